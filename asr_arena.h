@@ -0,0 +1,54 @@
+// Per-session scratch memory for the ASR MCP servers: the decoded audio of
+// a client message and the responses built while handling it.
+//
+// A monotonic arena is reset before each message. Its first block is part of
+// the session object, which covers a typical 4-16 KiB audio chunk and its
+// acknowledgement. Larger messages spill into a pool that keeps the blocks it
+// hands out for the next reset. Once a session has seen its largest chunk,
+// steady-state streaming does not allocate per message.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+namespace asr_arena {
+
+constexpr size_t INLINE_BYTES = 64 * 1024;
+constexpr size_t LARGEST_POOLED_BLOCK = 2 << 20; // Above a 1 MiB frame decoded
+
+using String = std::pmr::string;
+using Bytes = std::pmr::vector<uint8_t>;
+
+class MessageArena {
+public:
+  MessageArena()
+      : pool_(pool_options(), std::pmr::new_delete_resource()),
+        arena_(inline_, sizeof(inline_), &pool_) {}
+
+  MessageArena(const MessageArena &) = delete;
+  MessageArena &operator=(const MessageArena &) = delete;
+
+  std::pmr::memory_resource *resource() { return &arena_; }
+
+  // Frees everything allocated since the last reset; no container using the
+  // arena may outlive it.
+  void reset() { arena_.release(); }
+
+private:
+  static std::pmr::pool_options pool_options() {
+    std::pmr::pool_options options;
+    options.max_blocks_per_chunk = 4;
+    options.largest_required_pool_block = LARGEST_POOLED_BLOCK;
+    return options;
+  }
+
+  alignas(std::max_align_t) std::byte inline_[INLINE_BYTES];
+  std::pmr::unsynchronized_pool_resource pool_;
+  std::pmr::monotonic_buffer_resource arena_;
+};
+
+} // namespace asr_arena
@@ -0,0 +1,437 @@
+// Audio format normalization shared by the ASR MCP servers.
+//
+// Clients send PCM at whatever rate their capture device runs (often 44.1 or
+// 48 kHz, sometimes float or stereo). The ASR backends want 16 kHz mono
+// s16le, so every session owns an AudioNormalizer that converts the
+// negotiated input format to that target. The resampler is a windowed-sinc
+// polyphase filter whose history and phase persist across chunks, so
+// streaming chunks join without seams.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace asr_audio {
+
+constexpr uint32_t TARGET_SAMPLE_RATE = 16000;
+constexpr uint32_t MIN_SAMPLE_RATE = 8000;
+constexpr uint32_t MAX_SAMPLE_RATE = 192000;
+constexpr uint16_t MAX_CHANNELS = 8;
+constexpr size_t MAX_PHASES = 1024; // Caps L for awkward rate ratios
+constexpr size_t BASE_TAPS = 32;    // Taps per phase when not decimating
+constexpr size_t MAX_TAPS = 128;
+
+enum class SampleFormat { S16LE, F32LE };
+
+struct AudioFormat {
+  uint32_t sample_rate = TARGET_SAMPLE_RATE;
+  uint16_t channels = 1;
+  SampleFormat encoding = SampleFormat::S16LE;
+
+  size_t bytes_per_frame() const {
+    return static_cast<size_t>(channels) *
+           (encoding == SampleFormat::F32LE ? 4 : 2);
+  }
+
+  bool is_target() const {
+    return sample_rate == TARGET_SAMPLE_RATE && channels == 1 &&
+           encoding == SampleFormat::S16LE;
+  }
+
+  bool is_valid() const {
+    return sample_rate >= MIN_SAMPLE_RATE && sample_rate <= MAX_SAMPLE_RATE &&
+           channels >= 1 && channels <= MAX_CHANNELS;
+  }
+};
+
+inline const char *encoding_name(SampleFormat f) {
+  return f == SampleFormat::F32LE ? "f32le" : "s16le";
+}
+
+inline bool parse_encoding(const std::string &name, SampleFormat &out) {
+  if (name == "s16le" || name == "s16" || name == "pcm_s16le") {
+    out = SampleFormat::S16LE;
+    return true;
+  }
+  if (name == "f32le" || name == "f32" || name == "pcm_f32le") {
+    out = SampleFormat::F32LE;
+    return true;
+  }
+  return false;
+}
+
+// Looks up `"key":<number>` in a flat JSON message. Matches the string-search
+// style used for method dispatch; returns false if the key is absent.
+inline bool find_json_uint(const std::string &msg, const char *key,
+                           uint32_t &out) {
+  std::string needle = std::string("\"") + key + "\":";
+  size_t pos = msg.find(needle);
+  if (pos == std::string::npos)
+    return false;
+  pos += needle.size();
+  while (pos < msg.size() && msg[pos] == ' ')
+    ++pos;
+  uint64_t value = 0;
+  size_t start = pos;
+  while (pos < msg.size() && msg[pos] >= '0' && msg[pos] <= '9' &&
+         value <= UINT32_MAX) {
+    value = value * 10 + static_cast<uint64_t>(msg[pos] - '0');
+    ++pos;
+  }
+  if (pos == start || value > UINT32_MAX)
+    return false;
+  out = static_cast<uint32_t>(value);
+  return true;
+}
+
+inline bool find_json_string(const std::string &msg, const char *key,
+                             std::string &out) {
+  std::string needle = std::string("\"") + key + "\":\"";
+  size_t pos = msg.find(needle);
+  if (pos == std::string::npos)
+    return false;
+  pos += needle.size();
+  size_t end = msg.find('"', pos);
+  if (end == std::string::npos)
+    return false;
+  out = msg.substr(pos, end - pos);
+  return true;
+}
+
+// Reads optional "sample_rate", "channels" and "encoding" fields from a
+// handshake message into `fmt`. Returns false if a present field is invalid;
+// absent fields keep their current value.
+inline bool parse_format(const std::string &msg, AudioFormat &fmt) {
+  AudioFormat parsed = fmt;
+  uint32_t value = 0;
+  if (find_json_uint(msg, "sample_rate", value))
+    parsed.sample_rate = value;
+  if (find_json_uint(msg, "channels", value)) {
+    if (value > MAX_CHANNELS)
+      return false;
+    parsed.channels = static_cast<uint16_t>(value);
+  }
+  std::string encoding;
+  if (find_json_string(msg, "encoding", encoding) &&
+      !parse_encoding(encoding, parsed.encoding)) {
+    return false;
+  }
+  if (!parsed.is_valid())
+    return false;
+  fmt = parsed;
+  return true;
+}
+
+inline bool has_format_fields(const std::string &msg) {
+  return msg.find("\"sample_rate\"") != std::string::npos ||
+         msg.find("\"channels\"") != std::string::npos ||
+         msg.find("\"encoding\"") != std::string::npos;
+}
+
+inline std::string format_json(const AudioFormat &fmt) {
+  return "{\"sample_rate\":" + std::to_string(fmt.sample_rate) +
+         ",\"channels\":" + std::to_string(fmt.channels) +
+         ",\"encoding\":\"" + encoding_name(fmt.encoding) + "\"}";
+}
+
+// Dot product of two float arrays; the inner loop of the resampler.
+inline float dot(const float *a, const float *b, size_t n) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  __m128 acc0 = _mm_setzero_ps();
+  __m128 acc1 = _mm_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    acc0 = _mm_add_ps(acc0,
+                      _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    acc1 = _mm_add_ps(
+        acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+  }
+  acc0 = _mm_add_ps(acc0, acc1);
+  float lanes[4];
+  _mm_storeu_ps(lanes, acc0);
+  float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__ARM_NEON)
+  float32x4_t acc0 = vdupq_n_f32(0.0f);
+  float32x4_t acc1 = vdupq_n_f32(0.0f);
+  for (; i + 8 <= n; i += 8) {
+    acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+    acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+  }
+  acc0 = vaddq_f32(acc0, acc1);
+  float sum = vgetq_lane_f32(acc0, 0) + vgetq_lane_f32(acc0, 1) +
+              vgetq_lane_f32(acc0, 2) + vgetq_lane_f32(acc0, 3);
+#else
+  float sum = 0.0f;
+#endif
+  for (; i < n; ++i)
+    sum += a[i] * b[i];
+  return sum;
+}
+
+// Rational polyphase resampler (upsample by L, filter, decimate by M) for
+// mono float samples. Streaming: call process() with consecutive blocks.
+class PolyphaseResampler {
+public:
+  bool configure(uint32_t in_rate, uint32_t out_rate) {
+    uint32_t g = std::gcd(in_rate, out_rate);
+    up_ = out_rate / g;
+    down_ = in_rate / g;
+    if (up_ > MAX_PHASES)
+      return false;
+
+    // Wider filters when decimating so the anti-alias cutoff stays sharp
+    size_t ratio = (down_ + up_ - 1) / up_;
+    taps_ = std::min(MAX_TAPS, BASE_TAPS * std::max<size_t>(1, ratio));
+    // Keep taps a multiple of 8 for the vector loop
+    taps_ = (taps_ + 7) & ~static_cast<size_t>(7);
+
+    design_filter();
+    reset();
+    return true;
+  }
+
+  void reset() {
+    history_.assign(taps_ - 1, 0.0f);
+    pos_ = taps_ - 1;
+    phase_ = 0;
+  }
+
+  // Appends resampled output for `in` to `out`.
+  void process(const float *in, size_t n, std::vector<float> &out) {
+    history_.insert(history_.end(), in, in + n);
+
+    size_t avail = history_.size();
+    out.reserve(out.size() + (n * up_) / down_ + 1);
+    while (pos_ < avail) {
+      const float *window = history_.data() + pos_ + 1 - taps_;
+      out.push_back(dot(&coeffs_[phase_ * taps_], window, taps_));
+      phase_ += down_;
+      pos_ += phase_ / up_;
+      phase_ %= up_;
+    }
+
+    // Keep only the samples the next output still needs
+    size_t keep_from = pos_ + 1 - taps_;
+    if (keep_from > 0) {
+      keep_from = std::min(keep_from, history_.size());
+      history_.erase(history_.begin(),
+                     history_.begin() + static_cast<std::ptrdiff_t>(keep_from));
+      pos_ -= keep_from;
+    }
+  }
+
+private:
+  // Blackman-windowed sinc prototype at the upsampled rate, split into `up_`
+  // phases. Each phase is stored reversed so process() can take a straight
+  // dot product against the input window.
+  void design_filter() {
+    const size_t len = taps_ * up_;
+    const double cutoff = 0.5 / static_cast<double>(std::max(up_, down_));
+    const double fc = cutoff * 0.92; // Leave room for the transition band
+    const double center = (static_cast<double>(len) - 1.0) / 2.0;
+    const double pi = 3.14159265358979323846;
+
+    std::vector<double> proto(len);
+    for (size_t j = 0; j < len; ++j) {
+      double x = static_cast<double>(j) - center;
+      double sinc = x == 0.0 ? 2.0 * fc
+                             : std::sin(2.0 * pi * fc * x) / (pi * x);
+      double w = 0.42 -
+                 0.5 * std::cos(2.0 * pi * j / static_cast<double>(len - 1)) +
+                 0.08 * std::cos(4.0 * pi * j / static_cast<double>(len - 1));
+      proto[j] = sinc * w * static_cast<double>(up_);
+    }
+
+    coeffs_.assign(len, 0.0f);
+    for (size_t p = 0; p < up_; ++p) {
+      // Normalize each phase to unity DC gain so there is no ripple at the
+      // phase rate
+      double sum = 0.0;
+      for (size_t k = 0; k < taps_; ++k)
+        sum += proto[p + k * up_];
+      double norm = sum != 0.0 ? 1.0 / sum : 1.0;
+      for (size_t k = 0; k < taps_; ++k) {
+        coeffs_[p * taps_ + (taps_ - 1 - k)] =
+            static_cast<float>(proto[p + k * up_] * norm);
+      }
+    }
+  }
+
+  size_t up_ = 1;
+  size_t down_ = 1;
+  size_t taps_ = BASE_TAPS;
+  std::vector<float> coeffs_;
+  std::vector<float> history_;
+  size_t pos_ = 0;   // Index in history_ of the newest input for next output
+  size_t phase_ = 0; // Filter phase of the next output
+};
+
+// Converts one session's negotiated input format to 16 kHz mono s16le.
+class AudioNormalizer {
+public:
+  AudioNormalizer() { configure(AudioFormat{}); }
+
+  bool configure(const AudioFormat &fmt) {
+    if (!fmt.is_valid())
+      return false;
+    if (fmt.sample_rate != TARGET_SAMPLE_RATE &&
+        !resampler_.configure(fmt.sample_rate, TARGET_SAMPLE_RATE)) {
+      return false;
+    }
+    format_ = fmt;
+    pending_.clear();
+    return true;
+  }
+
+  const AudioFormat &format() const { return format_; }
+
+  bool is_passthrough() const { return format_.is_target(); }
+
+  // Clears filter history, e.g. when a new utterance starts.
+  void reset() {
+    pending_.clear();
+    if (format_.sample_rate != TARGET_SAMPLE_RATE)
+      resampler_.reset();
+  }
+
+  // Converts `len` input bytes and appends s16le output to `out`. Partial
+  // frames are held back until the next call.
+  void process(const uint8_t *data, size_t len, std::vector<uint8_t> &out) {
+    if (is_passthrough() && pending_.empty() && len % 2 == 0) {
+      out.insert(out.end(), data, data + len);
+      return;
+    }
+
+    const uint8_t *src = data;
+    size_t src_len = len;
+    if (!pending_.empty()) {
+      pending_.insert(pending_.end(), data, data + len);
+      src = pending_.data();
+      src_len = pending_.size();
+    }
+
+    const size_t frame_bytes = format_.bytes_per_frame();
+    const size_t frames = src_len / frame_bytes;
+    const size_t used = frames * frame_bytes;
+
+    mono_.resize(frames);
+    to_mono_float(src, frames, mono_.data());
+
+    if (format_.sample_rate == TARGET_SAMPLE_RATE) {
+      append_s16(mono_.data(), frames, out);
+    } else {
+      resampled_.clear();
+      resampler_.process(mono_.data(), frames, resampled_);
+      append_s16(resampled_.data(), resampled_.size(), out);
+    }
+
+    // Hold back any trailing partial frame
+    if (src == pending_.data()) {
+      pending_.erase(pending_.begin(),
+                     pending_.begin() + static_cast<std::ptrdiff_t>(used));
+    } else if (used < src_len) {
+      pending_.assign(src + used, src + src_len);
+    }
+  }
+
+private:
+  void to_mono_float(const uint8_t *src, size_t frames, float *dst) const {
+    const size_t ch = format_.channels;
+    const float scale = 1.0f / static_cast<float>(ch);
+    if (format_.encoding == SampleFormat::S16LE) {
+      for (size_t i = 0; i < frames; ++i) {
+        int32_t acc = 0;
+        for (size_t c = 0; c < ch; ++c) {
+          int16_t s;
+          std::memcpy(&s, src + (i * ch + c) * 2, 2);
+          acc += s;
+        }
+        dst[i] = static_cast<float>(acc) * (scale / 32768.0f);
+      }
+    } else {
+      for (size_t i = 0; i < frames; ++i) {
+        float acc = 0.0f;
+        for (size_t c = 0; c < ch; ++c) {
+          float s;
+          std::memcpy(&s, src + (i * ch + c) * 4, 4);
+          acc += s;
+        }
+        dst[i] = acc * scale;
+      }
+    }
+  }
+
+  static void append_s16(const float *in, size_t n, std::vector<uint8_t> &out) {
+    size_t base = out.size();
+    out.resize(base + n * 2);
+    uint8_t *dst = out.data() + base;
+    for (size_t i = 0; i < n; ++i) {
+      float v = in[i] * 32768.0f;
+      v = std::min(32767.0f, std::max(-32768.0f, v));
+      int16_t s = static_cast<int16_t>(std::lrintf(v));
+      std::memcpy(dst + i * 2, &s, 2);
+    }
+  }
+
+  AudioFormat format_;
+  PolyphaseResampler resampler_;
+  std::vector<uint8_t> pending_; // Trailing bytes of an incomplete frame
+  std::vector<float> mono_;
+  std::vector<float> resampled_;
+};
+
+// Length of normalized (16 kHz mono s16le) audio
+inline uint64_t pcm_duration_ms(size_t pcm_bytes) {
+  return pcm_bytes / (TARGET_SAMPLE_RATE * 2 / 1000);
+}
+
+// Prepends a canonical 44-byte RIFF/WAVE header for 16 kHz mono s16le PCM so
+// the batch backend can decode the upload.
+inline void append_wav_header(std::vector<uint8_t> &out, size_t pcm_bytes) {
+  auto put32 = [&out](uint32_t v) {
+    for (int i = 0; i < 4; ++i)
+      out.push_back(static_cast<uint8_t>((v >> (8 * i)) & 0xFF));
+  };
+  auto put16 = [&out](uint16_t v) {
+    out.push_back(static_cast<uint8_t>(v & 0xFF));
+    out.push_back(static_cast<uint8_t>((v >> 8) & 0xFF));
+  };
+  auto tag = [&out](const char *t) { out.insert(out.end(), t, t + 4); };
+
+  tag("RIFF");
+  put32(static_cast<uint32_t>(36 + pcm_bytes));
+  tag("WAVE");
+  tag("fmt ");
+  put32(16);
+  put16(1); // PCM
+  put16(1); // Mono
+  put32(TARGET_SAMPLE_RATE);
+  put32(TARGET_SAMPLE_RATE * 2);
+  put16(2);
+  put16(16);
+  tag("data");
+  put32(static_cast<uint32_t>(pcm_bytes));
+}
+
+// Header for an upload that starts before the recording ends. Both length
+// fields hold 0xFFFFFFFF, which decoders take as "read to end of stream".
+inline void append_streaming_wav_header(std::vector<uint8_t> &out) {
+  size_t start = out.size();
+  append_wav_header(out, 0);
+  for (size_t field : {size_t(4), size_t(40)})
+    memset(out.data() + start + field, 0xFF, 4);
+}
+
+} // namespace asr_audio
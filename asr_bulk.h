@@ -0,0 +1,303 @@
+// Offline bulk transcription for asr_mcp_batch --bulk: the inputs of a run,
+// its output files and the checkpoint they double as.
+//
+// The input is a directory, whose *.wav files are transcribed in name order,
+// or a manifest listing one WAV path per line (blank lines and lines starting
+// with '#' are skipped; relative paths are taken from the manifest's
+// directory). Each file is memory-mapped and uploaded from the mapping as it
+// is.
+//
+// The output is JSONL, one record per file in input order:
+//
+//   {"file":"<path>","audio_ms":<n>,"results":[<result objects>]}
+//
+// and, optionally, an SRT file per input, named after it (see srt_names). A
+// record is appended only once its
+// file is fully transcribed (and its SRT written), so the output is also the
+// checkpoint: a rerun with the same output skips every file it already
+// records, after dropping a last line the interrupted run left incomplete.
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "asr_protocol.h"
+
+namespace asr_bulk {
+
+// The files named by `source`, a directory or a manifest. False, with
+// `error` set, if it cannot be read.
+inline bool list_inputs(const std::string &source,
+                        std::vector<std::string> &inputs, std::string &error) {
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  if (fs::is_directory(source, ec)) {
+    for (fs::directory_iterator it(source, ec), end; !ec && it != end;
+         it.increment(ec)) {
+      std::string ext = it->path().extension().string();
+      std::transform(ext.begin(), ext.end(), ext.begin(),
+                     [](unsigned char c) { return std::tolower(c); });
+      if (ext == ".wav" && it->is_regular_file(ec))
+        inputs.push_back(it->path().string());
+    }
+    if (ec) {
+      error = ec.message();
+      return false;
+    }
+    std::sort(inputs.begin(), inputs.end());
+    return true;
+  }
+
+  std::ifstream manifest(source);
+  if (!manifest) {
+    error = strerror(errno);
+    return false;
+  }
+  const fs::path base = fs::path(source).parent_path();
+  std::string line;
+  while (std::getline(manifest, line)) {
+    const size_t first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#')
+      continue;
+    const size_t last = line.find_last_not_of(" \t\r");
+    fs::path path = line.substr(first, last - first + 1);
+    inputs.push_back(path.is_absolute() ? path.string()
+                                        : (base / path).string());
+  }
+  return true;
+}
+
+// The SRT file name of each of `inputs`: "<stem>.srt", or "<stem>.<n>.srt"
+// with n its 1-based position when other inputs share the stem, ignoring
+// case (a.wav and a.WAV, or a.wav in two manifest directories). The names
+// depend on the whole list only, so a rerun picks the same ones. False, with
+// `error` set, if two names still clash.
+inline bool srt_names(const std::vector<std::string> &inputs,
+                      std::vector<std::string> &names, std::string &error) {
+  auto folded = [](std::string name) {
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return name;
+  };
+  std::vector<std::string> stems;
+  std::unordered_map<std::string, size_t> uses;
+  for (const std::string &input : inputs) {
+    stems.push_back(std::filesystem::path(input).stem().string());
+    ++uses[folded(stems.back())];
+  }
+  names.clear();
+  std::unordered_map<std::string, size_t> taken;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    std::string name = stems[i];
+    if (uses[folded(name)] > 1)
+      name += '.' + std::to_string(i + 1);
+    name += ".srt";
+    auto it = taken.emplace(folded(name), i);
+    if (!it.second) {
+      error = "SRT name " + name + " of " + inputs[i] + " is also that of " +
+              inputs[it.first->second];
+      return false;
+    }
+    names.push_back(std::move(name));
+  }
+  return true;
+}
+
+// A read-only mapping of a whole input file.
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile() {
+    if (data_)
+      munmap(data_, size_);
+  }
+
+  // False, with errno set, if the file cannot be mapped
+  bool open(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      const int saved = errno;
+      close(fd);
+      errno = saved;
+      return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    void *data = size_ ? mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0)
+                       : nullptr;
+    const int saved = errno;
+    close(fd);
+    if (data == MAP_FAILED) {
+      errno = saved;
+      size_ = 0;
+      return false;
+    }
+    data_ = data;
+    // Read once, front to back, by the upload
+    if (data_)
+      madvise(data_, size_, MADV_SEQUENTIAL);
+    return true;
+  }
+
+  const uint8_t *data() const { return static_cast<const uint8_t *>(data_); }
+  size_t size() const { return size_; }
+
+private:
+  void *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Duration of the audio in a RIFF/WAVE file, from its fmt and data chunks.
+// False if `data` is not a WAV file.
+inline bool wav_duration_ms(const uint8_t *data, size_t len, uint64_t &ms) {
+  auto u32 = [&](size_t at) {
+    return static_cast<uint32_t>(data[at]) |
+           static_cast<uint32_t>(data[at + 1]) << 8 |
+           static_cast<uint32_t>(data[at + 2]) << 16 |
+           static_cast<uint32_t>(data[at + 3]) << 24;
+  };
+  if (len < 12 || memcmp(data, "RIFF", 4) != 0 ||
+      memcmp(data + 8, "WAVE", 4) != 0)
+    return false;
+  uint32_t byte_rate = 0;
+  size_t at = 12;
+  while (at + 8 <= len) {
+    const uint32_t size = u32(at + 4);
+    const size_t body = at + 8;
+    if (memcmp(data + at, "fmt ", 4) == 0 && size >= 16 && body + 16 <= len) {
+      byte_rate = u32(body + 8);
+    } else if (memcmp(data + at, "data", 4) == 0) {
+      if (byte_rate == 0)
+        return false;
+      // Streamed WAVs leave the size unset; the file holds what there is
+      const uint64_t bytes = std::min<uint64_t>(size, len - body);
+      ms = bytes * 1000 / byte_rate;
+      return true;
+    }
+    at = body + size + (size & 1);
+  }
+  return false;
+}
+
+// Appends the output record for `file`; `results` are JSON objects.
+inline void append_record(std::string &out, const std::string &file,
+                          uint64_t audio_ms,
+                          const std::vector<std::string> &results) {
+  out += "{\"file\":\"";
+  asr_protocol::append_json_escaped(out, file);
+  out += "\",\"audio_ms\":";
+  out += std::to_string(audio_ms);
+  out += ",\"results\":[";
+  for (size_t i = 0; i < results.size(); ++i) {
+    if (i)
+      out += ',';
+    out += results[i];
+  }
+  out += "]}\n";
+}
+
+// Reads the files recorded in an earlier run's output into `done`. An
+// incomplete last record is cut off so that appending resumes cleanly.
+// False, with errno set, if the output exists but cannot be read or cut.
+inline bool load_checkpoint(const std::string &path,
+                            std::unordered_set<std::string> &done) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return errno == ENOENT;
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    return false;
+  std::string line;
+  uint64_t complete = 0;
+  while (std::getline(in, line)) {
+    if (in.eof())
+      break; // No newline: cut off below
+    complete += line.size() + 1;
+    size_t begin, end;
+    std::string file;
+    if (asr_protocol::find_string_member(line, "file", 0, begin, end) &&
+        asr_protocol::json_unescape(line, begin - 1, file))
+      done.insert(std::move(file));
+  }
+  in.close();
+  if (static_cast<uint64_t>(st.st_size) != complete)
+    return truncate(path.c_str(), static_cast<off_t>(complete)) == 0;
+  return true;
+}
+
+// "HH:MM:SS,mmm"
+inline void append_srt_time(std::string &out, uint64_t ms) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%02llu:%02llu:%02llu,%03llu",
+           static_cast<unsigned long long>(ms / 3600000),
+           static_cast<unsigned long long>(ms / 60000 % 60),
+           static_cast<unsigned long long>(ms / 1000 % 60),
+           static_cast<unsigned long long>(ms % 1000));
+  out += buf;
+}
+
+// SRT subtitles for one file's results. Cues come from verbose_json
+// "segments", or from results that carry their own "start" and "end"; if
+// there are none, the text of the results is one cue spanning the file.
+inline std::string make_srt(const std::vector<std::string> &results,
+                            uint64_t audio_ms) {
+  std::string srt;
+  int cue = 0;
+  auto add_cue = [&](uint64_t start, uint64_t end, const std::string &text) {
+    const size_t first = text.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos)
+      return;
+    srt += std::to_string(++cue);
+    srt += '\n';
+    append_srt_time(srt, start);
+    srt += " --> ";
+    append_srt_time(srt, std::max(start, end));
+    srt += '\n';
+    srt.append(text, first, text.find_last_not_of(" \t\r\n") + 1 - first);
+    srt += "\n\n";
+  };
+  auto add_segment = [&](const asr_protocol::Segment &segment) {
+    add_cue(static_cast<uint64_t>(segment.start * 1000 + 0.5),
+            static_cast<uint64_t>(segment.end * 1000 + 0.5), segment.text);
+  };
+
+  std::string untimed, text;
+  asr_protocol::Segment segment;
+  for (const std::string &object : results) {
+    if (asr_protocol::for_each_segment(object, add_segment))
+      continue;
+    if (asr_protocol::parse_segment(object, segment)) {
+      add_segment(segment);
+      continue;
+    }
+    size_t begin, end;
+    if (asr_protocol::find_string_member(object, "text", 0, begin, end) &&
+        asr_protocol::json_unescape(object, begin - 1, text))
+      untimed += text;
+  }
+  if (cue == 0)
+    add_cue(0, audio_ms, untimed);
+  return srt;
+}
+
+} // namespace asr_bulk
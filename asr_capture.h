@@ -0,0 +1,371 @@
+// Opt-in session traffic capture for the ASR MCP servers.
+//
+// When ASR_CAPTURE_FILE is set ("%p" expands to the pid), every client frame,
+// every response to the client and every upstream exchange is appended to a
+// compact binary log with monotonic timestamps. tools/asr_replay reads the
+// log back and drives a server with it.
+//
+// As with asr_log.h, each thread owns a single-producer/single-consumer byte
+// ring: recording is a bounds check, two memcpys and one release store. A
+// background thread writes the rings out in bulk. If a ring is full the
+// record is dropped and counted rather than stalling the session. With
+// capture off, record() costs one relaxed load.
+//
+// File layout: FileHeader, then Records back to back, each a RecordHeader
+// followed by `len` payload bytes. Integers are little-endian.
+
+#pragma once
+
+#include "asr_log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace asr_capture {
+
+constexpr char MAGIC[8] = {'A', 'S', 'R', 'C', 'A', 'P', 0, 1};
+constexpr size_t RING_BYTES = 1 << 20; // Per thread, power of two
+constexpr int DRAIN_INTERVAL_MS = 20;
+constexpr uint32_t MAX_PAYLOAD = (1u << 24) - 1;
+
+static_assert((RING_BYTES & (RING_BYTES - 1)) == 0,
+              "RING_BYTES must be a power of two");
+
+enum class Kind : uint8_t {
+  SessionOpen = 1,
+  SessionClose,
+  ClientFrame,     // Bytes received from the client
+  ServerFrame,     // Message sent to the client
+  UpstreamOpen,    // Upstream connection established / request started
+  UpstreamMessage, // Message or body chunk received from upstream
+};
+
+struct FileHeader {
+  char magic[8];
+  int64_t wall_start_us; // Wall clock at t_ns == 0
+};
+
+struct RecordHeader {
+  uint64_t t_ns;     // Monotonic, since capture start
+  uint32_t session;  // 0 for records outside a session
+  uint32_t kind_len; // Kind in the top 8 bits, payload length below
+};
+
+static_assert(sizeof(FileHeader) == 16 && sizeof(RecordHeader) == 16,
+              "capture headers are part of the file format");
+
+inline uint32_t pack_kind_len(Kind kind, uint32_t len) {
+  return (static_cast<uint32_t>(kind) << 24) | len;
+}
+
+inline Kind record_kind(const RecordHeader &h) {
+  return static_cast<Kind>(h.kind_len >> 24);
+}
+
+inline uint32_t record_len(const RecordHeader &h) {
+  return h.kind_len & MAX_PAYLOAD;
+}
+
+// SPSC byte ring: the owning thread appends records, the writer drains.
+class Ring {
+public:
+  Ring() : bytes_(new uint8_t[RING_BYTES]) {}
+
+  bool push(const RecordHeader &header, const void *payload, size_t len) {
+    const size_t need = sizeof(header) + len;
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head + need - tail_.load(std::memory_order_acquire) > RING_BYTES) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    copy_in(head, &header, sizeof(header));
+    copy_in(head + sizeof(header), payload, len);
+    head_.store(head + need, std::memory_order_release);
+    return true;
+  }
+
+  // Hands the published bytes to `fn` as at most two contiguous spans.
+  template <typename Fn> void drain(Fn &&fn) {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    uint64_t head = head_.load(std::memory_order_acquire);
+    if (head == tail)
+      return;
+    size_t start = tail & (RING_BYTES - 1);
+    size_t total = static_cast<size_t>(head - tail);
+    size_t first = std::min(total, RING_BYTES - start);
+    fn(bytes_.get() + start, first);
+    if (first < total)
+      fn(bytes_.get(), total - first);
+    tail_.store(head, std::memory_order_release);
+  }
+
+  bool empty() const {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+
+  uint64_t take_dropped() {
+    return dropped_.exchange(0, std::memory_order_relaxed);
+  }
+
+  std::atomic<bool> retired{false};
+
+private:
+  void copy_in(uint64_t pos, const void *src, size_t len) {
+    if (len == 0)
+      return;
+    size_t start = pos & (RING_BYTES - 1);
+    size_t first = std::min(len, RING_BYTES - start);
+    memcpy(bytes_.get() + start, src, first);
+    if (first < len)
+      memcpy(bytes_.get(), static_cast<const uint8_t *>(src) + first,
+             len - first);
+  }
+
+  alignas(64) std::atomic<uint64_t> head_{0};
+  alignas(64) std::atomic<uint64_t> tail_{0};
+  alignas(64) std::atomic<uint64_t> dropped_{0};
+  std::unique_ptr<uint8_t[]> bytes_;
+};
+
+class Capture {
+public:
+  static Capture &instance() {
+    static Capture capture;
+    return capture;
+  }
+
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  // Allocates a session id and records its start. Returns 0 when capture is
+  // off.
+  uint32_t open_session() {
+    if (!enabled())
+      return 0;
+    uint32_t id = next_session_.fetch_add(1, std::memory_order_relaxed);
+    record(id, Kind::SessionOpen, nullptr, 0);
+    return id;
+  }
+
+  void close_session(uint32_t session) {
+    if (session != 0)
+      record(session, Kind::SessionClose, nullptr, 0);
+  }
+
+  void record(uint32_t session, Kind kind, const void *data, size_t len) {
+    if (!enabled() || len > MAX_PAYLOAD)
+      return;
+    RecordHeader header;
+    header.t_ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_)
+            .count());
+    header.session = session;
+    header.kind_len = pack_kind_len(kind, static_cast<uint32_t>(len));
+    local_ring()->push(header, data, len);
+  }
+
+  void flush() {
+    std::lock_guard<std::mutex> lock(drain_mutex_);
+    drain_once();
+  }
+
+  ~Capture() {
+    if (!file_)
+      return;
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+      running_ = false;
+    }
+    wake_.notify_one();
+    if (writer_.joinable())
+      writer_.join();
+    flush();
+    fclose(file_);
+  }
+
+private:
+  Capture() : start_(std::chrono::steady_clock::now()) {
+    const char *env_path = std::getenv("ASR_CAPTURE_FILE");
+    if (!env_path || !*env_path)
+      return;
+    std::string path(env_path);
+    size_t pid_pos = path.find("%p");
+    if (pid_pos != std::string::npos)
+      path.replace(pid_pos, 2, std::to_string(getpid()));
+
+    file_ = fopen(path.c_str(), "wb");
+    if (!file_) {
+      ASR_LOG_WARN("Capture disabled: cannot open %s: %s", path.c_str(),
+                   strerror(errno));
+      return;
+    }
+    FileHeader header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.wall_start_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    fwrite(&header, sizeof(header), 1, file_);
+    ASR_LOG_INFO("Capturing session traffic to %s", path.c_str());
+
+    enabled_ = true;
+    writer_ = std::thread(&Capture::write_loop, this);
+  }
+
+  Capture(const Capture &) = delete;
+  Capture &operator=(const Capture &) = delete;
+
+  struct LocalHandle {
+    std::shared_ptr<Ring> ring;
+    ~LocalHandle() {
+      if (ring)
+        ring->retired.store(true, std::memory_order_release);
+    }
+  };
+
+  Ring *local_ring() {
+    thread_local LocalHandle handle;
+    if (!handle.ring) {
+      handle.ring = std::make_shared<Ring>();
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      rings_.push_back(handle.ring);
+    }
+    return handle.ring.get();
+  }
+
+  void write_loop() {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    while (running_) {
+      wake_.wait_for(lock, std::chrono::milliseconds(DRAIN_INTERVAL_MS));
+      lock.unlock();
+      flush();
+      lock.lock();
+    }
+  }
+
+  // Records from different threads interleave in the file in drain order,
+  // not timestamp order; readers sort by t_ns.
+  void drain_once() {
+    std::vector<std::shared_ptr<Ring>> snapshot;
+    {
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      snapshot = rings_;
+    }
+
+    bool wrote = false;
+    for (auto &ring : snapshot) {
+      bool retired = ring->retired.load(std::memory_order_acquire);
+      ring->drain([&](const uint8_t *data, size_t len) {
+        fwrite(data, 1, len, file_);
+        wrote = true;
+      });
+      if (uint64_t dropped = ring->take_dropped()) {
+        ASR_LOG_WARN("Capture dropped %llu records",
+                     static_cast<unsigned long long>(dropped));
+      }
+      if (retired && ring->empty()) {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        for (auto it = rings_.begin(); it != rings_.end(); ++it) {
+          if (*it == ring) {
+            rings_.erase(it);
+            break;
+          }
+        }
+      }
+    }
+    if (wrote)
+      fflush(file_);
+  }
+
+  const std::chrono::steady_clock::time_point start_;
+  std::atomic<bool> enabled_{false};
+  std::atomic<uint32_t> next_session_{1};
+  FILE *file_ = nullptr;
+
+  std::mutex rings_mutex_;
+  std::vector<std::shared_ptr<Ring>> rings_;
+  std::mutex drain_mutex_;
+
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  bool running_ = true;
+  std::thread writer_;
+};
+
+inline uint32_t open_session() { return Capture::instance().open_session(); }
+
+inline void close_session(uint32_t session) {
+  Capture::instance().close_session(session);
+}
+
+inline void record(uint32_t session, Kind kind, const void *data, size_t len) {
+  Capture::instance().record(session, kind, data, len);
+}
+
+inline void record(uint32_t session, Kind kind, const std::string &data) {
+  record(session, kind, data.data(), data.size());
+}
+
+// ----------------------------------------------------------------------------
+// Reading
+// ----------------------------------------------------------------------------
+
+struct Event {
+  uint64_t t_ns;
+  uint32_t session;
+  Kind kind;
+  std::string data;
+};
+
+// Loads a capture file, sorted by timestamp. Returns false if the file is
+// missing or not a capture; a truncated final record is ignored.
+inline bool read_file(const std::string &path, std::vector<Event> &events,
+                      int64_t *wall_start_us = nullptr) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file)
+    return false;
+  FileHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+    fclose(file);
+    return false;
+  }
+  if (wall_start_us)
+    *wall_start_us = header.wall_start_us;
+
+  RecordHeader rec;
+  while (fread(&rec, sizeof(rec), 1, file) == 1) {
+    Event event;
+    event.t_ns = rec.t_ns;
+    event.session = rec.session;
+    event.kind = record_kind(rec);
+    event.data.resize(record_len(rec));
+    if (!event.data.empty() &&
+        fread(&event.data[0], 1, event.data.size(), file) !=
+            event.data.size()) {
+      break;
+    }
+    events.push_back(std::move(event));
+  }
+  fclose(file);
+
+  std::stable_sort(events.begin(), events.end(),
+                   [](const Event &a, const Event &b) { return a.t_ns < b.t_ns; });
+  return true;
+}
+
+} // namespace asr_capture
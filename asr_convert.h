@@ -0,0 +1,374 @@
+// Script conversion of transcription results: Traditional/Simplified and
+// colloquial Cantonese to standard written forms, or whatever the configured
+// dictionaries map.
+//
+// ASR_CONVERT lists the dictionaries, in the text format of OpenCC's
+// dictionary sources: one entry per line, the phrase, a tab, then one or
+// more replacements separated by spaces (the first is used). Stages are
+// separated by ';' and run in order; the files of one stage, separated by
+// ',', are merged, the first file winning on duplicates. For example,
+// colloquial Cantonese to written Chinese and then to Simplified:
+//
+//   ASR_CONVERT=/etc/asr/yue_written.txt;TSPhrases.txt,TSCharacters.txt
+//
+// Each stage is a double-array trie over UTF-8 bytes, built once at startup
+// from the memory-mapped files. Replacements are not copied: they point
+// into the mappings. Conversion takes the longest matching phrase at each
+// character and copies everything else through; it appends to caller
+// buffers, so with reused buffers it does not allocate.
+//
+// Entries whose phrase contains ASCII are ignored, so conversion can run
+// over a whole JSON result without touching its structure.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "asr_log.h"
+#include "asr_upstream.h"
+
+namespace asr_convert {
+
+// Bytes in the UTF-8 sequence that starts with `lead`
+inline size_t utf8_length(uint8_t lead) {
+  if (lead < 0xC0)
+    return 1; // ASCII, or a stray continuation byte copied alone
+  if (lead < 0xE0)
+    return 2;
+  if (lead < 0xF0)
+    return 3;
+  return 4;
+}
+
+// One conversion stage.
+class Dictionary {
+public:
+  Dictionary() = default;
+  Dictionary(Dictionary &&) = default;
+  Dictionary &operator=(Dictionary &&) = default;
+  Dictionary(const Dictionary &) = delete;
+  Dictionary &operator=(const Dictionary &) = delete;
+
+  ~Dictionary() {
+    for (const Mapping &m : mappings_)
+      munmap(m.data, m.size);
+  }
+
+  // Maps a dictionary file and adds its entries. False if it cannot be
+  // read.
+  bool load(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      if (fd >= 0)
+        close(fd);
+      return false;
+    }
+    const size_t size = static_cast<size_t>(st.st_size);
+    void *data = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)
+                      : nullptr;
+    close(fd);
+    if (data == MAP_FAILED)
+      return false;
+    if (data)
+      mappings_.push_back({data, size});
+    add(std::string_view(static_cast<const char *>(data), size));
+    return true;
+  }
+
+  // Adds the entries in `text`, which must outlive the dictionary
+  void add(std::string_view text) {
+    size_t pos = 0;
+    while (pos < text.size()) {
+      size_t end = text.find('\n', pos);
+      if (end == std::string_view::npos)
+        end = text.size();
+      std::string_view line = text.substr(pos, end - pos);
+      pos = end + 1;
+      if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+      const size_t tab = line.find('\t');
+      if (tab == 0 || tab == std::string_view::npos || line[0] == '#')
+        continue;
+      std::string_view key = line.substr(0, tab);
+      std::string_view value = line.substr(tab + 1);
+      value = value.substr(0, value.find(' '));
+      if (std::any_of(key.begin(), key.end(),
+                      [](char c) { return (c & 0x80) == 0; }))
+        continue;
+      pending_.push_back({key, value});
+    }
+  }
+
+  // Builds the trie from the entries added; call once, before convert()
+  void build() {
+    std::stable_sort(pending_.begin(), pending_.end(),
+                     [](const Entry &a, const Entry &b) {
+                       return a.key < b.key;
+                     });
+    auto dup = std::unique(pending_.begin(), pending_.end(),
+                           [](const Entry &a, const Entry &b) {
+                             return a.key == b.key;
+                           });
+    pending_.erase(dup, pending_.end());
+
+    units_.clear();
+    free_head_ = free_tail_ = NONE;
+    extend(512);
+    occupy(0, 0); // The root
+    values_.reserve(pending_.size());
+    if (!pending_.empty())
+      insert(0, 0, pending_.size(), 0);
+    while (!units_.empty() && units_.back().check < 0)
+      units_.pop_back();
+    units_.shrink_to_fit();
+    std::vector<Entry>().swap(pending_);
+    std::vector<FreeLink>().swap(free_);
+  }
+
+  size_t size() const { return values_.size(); }
+  size_t memory_bytes() const {
+    return units_.size() * sizeof(Unit) +
+           values_.size() * sizeof(std::string_view);
+  }
+
+  // Appends `in` to `out` with every longest match replaced
+  template <typename String>
+  void convert(std::string_view in, String &out) const {
+    const size_t n = in.size();
+    size_t i = 0;
+    while (i < n) {
+      // Phrases never contain ASCII; copy runs of it in one go
+      size_t run = i;
+      while (run < n && (static_cast<uint8_t>(in[run]) & 0x80) == 0)
+        ++run;
+      if (run > i) {
+        out.append(in.data() + i, run - i);
+        i = run;
+        continue;
+      }
+
+      int32_t match = -1;
+      size_t match_end = i;
+      uint32_t s = 0;
+      for (size_t j = i; j < n; ++j) {
+        const uint32_t t = static_cast<uint32_t>(units_[s].base) +
+                           static_cast<uint8_t>(in[j]);
+        if (t >= units_.size() || units_[t].check != static_cast<int32_t>(s))
+          break;
+        s = t;
+        if (units_[s].value >= 0) {
+          match = units_[s].value;
+          match_end = j + 1;
+        }
+      }
+      if (match >= 0) {
+        const std::string_view v = values_[static_cast<size_t>(match)];
+        out.append(v.data(), v.size());
+        i = match_end;
+      } else {
+        const size_t len =
+            std::min(utf8_length(static_cast<uint8_t>(in[i])), n - i);
+        out.append(in.data() + i, len);
+        i += len;
+      }
+    }
+  }
+
+private:
+  struct Unit {
+    int32_t base = 0;
+    int32_t check = -1; // Parent unit; -1 while free
+    int32_t value = -1; // Index into values_ if a phrase ends here
+  };
+
+  struct Entry {
+    std::string_view key;
+    std::string_view value;
+  };
+
+  struct Mapping {
+    void *data;
+    size_t size;
+  };
+
+  // Build only
+  struct FreeLink {
+    uint32_t prev;
+    uint32_t next;
+    uint8_t tries = 0;
+  };
+  static constexpr uint32_t NONE = UINT32_MAX;
+  static constexpr uint8_t MAX_TRIES = 16;
+
+  // Places the children of `unit`, which covers the sorted entries
+  // [lo, hi) sharing their first `depth` bytes, then recurses into them.
+  void insert(uint32_t unit, size_t lo, size_t hi, size_t depth) {
+    if (pending_[lo].key.size() == depth) {
+      units_[unit].value = static_cast<int32_t>(values_.size());
+      values_.push_back(pending_[lo].value);
+      ++lo;
+    }
+    if (lo == hi)
+      return;
+
+    std::vector<uint8_t> labels;
+    for (size_t k = lo; k < hi; ++k) {
+      const uint8_t c = static_cast<uint8_t>(pending_[k].key[depth]);
+      if (labels.empty() || labels.back() != c)
+        labels.push_back(c);
+    }
+
+    const uint32_t base = find_base(labels);
+    units_[unit].base = static_cast<int32_t>(base);
+    for (uint8_t c : labels)
+      occupy(base + c, unit);
+
+    size_t k = lo;
+    for (uint8_t c : labels) {
+      size_t end = k;
+      while (end < hi && static_cast<uint8_t>(pending_[end].key[depth]) == c)
+        ++end;
+      insert(base + c, k, end, depth + 1);
+      k = end;
+    }
+  }
+
+  // A base at which every label lands on a free unit. Candidates come from
+  // the free list; a unit passed over MAX_TRIES times leaves it, so the
+  // search stays short as the array fills up.
+  uint32_t find_base(const std::vector<uint8_t> &labels) {
+    uint32_t pos = free_head_;
+    while (true) {
+      if (pos == NONE) {
+        pos = static_cast<uint32_t>(units_.size());
+        extend(units_.size() * 2);
+      }
+      if (pos > labels[0]) {
+        const uint32_t base = pos - labels[0];
+        if (base + 256 > units_.size())
+          extend(units_.size() * 2);
+        bool fits = std::all_of(labels.begin(), labels.end(), [&](uint8_t c) {
+          return units_[base + c].check < 0;
+        });
+        if (fits)
+          return base;
+      }
+      const uint32_t next = free_[pos].next;
+      if (++free_[pos].tries >= MAX_TRIES)
+        unlink(pos);
+      pos = next;
+    }
+  }
+
+  void occupy(uint32_t unit, uint32_t parent) {
+    units_[unit].check = static_cast<int32_t>(parent);
+    if (free_[unit].tries < MAX_TRIES)
+      unlink(unit);
+  }
+
+  // Grows the array to `size` units, the new ones joining the free list
+  void extend(size_t size) {
+    const size_t old = units_.size();
+    units_.resize(size);
+    free_.resize(size);
+    for (size_t i = old; i < size; ++i) {
+      const uint32_t unit = static_cast<uint32_t>(i);
+      free_[unit].prev = free_tail_;
+      free_[unit].next = NONE;
+      if (free_tail_ == NONE)
+        free_head_ = unit;
+      else
+        free_[free_tail_].next = unit;
+      free_tail_ = unit;
+    }
+  }
+
+  // Takes `unit` off the free list; its own links are left for a caller
+  // walking the list
+  void unlink(uint32_t unit) {
+    FreeLink &link = free_[unit];
+    if (link.prev == NONE)
+      free_head_ = link.next;
+    else
+      free_[link.prev].next = link.next;
+    if (link.next == NONE)
+      free_tail_ = link.prev;
+    else
+      free_[link.next].prev = link.prev;
+    link.tries = MAX_TRIES;
+  }
+
+  std::vector<Unit> units_;
+  std::vector<std::string_view> values_;
+  std::vector<Mapping> mappings_;
+  std::vector<Entry> pending_; // Until build()
+  std::vector<FreeLink> free_;
+  uint32_t free_head_ = NONE;
+  uint32_t free_tail_ = NONE;
+};
+
+class Converter {
+public:
+  // The stages configured in ASR_CONVERT, loaded on first use
+  static const Converter &instance() {
+    static const Converter converter(std::getenv("ASR_CONVERT"));
+    return converter;
+  }
+
+  explicit Converter(const char *spec) {
+    if (!spec)
+      return;
+    std::string stages = spec;
+    size_t pos = 0;
+    while (pos <= stages.size()) {
+      size_t end = stages.find(';', pos);
+      if (end == std::string::npos)
+        end = stages.size();
+      Dictionary stage;
+      for (const std::string &path :
+           asr_upstream::split_list(stages.substr(pos, end - pos))) {
+        if (!stage.load(path))
+          ASR_LOG_WARN("Conversion dictionary %s unreadable", path.c_str());
+      }
+      stage.build();
+      if (stage.size() > 0) {
+        ASR_LOG_INFO("Conversion stage %zu: %zu phrases, %zu KiB",
+                     stages_.size() + 1, stage.size(),
+                     stage.memory_bytes() / 1024);
+        stages_.push_back(std::move(stage));
+      }
+      pos = end + 1;
+    }
+  }
+
+  bool enabled() const { return !stages_.empty(); }
+  const std::vector<Dictionary> &stages() const { return stages_; }
+
+  // Replaces `out` with `in` run through every stage. `scratch` holds the
+  // intermediate results; with both reused, conversion does not allocate.
+  template <typename String>
+  void convert(std::string_view in, String &out, String &scratch) const {
+    out.assign(in.data(), in.size());
+    for (const Dictionary &stage : stages_) {
+      scratch.clear();
+      stage.convert(out, scratch);
+      out.swap(scratch);
+    }
+  }
+
+private:
+  std::vector<Dictionary> stages_;
+};
+
+} // namespace asr_convert
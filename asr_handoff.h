@@ -0,0 +1,232 @@
+// Listening-socket handoff for zero-downtime restarts.
+//
+// A running server exposes a Unix domain socket (ASR_HANDOFF_SOCKET, default
+// /tmp/asr_mcp_<port>.sock). A replacement started with --upgrade connects to
+// it and receives the listening sockets via SCM_RIGHTS, so the ports are
+// never closed. Once the successor acknowledges, the old process stops
+// accepting and drains its existing sessions.
+//
+// Exchange (one byte each way):
+//   old -> new: 'L' + SCM_RIGHTS(listen fds: MCP port, then WebSocket port)
+//   new -> old: 'A' once it is accepting on the inherited sockets
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace asr_handoff {
+
+constexpr int HANDOFF_TIMEOUT_MS = 5000;
+constexpr char MSG_LISTENER = 'L';
+constexpr char MSG_ACK = 'A';
+constexpr size_t MAX_LISTENERS = 2; // MCP TCP port, WebSocket port
+
+inline std::string socket_path(int port) {
+  const char *env_path = std::getenv("ASR_HANDOFF_SOCKET");
+  if (env_path && strlen(env_path) > 0) {
+    return std::string(env_path);
+  }
+  return "/tmp/asr_mcp_" + std::to_string(port) + ".sock";
+}
+
+inline bool make_address(const std::string &path, sockaddr_un &addr) {
+  if (path.size() >= sizeof(addr.sun_path))
+    return false;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+inline bool wait_readable(int fd, int timeout_ms) {
+  struct pollfd pfd = {fd, POLLIN, 0};
+  return poll(&pfd, 1, timeout_ms) > 0 && (pfd.revents & POLLIN);
+}
+
+// Sends up to MAX_LISTENERS descriptors in one message.
+inline bool send_fds(int sock, const int *fds, size_t count) {
+  char tag = MSG_LISTENER;
+  struct iovec iov = {&tag, 1};
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) *
+                                                  MAX_LISTENERS)] = {};
+
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+
+  return sendmsg(sock, &msg, MSG_NOSIGNAL) == 1;
+}
+
+// Returns the number of descriptors received (0 on error).
+inline size_t recv_fds(int sock, int *fds, size_t max) {
+  char tag = 0;
+  struct iovec iov = {&tag, 1};
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) *
+                                                  MAX_LISTENERS)] = {};
+
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  if (recvmsg(sock, &msg, 0) != 1 || tag != MSG_LISTENER)
+    return 0;
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len < CMSG_LEN(0)) {
+    return 0;
+  }
+  // The control buffer holds at most MAX_LISTENERS; with more the kernel
+  // truncates (closing what did not fit) and the message is rejected
+  size_t count = std::min<size_t>((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int),
+                                  MAX_LISTENERS);
+  int received[MAX_LISTENERS];
+  memcpy(received, CMSG_DATA(cmsg), sizeof(int) * count);
+  const size_t keep = (msg.msg_flags & MSG_CTRUNC) ? 0 : std::min(count, max);
+  for (size_t i = keep; i < count; ++i)
+    close(received[i]);
+  std::copy(received, received + keep, fds);
+  return keep;
+}
+
+// Successor side: fetches the listening sockets from the running instance,
+// in the order it passed them to serve(). Returns how many were received, 0
+// if no instance answered. Call acknowledge() once they are in use.
+inline size_t acquire_listeners(const std::string &path, int *fds, size_t max,
+                                int &channel) {
+  channel = -1;
+  sockaddr_un addr;
+  if (!make_address(path, addr))
+    return 0;
+
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0)
+    return 0;
+  if (connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      !wait_readable(sock, HANDOFF_TIMEOUT_MS)) {
+    close(sock);
+    return 0;
+  }
+
+  size_t count = recv_fds(sock, fds, max);
+  if (count == 0) {
+    close(sock);
+    return 0;
+  }
+  channel = sock;
+  return count;
+}
+
+inline void acknowledge(int channel) {
+  if (channel < 0)
+    return;
+  char ack = MSG_ACK;
+  send(channel, &ack, 1, MSG_NOSIGNAL);
+  close(channel);
+}
+
+// Binds a TCP listening socket on all interfaces; -1 on failure (errno set).
+inline int bind_listener(int port, int backlog) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  int opt = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+  struct sockaddr_in addr {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = INADDR_ANY;
+  addr.sin_port = htons(static_cast<uint16_t>(port));
+  if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      listen(fd, backlog) < 0) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+  return fd;
+}
+
+// Binds a Unix listening socket under a temporary name and renames it over
+// `path`, so a successor can take the path over from a still-running
+// predecessor atomically. -1 on failure.
+inline int bind_unix_listener(const std::string &path, int backlog) {
+  std::string tmp = path + "." + std::to_string(getpid());
+  sockaddr_un addr;
+  if (!make_address(tmp, addr))
+    return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  unlink(tmp.c_str());
+  if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      listen(fd, backlog) < 0 || rename(tmp.c_str(), path.c_str()) < 0) {
+    int saved = errno;
+    unlink(tmp.c_str());
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+  return fd;
+}
+
+// Predecessor side: the Unix socket a successor connects to.
+class HandoffListener {
+public:
+  ~HandoffListener() { close_fd(); }
+
+  bool open(const std::string &path) {
+    fd_ = bind_unix_listener(path, 1);
+    return fd_ >= 0;
+  }
+
+  int fd() const { return fd_; }
+
+  // Serves a pending successor: sends the listening sockets and waits for
+  // the ack. Returns true if the successor took over.
+  bool serve(const int *listen_fds, size_t count) {
+    int peer = accept(fd_, nullptr, nullptr);
+    if (peer < 0)
+      return false;
+    bool ok = send_fds(peer, listen_fds, count) &&
+              wait_readable(peer, HANDOFF_TIMEOUT_MS);
+    if (ok) {
+      char ack = 0;
+      ok = recv(peer, &ack, 1, 0) == 1 && ack == MSG_ACK;
+    }
+    close(peer);
+    return ok;
+  }
+
+  void close_fd() {
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+
+private:
+  int fd_ = -1;
+};
+
+} // namespace asr_handoff
@@ -0,0 +1,425 @@
+// Client side of the upstream HTTP batch transcription endpoint, shared by
+// asr_mcp_batch and the streaming server's refinement pass.
+
+#pragma once
+
+#include "asr_protocol.h"
+#include "asr_trace.h"
+#include "asr_upstream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <curl/curl.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace asr_http {
+
+constexpr const char *API_URL =
+    "https://asr.votee-demo.votee.dev/v1/audio/transcriptions";
+constexpr const char *MODEL = "votee/stt-v2";
+constexpr const char *LANGUAGE = "yue";
+constexpr const char *TIMESTAMP_GRANULARITIES = "[\"segment\"]";
+constexpr const char *RESPONSE_FORMAT = "verbose_json";
+
+// Upstream endpoint, overridable (e.g. to point at tools/asr_replay's mock)
+inline std::string api_url() {
+  const char *env_url = std::getenv("ASR_API_URL");
+  if (env_url && strlen(env_url) > 0) {
+    return std::string(env_url);
+  }
+  return API_URL;
+}
+
+// Replicas of the endpoint (ASR_API_URLS, comma separated), or api_url()
+inline std::vector<std::string> api_urls() {
+  return asr_upstream::env_list("ASR_API_URLS", api_url());
+}
+
+// Language of sessions that do not choose one
+inline std::string default_language() {
+  const char *env_lang = std::getenv("ASR_LANGUAGE");
+  if (env_lang && strlen(env_lang) > 0) {
+    return std::string(env_lang);
+  }
+  return LANGUAGE;
+}
+
+// Get API key from environment variable
+inline std::string api_key() {
+  const char *env_key = std::getenv("ASR_API_KEY");
+  if (env_key && strlen(env_key) > 0) {
+    return std::string(env_key);
+  }
+  // Fallback to default (should be removed in production)
+  return "votee_112f7d0b1b0af5c537626429";
+}
+
+// Process-wide state shared by every handle: one CURLSH so DNS results, TLS
+// sessions and live connections are reused across handles, plus request
+// headers that are built once instead of per request.
+class CurlShare {
+private:
+  CURLSH *share_;
+  std::mutex locks_[CURL_LOCK_DATA_LAST];
+  std::string api_key_header_;
+  struct curl_slist *headers_;
+
+  static void lock_cb(CURL *, curl_lock_data data, curl_lock_access,
+                      void *userptr) {
+    static_cast<CurlShare *>(userptr)->locks_[data].lock();
+  }
+
+  static void unlock_cb(CURL *, curl_lock_data data, void *userptr) {
+    static_cast<CurlShare *>(userptr)->locks_[data].unlock();
+  }
+
+public:
+  CurlShare() : share_(curl_share_init()), headers_(nullptr) {
+    if (share_) {
+      curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, lock_cb);
+      curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, unlock_cb);
+      curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+      curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+      curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+      curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    }
+
+    api_key_header_ = "x-api-key: " + api_key();
+    headers_ = curl_slist_append(headers_, api_key_header_.c_str());
+  }
+
+  // Must outlive every handle attached to it
+  ~CurlShare() {
+    curl_slist_free_all(headers_);
+    if (share_) {
+      curl_share_cleanup(share_);
+    }
+  }
+
+  CurlShare(const CurlShare &) = delete;
+  CurlShare &operator=(const CurlShare &) = delete;
+
+  CURLSH *handle() const { return share_; }
+  struct curl_slist *headers() const { return headers_; }
+};
+
+// Audio for a request that is sent while it is still being recorded. The
+// session thread append()s and finally finish()es; the transfer thread reads
+// through TranscriptionForm. When the reader catches up it pauses the
+// transfer (CURL_READFUNC_PAUSE) and the next append() wakes the transfer's
+// multi handle, whose loop then calls resume_pending() and unpauses.
+class ProgressiveBody {
+public:
+  ProgressiveBody() : last_append_(std::chrono::steady_clock::now()) {}
+
+  ProgressiveBody(const ProgressiveBody &) = delete;
+  ProgressiveBody &operator=(const ProgressiveBody &) = delete;
+
+  // Ignored once the body is finished, failed or cancelled.
+  void append(const uint8_t *data, size_t len) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ != State::Open)
+      return;
+    buffer_.insert(buffer_.end(), data, data + len);
+    last_append_ = std::chrono::steady_clock::now();
+    wake_locked();
+  }
+
+  // No more audio: the upload completes once the buffer drains. Returns
+  // false if the transfer had already failed, in which case the caller
+  // must send the audio some other way.
+  bool finish() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ != State::Open)
+      return false;
+    state_ = State::Finished;
+    wake_locked();
+    return true;
+  }
+
+  // Abandons the request, e.g. because the client went away.
+  void cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ == State::Open || state_ == State::Finished)
+      state_ = State::Cancelled;
+    wake_locked();
+  }
+
+  // Called by the transfer thread when the request ends. Returns true if
+  // its outcome should be reported to the client; false if the session
+  // cancelled it or was still recording (the body is then marked failed and
+  // finish() will return false).
+  bool settle() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ == State::Finished)
+      return true;
+    if (state_ == State::Open)
+      state_ = State::Failed;
+    return false;
+  }
+
+  // Transfer thread only ----------------------------------------------------
+
+  // Handle to wake while the transfer is paused; nullptr to detach.
+  void attach(CURLM *multi) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    multi_ = multi;
+  }
+
+  // True (once) if the transfer is paused and there is something to read.
+  bool resume_pending() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!paused_ || (pos_ == buffer_.size() && state_ == State::Open))
+      return false;
+    paused_ = false;
+    return true;
+  }
+
+  bool cancelled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_ == State::Cancelled;
+  }
+
+  bool finished() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_ == State::Finished;
+  }
+
+  // Time since audio last arrived, for abandoning idle recordings.
+  std::chrono::steady_clock::duration idle() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::chrono::steady_clock::now() - last_append_;
+  }
+
+  // asr_trace::now_ns() when the last byte was read, 0 before that.
+  uint64_t done_ns() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return done_ns_;
+  }
+
+  size_t read(char *out, size_t max) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_ == State::Cancelled)
+      return CURL_READFUNC_ABORT;
+    size_t n = std::min(max, buffer_.size() - pos_);
+    if (n == 0) {
+      if (state_ == State::Finished) {
+        if (done_ns_ == 0)
+          done_ns_ = asr_trace::Tracer::instance().now_ns();
+        return 0;
+      }
+      paused_ = true;
+      return CURL_READFUNC_PAUSE;
+    }
+    memcpy(out, buffer_.data() + pos_, n);
+    pos_ += n;
+    // Drop what has been sent once it dominates the buffer
+    if (pos_ > buffer_.size() / 2) {
+      buffer_.erase(buffer_.begin(), buffer_.begin() + pos_);
+      pos_ = 0;
+    }
+    return n;
+  }
+
+private:
+  enum class State { Open, Finished, Failed, Cancelled };
+
+  void wake_locked() {
+    if (paused_ && multi_)
+      curl_multi_wakeup(multi_);
+  }
+
+  mutable std::mutex mutex_;
+  std::vector<uint8_t> buffer_;
+  size_t pos_ = 0;
+  State state_ = State::Open;
+  bool paused_ = false;
+  CURLM *multi_ = nullptr;
+  std::chrono::steady_clock::time_point last_append_;
+  uint64_t done_ns_ = 0;
+};
+
+// Cancellation of an upstream request, e.g. because its client went away.
+// The transfer's loop checks cancelled() and attach()es its multi handle,
+// which cancel() wakes, so a cancelled transfer ends at once.
+class Cancellation {
+public:
+  Cancellation() = default;
+  Cancellation(const Cancellation &) = delete;
+  Cancellation &operator=(const Cancellation &) = delete;
+
+  void cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancelled_.store(true, std::memory_order_relaxed);
+    if (multi_)
+      curl_multi_wakeup(multi_);
+  }
+
+  bool cancelled() const {
+    return cancelled_.load(std::memory_order_relaxed);
+  }
+
+  // Handle to wake on cancel(); nullptr to detach.
+  void attach(CURLM *multi) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    multi_ = multi;
+  }
+
+private:
+  std::mutex mutex_;
+  std::atomic<bool> cancelled_{false};
+  CURLM *multi_ = nullptr;
+};
+
+// Multipart body of one transcription request. `wav` is not copied and must
+// stay alive until the request completes.
+class TranscriptionForm {
+public:
+  // `stream` asks the service to send results as they are produced.
+  TranscriptionForm(CURL *curl, const uint8_t *wav, size_t len, bool stream,
+                    const std::string &language = LANGUAGE)
+      : mime_(curl_mime_init(curl)) {
+    source_ = {wav, len, 0, 0};
+    add_fields(static_cast<curl_off_t>(len), read_cb, seek_cb, &source_,
+               stream, language);
+  }
+
+  // Audio of unknown length, sent with chunked transfer encoding as `body`
+  // grows. `body` must outlive the form.
+  TranscriptionForm(CURL *curl, ProgressiveBody &body, bool stream,
+                    const std::string &language = LANGUAGE)
+      : mime_(curl_mime_init(curl)), body_(&body) {
+    add_fields(-1, progressive_read_cb, nullptr, &body, stream, language);
+  }
+
+  ~TranscriptionForm() { curl_mime_free(mime_); }
+
+  TranscriptionForm(const TranscriptionForm &) = delete;
+  TranscriptionForm &operator=(const TranscriptionForm &) = delete;
+
+  curl_mime *get() const { return mime_; }
+
+  // asr_trace::now_ns() when curl read the last audio byte, 0 before that.
+  uint64_t upload_done_ns() const {
+    return body_ ? body_->done_ns() : source_.done_ns;
+  }
+
+private:
+  struct Source {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+    uint64_t done_ns;
+  };
+
+  void add_fields(curl_off_t audio_len, curl_read_callback read,
+                  curl_seek_callback seek, void *arg, bool stream,
+                  const std::string &language) {
+    add_field("model", MODEL);
+
+    curl_mimepart *file = curl_mime_addpart(mime_);
+    curl_mime_name(file, "file");
+    curl_mime_filename(file, "audio.wav");
+    curl_mime_type(file, "audio/wav");
+    curl_mime_data_cb(file, audio_len, read, seek, nullptr, arg);
+
+    if (stream)
+      add_field("stream", "True");
+    add_field("language", language.c_str());
+    add_field("timestamp_granularities", TIMESTAMP_GRANULARITIES);
+    add_field("response_format", RESPONSE_FORMAT);
+    add_field("vad_filter", "True");
+  }
+
+  void add_field(const char *name, const char *value) {
+    curl_mimepart *part = curl_mime_addpart(mime_);
+    curl_mime_name(part, name);
+    curl_mime_data(part, value, CURL_ZERO_TERMINATED);
+  }
+
+  // The audio is read straight from the caller's buffer rather than copied
+  // into the form.
+  static size_t read_cb(char *buffer, size_t size, size_t nitems, void *arg) {
+    Source *src = static_cast<Source *>(arg);
+    size_t n = std::min(size * nitems, src->len - src->pos);
+    memcpy(buffer, src->data + src->pos, n);
+    src->pos += n;
+    if (src->pos == src->len && src->done_ns == 0)
+      src->done_ns = asr_trace::Tracer::instance().now_ns();
+    return n;
+  }
+
+  static size_t progressive_read_cb(char *buffer, size_t size, size_t nitems,
+                                    void *arg) {
+    return static_cast<ProgressiveBody *>(arg)->read(buffer, size * nitems);
+  }
+
+  static int seek_cb(void *arg, curl_off_t offset, int origin) {
+    Source *src = static_cast<Source *>(arg);
+    if (origin != SEEK_SET || offset < 0 ||
+        static_cast<size_t>(offset) > src->len) {
+      return CURL_SEEKFUNC_CANTSEEK;
+    }
+    src->pos = static_cast<size_t>(offset);
+    return CURL_SEEKFUNC_OK;
+  }
+
+  curl_mime *mime_;
+  Source source_ = {nullptr, 0, 0, 0};
+  ProgressiveBody *body_ = nullptr;
+};
+
+// Splits a finished request that started at `start_ns` (tracer clock) into
+// spans from libcurl's phase timers, so a slow request shows whether the
+// time went to connection setup, the upload, the backend or the download.
+inline void trace_phases(CURL *curl, const TranscriptionForm &form,
+                         const asr_trace::Context &ctx, uint64_t start_ns) {
+  if (!ctx.sampled)
+    return;
+  curl_off_t dns = 0, connect = 0, tls = 0, pretransfer = 0, first_byte = 0,
+             total = 0;
+  curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+  curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+  curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &tls);
+  curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+  curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &first_byte);
+  curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+  auto at = [start_ns](curl_off_t us) {
+    return start_ns + static_cast<uint64_t>(us) * 1000;
+  };
+
+  // Reused connections report zero for the setup phases
+  if (dns > 0)
+    asr_trace::record("dns_resolve", ctx, start_ns, at(dns));
+  if (connect > dns)
+    asr_trace::record("tcp_connect", ctx, at(dns), at(connect));
+  if (tls > connect)
+    asr_trace::record("tls_handshake", ctx, at(connect), at(tls));
+  uint64_t upload_done = form.upload_done_ns();
+  if (upload_done > at(pretransfer) && upload_done < at(first_byte)) {
+    asr_trace::record("upload", ctx, at(pretransfer), upload_done);
+    asr_trace::record("backend_wait", ctx, upload_done, at(first_byte));
+  } else {
+    asr_trace::record("upload_and_backend", ctx, at(pretransfer),
+                      at(first_byte));
+  }
+  asr_trace::record("download", ctx, at(first_byte), at(total));
+}
+
+// Top-level "text" of a (non-streamed) verbose_json response, unescaped.
+inline bool response_text(const std::string &body, std::string &text) {
+  // Segments have a "text" of their own, which may come first
+  const size_t pos = asr_protocol::find_top_level_member(body, "text");
+  if (pos == std::string::npos || body[pos] != '"')
+    return false;
+  return asr_protocol::json_unescape(body, pos, text);
+}
+
+} // namespace asr_http
@@ -0,0 +1,355 @@
+// Per-session transcript journal for the ASR MCP servers.
+//
+// When ASR_JOURNAL_DIR is set, each session appends the final results it
+// produces to <dir>/<token>.journal. Records are numbered from 1 and stamped
+// with how much of the session's audio (in ms) the result covers. The client
+// learns the token in its "initialized" message and each journaled result
+// carries its "seq". After a reconnect the client sends
+// {"method":"resume","session":<token>,"seq":<last seen>}, is sent the
+// records it missed, and resumes audio from the offset in the reply instead
+// of from the beginning. That offset is the audio the session has taken
+// responsibility for: finalized clips on the batch server, audio up to the
+// last final on the streaming server.
+//
+// Results are delivered to the client from the journal rather than straight
+// from the threads producing them. A resumed session reads the same journal,
+// so it also receives what its predecessor's requests produce after the
+// reconnect.
+//
+// The file is memory-mapped and append-only. A record is copied in first
+// and only then counted in the header, so a half-written record is never
+// read back. Records live in the page cache once appended: they survive the
+// server process exiting or an --upgrade handoff, though not a machine
+// crash. Journals untouched for RETENTION are deleted, as is a journal with
+// no records when its last session ends.
+//
+// File layout: FileHeader, then Records back to back, each a RecordHeader
+// followed by `len` payload bytes padded to 8. Integers are little-endian.
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "asr_log.h"
+
+namespace asr_journal {
+
+constexpr char MAGIC[8] = {'A', 'S', 'R', 'J', 'R', 'N', 0, 1};
+constexpr size_t INITIAL_BYTES = 64 * 1024;
+constexpr size_t MAX_BYTES = 16 << 20; // Per session; later results are lost
+constexpr std::chrono::hours RETENTION(1);
+constexpr std::chrono::minutes SWEEP_INTERVAL(1);
+constexpr size_t TOKEN_BYTES = 16; // Sent as 32 hex digits
+
+struct FileHeader {
+  char magic[8];
+  uint64_t used;     // Bytes of FileHeader and complete records
+  uint64_t records;  // Sequence number of the last record
+  uint64_t audio_ms; // Audio the client need not send again
+};
+
+struct RecordHeader {
+  uint32_t len;
+  uint32_t reserved;
+  uint64_t seq;
+  uint64_t audio_ms;
+};
+
+static_assert(sizeof(FileHeader) == 32 && sizeof(RecordHeader) == 24,
+              "journal headers are part of the file format");
+
+struct Record {
+  uint64_t seq;
+  uint64_t audio_ms;
+  std::string_view payload;
+};
+
+// ASR_JOURNAL_DIR, or empty when journaling is off
+inline const std::string &directory() {
+  static const std::string dir = [] {
+    const char *env_dir = std::getenv("ASR_JOURNAL_DIR");
+    return std::string(env_dir ? env_dir : "");
+  }();
+  return dir;
+}
+
+inline bool enabled() { return !directory().empty(); }
+
+// Tokens name files, so only what create() makes is accepted
+inline bool valid_token(const std::string &token) {
+  if (token.size() != 2 * TOKEN_BYTES)
+    return false;
+  for (char c : token) {
+    if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+      return false;
+  }
+  return true;
+}
+
+class Journal {
+public:
+  // A journal for a new session, or null if journaling is off or the file
+  // cannot be created.
+  static std::shared_ptr<Journal> create() {
+    if (!enabled())
+      return nullptr;
+    sweep();
+    std::random_device random;
+    static const char HEX[] = "0123456789abcdef";
+    std::string token;
+    for (size_t i = 0; i < TOKEN_BYTES; ++i) {
+      unsigned byte = random() & 0xff;
+      token += HEX[byte >> 4];
+      token += HEX[byte & 0xf];
+    }
+    return attach(token, true);
+  }
+
+  // The journal of an earlier session: the one a live session is still
+  // writing to, or else the file a previous process left. Null if there is
+  // none.
+  static std::shared_ptr<Journal> open(const std::string &token) {
+    if (!enabled() || !valid_token(token))
+      return nullptr;
+    return attach(token, false);
+  }
+
+  ~Journal() {
+    if (map_ && header().records == 0)
+      unlink(path(token_).c_str());
+    if (map_)
+      munmap(map_, capacity_);
+    if (fd_ >= 0)
+      close(fd_);
+  }
+
+  Journal(const Journal &) = delete;
+  Journal &operator=(const Journal &) = delete;
+
+  const std::string &token() const { return token_; }
+
+  // Appends a result covering the session's audio up to `audio_ms`. Returns
+  // its sequence number, or 0 if the journal is full.
+  uint64_t append(uint64_t audio_ms, std::string_view payload) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const size_t need = sizeof(RecordHeader) + padded(payload.size());
+    FileHeader &h = header();
+    if (h.used + need > capacity_ && !grow(h.used + need)) {
+      ASR_LOG_RATE_LIMITED(asr_log::Level::Warn, 1,
+                           "Journal %s full, result not recorded",
+                           token_.c_str());
+      return 0;
+    }
+    FileHeader &file = header(); // grow() may have moved the mapping
+    RecordHeader record = {static_cast<uint32_t>(payload.size()), 0,
+                           file.records + 1, audio_ms};
+    char *at = map_ + file.used;
+    std::memcpy(at, &record, sizeof(record));
+    std::memcpy(at + sizeof(record), payload.data(), payload.size());
+    file.records = record.seq;
+    file.used += need;
+    touch();
+    return record.seq;
+  }
+
+  // Moves the resume offset forward to `audio_ms`
+  void accept_audio(uint64_t audio_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    FileHeader &h = header();
+    h.audio_ms = std::max(h.audio_ms, audio_ms);
+    touch();
+  }
+
+  uint64_t audio_ms() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return header().audio_ms;
+  }
+
+  // Calls fn(const Record&) for each record from byte offset `cursor` on
+  // (0 for the first) and moves `cursor` past them. A file left by an
+  // earlier process is not trusted: reading stops at the first record that
+  // does not fit in what the header says is used.
+  template <typename Fn> void read(size_t &cursor, Fn &&fn) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const size_t used = header().used;
+    size_t at = std::max(cursor, sizeof(FileHeader));
+    while (at < used) {
+      RecordHeader record;
+      if (used - at < sizeof(record)) {
+        corrupt(at);
+        at = used;
+        break;
+      }
+      std::memcpy(&record, map_ + at, sizeof(record));
+      if (padded(record.len) > used - at - sizeof(record)) {
+        corrupt(at);
+        at = used;
+        break;
+      }
+      fn(Record{record.seq, record.audio_ms,
+                std::string_view(map_ + at + sizeof(record), record.len)});
+      at += sizeof(record) + padded(record.len);
+    }
+    cursor = at;
+  }
+
+private:
+  explicit Journal(std::string token) : token_(std::move(token)) {}
+
+  static std::string path(const std::string &token) {
+    return directory() + "/" + token + ".journal";
+  }
+
+  static size_t padded(size_t len) { return (len + 7) & ~size_t(7); }
+
+  void corrupt(size_t at) const {
+    ASR_LOG_WARN("Journal %s is corrupt at byte %zu, later records skipped",
+                 path(token_).c_str(), at);
+  }
+
+  FileHeader &header() { return *reinterpret_cast<FileHeader *>(map_); }
+
+  // Stores through the mapping leave the mtime alone (on tmpfs for good,
+  // elsewhere until writeback), so sweep() would go by the last grow()
+  void touch() {
+    if (futimens(fd_, nullptr) != 0)
+      ASR_LOG_RATE_LIMITED(asr_log::Level::Warn, 1,
+                           "Journal %s: cannot update mtime: %s",
+                           token_.c_str(), strerror(errno));
+  }
+
+  struct Registry {
+    std::mutex mutex;
+    std::unordered_map<std::string, std::weak_ptr<Journal>> open;
+    std::chrono::steady_clock::time_point last_sweep;
+  };
+
+  static Registry &registry() {
+    static Registry registry;
+    return registry;
+  }
+
+  static std::shared_ptr<Journal> attach(const std::string &token,
+                                         bool create) {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    if (auto live = r.open[token].lock())
+      return live;
+    std::shared_ptr<Journal> journal(new Journal(token));
+    if (!(create ? journal->create_file() : journal->open_file())) {
+      r.open.erase(token);
+      return nullptr;
+    }
+    r.open[token] = journal;
+    return journal;
+  }
+
+  bool create_file() {
+    fd_ = ::open(path(token_).c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                 0600);
+    if (fd_ < 0 || !map(INITIAL_BYTES)) {
+      ASR_LOG_WARN("Journal %s unavailable: %s", path(token_).c_str(),
+                   strerror(errno));
+      return false;
+    }
+    FileHeader h = {};
+    std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.used = sizeof(FileHeader);
+    std::memcpy(map_, &h, sizeof(h));
+    return true;
+  }
+
+  bool open_file() {
+    fd_ = ::open(path(token_).c_str(), O_RDWR | O_CLOEXEC);
+    struct stat st;
+    if (fd_ < 0 || fstat(fd_, &st) != 0 ||
+        static_cast<size_t>(st.st_size) < sizeof(FileHeader) ||
+        !map(static_cast<size_t>(st.st_size))) {
+      return false;
+    }
+    const FileHeader &h = header();
+    if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        h.used < sizeof(FileHeader) || h.used > capacity_) {
+      ASR_LOG_WARN("Journal %s is corrupt", path(token_).c_str());
+      return false;
+    }
+    return true;
+  }
+
+  // Maps the file at `bytes`, extending it first if need be
+  bool map(size_t bytes) {
+    if (ftruncate(fd_, static_cast<off_t>(bytes)) != 0)
+      return false;
+    void *mapped =
+        mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (mapped == MAP_FAILED)
+      return false;
+    if (map_)
+      munmap(map_, capacity_);
+    map_ = static_cast<char *>(mapped);
+    capacity_ = bytes;
+    return true;
+  }
+
+  bool grow(size_t need) {
+    if (need > MAX_BYTES)
+      return false;
+    size_t bytes = capacity_;
+    while (bytes < need)
+      bytes *= 2;
+    return map(std::min(bytes, MAX_BYTES));
+  }
+
+  // Deletes journals no session has open that have not been written for
+  // RETENTION, at most once per SWEEP_INTERVAL. Files it cannot stat, and
+  // the rest of a directory it cannot list, are left for a later sweep.
+  static void sweep() {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    const auto now = std::chrono::steady_clock::now();
+    if (r.last_sweep.time_since_epoch().count() != 0 &&
+        now - r.last_sweep < SWEEP_INTERVAL)
+      return;
+    r.last_sweep = now;
+    for (auto it = r.open.begin(); it != r.open.end();)
+      it = it->second.expired() ? r.open.erase(it) : std::next(it);
+
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    const auto cutoff = fs::file_time_type::clock::now() - RETENTION;
+    for (fs::directory_iterator it(directory(), ec), end; !ec && it != end;
+         it.increment(ec)) {
+      if (it->path().extension() != ".journal" ||
+          r.open.count(it->path().stem().string()))
+        continue;
+      std::error_code stat_ec;
+      const auto written = it->last_write_time(stat_ec);
+      if (!stat_ec && written < cutoff)
+        fs::remove(it->path(), stat_ec);
+    }
+  }
+
+  const std::string token_;
+  std::mutex mutex_;
+  int fd_ = -1;
+  char *map_ = nullptr;
+  size_t capacity_ = 0;
+};
+
+} // namespace asr_journal
@@ -0,0 +1,221 @@
+// Local transport for clients on the same host as the ASR MCP servers.
+//
+// Both servers also accept clients on a Unix domain socket
+// (ASR_MCP_LOCAL_SOCKET, default /tmp/asr_mcp_<port>.local.sock, "0"
+// disables). It carries the same newline-delimited JSON as the TCP port.
+// A local client may then send {"method":"open_ring"}; the reply
+// {"type":"ring_opened","capacity":N,"data_offset":D} comes with two
+// descriptors (SCM_RIGHTS): a memfd holding an audio ring and an eventfd
+// doorbell. From then on the client writes samples in the negotiated format
+// into the ring instead of sending stream_audio, and the session hands them
+// to the normalizer straight from the shared mapping: no base64, no socket
+// copies, no per-chunk acks and no system call per frame. Control messages
+// (configure_audio, finalize_transcription, ...) still go over the socket;
+// the session reads the ring up to date before handling each of them.
+//
+// Ring layout (little-endian, offsets in bytes):
+//     0  magic "ASRRING\0"
+//     8  capacity (uint64, a power of two)
+//    64  write index (uint64): bytes ever written, advanced by the client
+//   128  read index (uint64): bytes ever read, advanced by the server
+//   192  waiting (uint32): the server is about to sleep
+//   D    audio: byte i of the stream is at D + i % capacity
+// The client writes samples, publishes the new write index, then, if
+// `waiting` is set, clears it and writes 1 to the doorbell. It may reuse
+// space up to the read index. The memfd is sealed against resizing, so a
+// client cannot pull pages from under the server.
+//
+// The local socket is not passed on by --upgrade: the successor binds its
+// own socket over the path, and existing local sessions drain as usual.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "asr_handoff.h"
+
+namespace asr_local {
+
+constexpr char RING_MAGIC[8] = {'A', 'S', 'R', 'R', 'I', 'N', 'G', 0};
+constexpr size_t RING_BYTES = 1 << 20; // ~32 s of 16 kHz mono s16le
+constexpr size_t DATA_OFFSET = 4096;
+
+// The local socket path; empty when the local transport is off
+inline std::string socket_path(int port) {
+  const char *env_path = std::getenv("ASR_MCP_LOCAL_SOCKET");
+  if (env_path && *env_path)
+    return std::string(env_path) == "0" ? std::string() : env_path;
+  return "/tmp/asr_mcp_" + std::to_string(port) + ".local.sock";
+}
+
+// Whether the client on `fd` came in over the local socket
+inline bool is_local(int fd) {
+  sockaddr_storage addr;
+  socklen_t len = sizeof(addr);
+  return getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len) == 0 &&
+         addr.ss_family == AF_UNIX;
+}
+
+// The listening socket. Unlinks its path on close unless a successor has
+// bound over it since.
+class Listener {
+public:
+  ~Listener() { close_fd(); }
+
+  bool open(const std::string &path) {
+    fd_ = asr_handoff::bind_unix_listener(path, SOMAXCONN);
+    struct stat st;
+    if (fd_ < 0 || stat(path.c_str(), &st) != 0)
+      return false;
+    path_ = path;
+    dev_ = st.st_dev;
+    ino_ = st.st_ino;
+    return true;
+  }
+
+  int fd() const { return fd_; }
+
+  void close_fd() {
+    if (fd_ < 0)
+      return;
+    struct stat st;
+    if (stat(path_.c_str(), &st) == 0 && st.st_dev == dev_ &&
+        st.st_ino == ino_)
+      unlink(path_.c_str());
+    close(fd_);
+    fd_ = -1;
+  }
+
+private:
+  int fd_ = -1;
+  std::string path_;
+  dev_t dev_ = 0;
+  ino_t ino_ = 0;
+};
+
+// Server side of one session's audio ring.
+class Ring {
+public:
+  // A new ring, or null (errno set) if it cannot be created
+  static std::unique_ptr<Ring> create() {
+    std::unique_ptr<Ring> ring(new Ring());
+    const size_t bytes = DATA_OFFSET + RING_BYTES;
+    ring->memfd_ =
+        memfd_create("asr_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (ring->memfd_ < 0 ||
+        ftruncate(ring->memfd_, static_cast<off_t>(bytes)) != 0 ||
+        fcntl(ring->memfd_, F_ADD_SEALS,
+              F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0)
+      return nullptr;
+    void *mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        ring->memfd_, 0);
+    if (mapped == MAP_FAILED)
+      return nullptr;
+    ring->map_ = static_cast<uint8_t *>(mapped);
+    ring->doorbell_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ring->doorbell_ < 0)
+      return nullptr;
+
+    const uint64_t capacity = RING_BYTES;
+    std::memcpy(ring->map_, RING_MAGIC, sizeof(RING_MAGIC));
+    std::memcpy(ring->map_ + 8, &capacity, sizeof(capacity));
+    return ring;
+  }
+
+  ~Ring() {
+    if (map_)
+      munmap(map_, DATA_OFFSET + RING_BYTES);
+    if (memfd_ >= 0)
+      close(memfd_);
+    if (doorbell_ >= 0)
+      close(doorbell_);
+  }
+
+  Ring(const Ring &) = delete;
+  Ring &operator=(const Ring &) = delete;
+
+  int memfd() const { return memfd_; }
+  int doorbell() const { return doorbell_; }
+
+  bool empty() {
+    return write_index().load(std::memory_order_acquire) == read_;
+  }
+
+  // Calls fn(const uint8_t*, size_t) on the unread bytes in place, in at
+  // most two spans, then gives the space back to the client. False if the
+  // client has published an impossible write index.
+  template <typename Fn> bool drain(Fn &&fn) {
+    const uint64_t write = write_index().load(std::memory_order_acquire);
+    if (write - read_ > RING_BYTES)
+      return false;
+    while (read_ != write) {
+      const size_t at = static_cast<size_t>(read_ % RING_BYTES);
+      const size_t len = static_cast<size_t>(
+          std::min<uint64_t>(write - read_, RING_BYTES - at));
+      fn(map_ + DATA_OFFSET + at, len);
+      read_ += len;
+    }
+    read_index().store(read_, std::memory_order_release);
+    return true;
+  }
+
+  // Call before blocking on the doorbell. False if audio is already
+  // waiting, in which case the session should not block.
+  bool prepare_wait() {
+    waiting().store(1, std::memory_order_seq_cst);
+    if (write_index().load(std::memory_order_seq_cst) != read_) {
+      waiting().store(0, std::memory_order_relaxed);
+      return false;
+    }
+    return true;
+  }
+
+  // Call after waking; `rang` if the doorbell polled readable
+  void end_wait(bool rang) {
+    waiting().store(0, std::memory_order_relaxed);
+    if (rang) {
+      uint64_t rings;
+      ssize_t n = read(doorbell_, &rings, sizeof(rings));
+      (void)n; // EAGAIN: another wakeup already reset it
+    }
+  }
+
+private:
+  Ring() = default;
+
+  std::atomic<uint64_t> &write_index() { return at<uint64_t>(64); }
+  std::atomic<uint64_t> &read_index() { return at<uint64_t>(128); }
+  std::atomic<uint32_t> &waiting() { return at<uint32_t>(192); }
+
+  template <typename T> std::atomic<T> &at(size_t offset) {
+    static_assert(std::atomic<T>::is_always_lock_free,
+                  "ring indices are shared with another process");
+    return *reinterpret_cast<std::atomic<T> *>(map_ + offset);
+  }
+
+  int memfd_ = -1;
+  int doorbell_ = -1;
+  uint8_t *map_ = nullptr;
+  uint64_t read_ = 0; // The server's copy; the client cannot move it
+};
+
+inline std::string ring_opened_message() {
+  return "{\"type\":\"ring_opened\",\"capacity\":" +
+         std::to_string(RING_BYTES) +
+         ",\"data_offset\":" + std::to_string(DATA_OFFSET) + "}";
+}
+
+} // namespace asr_local
@@ -0,0 +1,354 @@
+// Asynchronous logger shared by the ASR MCP servers.
+//
+// Each thread that logs owns a single-producer/single-consumer ring of
+// fixed-size records. Producers format straight into a ring slot and publish
+// it with one release store; a background thread drains every ring, writes
+// the records with buffered stdio and flushes once per pass. Nothing on the
+// producer side takes a lock or allocates after the thread's first message.
+//
+// Usage:
+//   ASR_LOG_INFO("New connection from %s", ip);
+//   ASR_LOG_RATE_LIMITED(asr_log::Level::Debug, 10, "[Partial] %s", text);
+//
+// The runtime level comes from ASR_LOG_LEVEL (trace, debug, info, warn,
+// error, off) and can be changed with asr_log::set_level().
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <strings.h>
+#include <thread>
+#include <vector>
+
+namespace asr_log {
+
+enum class Level : uint8_t { Trace = 0, Debug, Info, Warn, Error, Off };
+
+constexpr size_t RING_SLOTS = 256;  // Per thread, power of two
+constexpr size_t RECORD_TEXT = 240; // Longer messages are truncated
+constexpr int DRAIN_INTERVAL_MS = 5;
+
+struct Record {
+  int64_t wall_us;
+  uint32_t thread_id;
+  Level level;
+  uint16_t len;
+  char text[RECORD_TEXT];
+};
+
+// SPSC ring of fixed-size slots: the owning thread pushes, a drain thread
+// pops. Also used by asr_trace.h.
+template <typename T, size_t Slots> class SlotRing {
+  static_assert((Slots & (Slots - 1)) == 0, "Slots must be a power of two");
+
+public:
+  T *reserve() {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= Slots) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    return &slots_[head & (Slots - 1)];
+  }
+
+  void commit() {
+    head_.store(head_.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+
+  template <typename Fn> size_t drain(Fn &&fn) {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    uint64_t head = head_.load(std::memory_order_acquire);
+    for (uint64_t i = tail; i < head; ++i) {
+      fn(slots_[i & (Slots - 1)]);
+    }
+    tail_.store(head, std::memory_order_release);
+    return static_cast<size_t>(head - tail);
+  }
+
+  bool empty() const {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+
+  uint64_t take_dropped() {
+    return dropped_.exchange(0, std::memory_order_relaxed);
+  }
+
+  std::atomic<bool> retired{false};
+
+private:
+  alignas(64) std::atomic<uint64_t> head_{0};
+  alignas(64) std::atomic<uint64_t> tail_{0};
+  alignas(64) std::atomic<uint64_t> dropped_{0};
+  T slots_[Slots];
+};
+
+class Ring : public SlotRing<Record, RING_SLOTS> {
+public:
+  explicit Ring(uint32_t id) : thread_id_(id) {}
+
+  uint32_t thread_id() const { return thread_id_; }
+
+private:
+  uint32_t thread_id_;
+};
+
+inline const char *level_name(Level level) {
+  switch (level) {
+  case Level::Trace:
+    return "TRACE";
+  case Level::Debug:
+    return "DEBUG";
+  case Level::Info:
+    return "INFO ";
+  case Level::Warn:
+    return "WARN ";
+  case Level::Error:
+    return "ERROR";
+  default:
+    return "?    ";
+  }
+}
+
+inline Level parse_level(const char *name, Level fallback) {
+  if (!name || !*name)
+    return fallback;
+  static const char *const names[] = {"trace", "debug", "info",
+                                      "warn",  "error", "off"};
+  for (int i = 0; i <= static_cast<int>(Level::Off); ++i) {
+    if (strcasecmp(name, names[i]) == 0)
+      return static_cast<Level>(i);
+  }
+  return fallback;
+}
+
+class Logger {
+public:
+  static Logger &instance() {
+    static Logger logger;
+    return logger;
+  }
+
+  bool enabled(Level level) const {
+    return level >= level_.load(std::memory_order_relaxed);
+  }
+
+  void set_level(Level level) {
+    level_.store(level, std::memory_order_relaxed);
+  }
+
+  void vlog(Level level, const char *fmt, va_list args) {
+    Ring *ring = local_ring();
+    Record *rec = ring->reserve();
+    if (!rec)
+      return;
+
+    rec->wall_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count();
+    rec->thread_id = ring->thread_id();
+    rec->level = level;
+    int n = vsnprintf(rec->text, RECORD_TEXT, fmt, args);
+    if (n < 0)
+      n = 0;
+    rec->len = static_cast<uint16_t>(
+        static_cast<size_t>(n) < RECORD_TEXT ? n : RECORD_TEXT - 1);
+    ring->commit();
+
+    if (level >= Level::Error)
+      wake_.notify_one();
+  }
+
+  // Drains everything that has been published so far. Called by the
+  // background thread and on shutdown; safe to call from anywhere.
+  void flush() {
+    std::lock_guard<std::mutex> lock(drain_mutex_);
+    drain_once();
+  }
+
+  ~Logger() {
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+      running_ = false;
+    }
+    wake_.notify_one();
+    if (drainer_.joinable())
+      drainer_.join();
+    flush();
+  }
+
+private:
+  Logger() {
+    level_ = parse_level(std::getenv("ASR_LOG_LEVEL"), Level::Info);
+    drainer_ = std::thread(&Logger::drain_loop, this);
+  }
+
+  Logger(const Logger &) = delete;
+  Logger &operator=(const Logger &) = delete;
+
+  // Owned by the thread; marks the ring retired so the drainer can free it
+  // once the remaining records are written.
+  struct LocalHandle {
+    std::shared_ptr<Ring> ring;
+    ~LocalHandle() {
+      if (ring)
+        ring->retired.store(true, std::memory_order_release);
+    }
+  };
+
+  Ring *local_ring() {
+    thread_local LocalHandle handle;
+    if (!handle.ring) {
+      handle.ring = std::make_shared<Ring>(
+          next_thread_id_.fetch_add(1, std::memory_order_relaxed));
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      rings_.push_back(handle.ring);
+    }
+    return handle.ring.get();
+  }
+
+  void drain_loop() {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    while (running_) {
+      wake_.wait_for(lock, std::chrono::milliseconds(DRAIN_INTERVAL_MS));
+      lock.unlock();
+      flush();
+      lock.lock();
+    }
+  }
+
+  void drain_once() {
+    std::vector<std::shared_ptr<Ring>> snapshot;
+    {
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      snapshot = rings_;
+    }
+
+    bool wrote_out = false, wrote_err = false;
+    for (auto &ring : snapshot) {
+      // Read retired before draining so records published just before
+      // retirement are never skipped.
+      bool retired = ring->retired.load(std::memory_order_acquire);
+      ring->drain([&](const Record &rec) {
+        FILE *out = rec.level >= Level::Warn ? stderr : stdout;
+        write_record(out, rec);
+        (out == stderr ? wrote_err : wrote_out) = true;
+      });
+      if (uint64_t dropped = ring->take_dropped()) {
+        fprintf(stderr, "WARN  [t%u] logger dropped %llu messages\n",
+                ring->thread_id(), static_cast<unsigned long long>(dropped));
+        wrote_err = true;
+      }
+      if (retired && ring->empty()) {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        for (auto it = rings_.begin(); it != rings_.end(); ++it) {
+          if (*it == ring) {
+            rings_.erase(it);
+            break;
+          }
+        }
+      }
+    }
+    if (wrote_out)
+      fflush(stdout);
+    if (wrote_err)
+      fflush(stderr);
+  }
+
+  static void write_record(FILE *out, const Record &rec) {
+    time_t secs = static_cast<time_t>(rec.wall_us / 1000000);
+    struct tm tm_buf;
+    localtime_r(&secs, &tm_buf);
+    char stamp[16];
+    strftime(stamp, sizeof(stamp), "%H:%M:%S", &tm_buf);
+    fprintf(out, "%s.%03d %s [t%u] %.*s\n", stamp,
+            static_cast<int>((rec.wall_us / 1000) % 1000),
+            level_name(rec.level), rec.thread_id, static_cast<int>(rec.len),
+            rec.text);
+  }
+
+  std::atomic<Level> level_{Level::Info};
+  std::atomic<uint32_t> next_thread_id_{1};
+  std::mutex rings_mutex_;
+  std::vector<std::shared_ptr<Ring>> rings_;
+  std::mutex drain_mutex_;
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  bool running_{true};
+  std::thread drainer_;
+};
+
+// Allows at most `per_sec` messages per one-second window; one limiter per
+// call site (see ASR_LOG_RATE_LIMITED).
+class RateLimiter {
+public:
+  explicit RateLimiter(uint32_t per_sec) : per_sec_(per_sec) {}
+
+  bool allow() {
+    int64_t now_sec = std::chrono::duration_cast<std::chrono::seconds>(
+                          std::chrono::steady_clock::now().time_since_epoch())
+                          .count();
+    int64_t window = window_.load(std::memory_order_relaxed);
+    if (now_sec != window &&
+        window_.compare_exchange_strong(window, now_sec,
+                                        std::memory_order_relaxed)) {
+      count_.store(0, std::memory_order_relaxed);
+    }
+    return count_.fetch_add(1, std::memory_order_relaxed) < per_sec_;
+  }
+
+private:
+  uint32_t per_sec_;
+  std::atomic<int64_t> window_{0};
+  std::atomic<uint32_t> count_{0};
+};
+
+inline void set_level(Level level) { Logger::instance().set_level(level); }
+
+inline bool enabled(Level level) { return Logger::instance().enabled(level); }
+
+inline void flush() { Logger::instance().flush(); }
+
+#if defined(__GNUC__)
+__attribute__((format(printf, 2, 3)))
+#endif
+inline void log(Level level, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  Logger::instance().vlog(level, fmt, args);
+  va_end(args);
+}
+
+} // namespace asr_log
+
+#define ASR_LOG(level, ...)                                                    \
+  do {                                                                         \
+    if (::asr_log::enabled(level))                                             \
+      ::asr_log::log(level, __VA_ARGS__);                                      \
+  } while (0)
+
+#define ASR_LOG_RATE_LIMITED(level, per_sec, ...)                              \
+  do {                                                                         \
+    if (::asr_log::enabled(level)) {                                           \
+      static ::asr_log::RateLimiter asr_log_limiter_(per_sec);                 \
+      if (asr_log_limiter_.allow())                                            \
+        ::asr_log::log(level, __VA_ARGS__);                                    \
+    }                                                                          \
+  } while (0)
+
+#define ASR_LOG_TRACE(...) ASR_LOG(::asr_log::Level::Trace, __VA_ARGS__)
+#define ASR_LOG_DEBUG(...) ASR_LOG(::asr_log::Level::Debug, __VA_ARGS__)
+#define ASR_LOG_INFO(...) ASR_LOG(::asr_log::Level::Info, __VA_ARGS__)
+#define ASR_LOG_WARN(...) ASR_LOG(::asr_log::Level::Warn, __VA_ARGS__)
+#define ASR_LOG_ERROR(...) ASR_LOG(::asr_log::Level::Error, __VA_ARGS__)
@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include <queue>
+#include <list>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -17,67 +18,296 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <sys/eventfd.h>
 #include <algorithm>
 #include <stdexcept>
 #include <sstream>
 #include <cstdlib>
 #include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <optional>
+#include <unordered_set>
 #include <curl/curl.h>
 
+#include "asr_arena.h"
+#include "asr_audio.h"
+#include "asr_bulk.h"
+#include "asr_capture.h"
+#include "asr_convert.h"
+#include "asr_handoff.h"
+#include "asr_http.h"
+#include "asr_journal.h"
+#include "asr_local.h"
+#include "asr_log.h"
+#include "asr_pool.h"
+#include "asr_protocol.h"
+#include "asr_rules.h"
+#include "asr_session_registry.h"
+#include "asr_trace.h"
+#include "asr_upstream.h"
+#include "asr_ws.h"
+
 // ============================================================================
 // Configuration
 // ============================================================================
 constexpr int MCP_PORT = 8080;
 constexpr int MAX_CONNECTIONS = 100;
-constexpr int BUFFER_SIZE = 16384;
 constexpr int AUDIO_CHUNK_SIZE = 4096;
 
-// ASR API Configuration
-constexpr const char* ASR_API_URL = "https://asr.votee-demo.votee.dev/v1/audio/transcriptions";
-constexpr const char* ASR_MODEL = "votee/stt-v2";
-constexpr const char* ASR_LANGUAGE = "yue";
-constexpr const char* ASR_TIMESTAMP_GRANULARITIES = "[\"segment\"]";
-constexpr const char* ASR_RESPONSE_FORMAT = "verbose_json";
-
 // Timeout and size constants
 constexpr long HTTP_TIMEOUT_SEC = 300L; // 5 minutes for long audio
 constexpr long CONNECTION_TIMEOUT_SEC = 30L;
 constexpr size_t MAX_AUDIO_SIZE = 100 * 1024 * 1024; // 100MB max
 constexpr int POLL_TIMEOUT_MS = 1000;
+constexpr int PROGRESSIVE_IDLE_SEC = 30; // Give up a live upload with no new audio
+constexpr long STALL_TIMEOUT_SEC = 60L; // Give up an upstream silent this long
 
-// Get API key from environment variable
-static std::string get_api_key() {
-    const char* env_key = std::getenv("ASR_API_KEY");
-    if (env_key && strlen(env_key) > 0) {
-        return std::string(env_key);
-    }
-    // Fallback to default (should be removed in production)
-    return "votee_112f7d0b1b0af5c537626429";
-}
+// Hedging: a clip of up to HEDGE_MAX_AUDIO_BYTES of PCM that has no response
+// by the p95 latency of recent short clips is also sent to another endpoint
+constexpr size_t HEDGE_MAX_AUDIO_BYTES = 15 * 32000; // 15 s of 16 kHz s16le
+constexpr double HEDGE_PERCENTILE = 0.95;
+constexpr auto MIN_HEDGE_DELAY = std::chrono::milliseconds(100);
+
+// Micro-batching (ASR_MICROBATCH_MS): clips of up to MICROBATCH_MAX_CLIP_BYTES
+// of PCM share an upload, separated by MICROBATCH_GAP_MS of silence
+constexpr size_t MICROBATCH_MAX_CLIP_BYTES = 5 * 32000; // 5 s of 16 kHz s16le
+constexpr uint64_t MICROBATCH_GAP_MS = 1000;
+constexpr uint64_t MICROBATCH_MAX_AUDIO_MS = 30000; // One model window
+constexpr size_t MICROBATCH_MAX_CLIPS = 16;
+constexpr double MICROBATCH_OVERLAP_SEC = 0.25; // Of a segment into a clip not its own
+constexpr size_t MICROBATCH_SENDERS = 4; // Batches in flight at once
+constexpr auto MICROBATCH_CANCEL_POLL = std::chrono::milliseconds(100);
+
+// Graceful upgrade: how long a predecessor waits for sessions to finish
+constexpr int DRAIN_TIMEOUT_SEC = 600;
+constexpr int DRAIN_POLL_MS = 200;
 
 // ============================================================================
 // ASR Backend HTTP Client
 // ============================================================================
+// A session's eventfd. Its requests share it, so one that finishes after the
+// session is gone never signals a descriptor since reused.
+class WakeFd {
+public:
+    WakeFd() : fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+        if (fd_ < 0) {
+            ASR_LOG_ERROR("eventfd failed: %s", strerror(errno));
+        }
+    }
+    
+    ~WakeFd() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+    
+    WakeFd(const WakeFd&) = delete;
+    WakeFd& operator=(const WakeFd&) = delete;
+    
+    int fd() const { return fd_; }
+    
+private:
+    int fd_;
+};
+
+// One transcription request's results. Filled by the request's thread (and
+// WriteCallback), drained by the session thread, which tags them with `id`.
+// With a journal, results are recorded there instead, already tagged, as
+// soon as the request is no longer held; whatever the journal cannot take
+// stays queued here.
 struct StreamContext {
     std::queue<std::string> result_queue;
+    std::vector<std::string> closing; // Errors and completion, sent after the results
     std::mutex mutex;
     bool streaming;
+    bool complete; // Nothing more will be queued
+    bool held;     // Results wait for finalize (live uploads)
+    std::string id; // Client request id as a JSON token, empty if untagged
+    uint32_t capture_id; // asr_capture session, 0 when capture is off
+    asr_trace::Context trace;
+    // Session eventfd, signalled whenever there is something to send; null
+    // when nothing waits on the results
+    std::shared_ptr<WakeFd> wake_fd;
+    asr_protocol::JsonObjectSplitter splitter; // Session thread only
+    std::shared_ptr<asr_journal::Journal> journal; // Null when journaling is off
+    asr_protocol::JsonObjectSplitter journal_splitter; // Guarded by mutex
+    // Rewriting of results: script conversion (see asr_convert.h) and the
+    // tenant's rules (see asr_rules.h, null when it has none). Guarded by
+    // mutex.
+    std::shared_ptr<asr_rules::TenantRules> rules;
+    asr_protocol::JsonObjectSplitter rewrite_splitter;
+    std::string converted;
+    std::string convert_scratch;
+    std::string ruled;
+    bool raw; // Queued as received, never rewritten (micro-batches, see MicroBatcher)
+    // Session audio (ms) before and after this request's; results are stamped
+    // with the start until the request completes successfully
+    uint64_t audio_start_ms;
+    uint64_t audio_end_ms;
+    bool transcribed; // Completed successfully
+    // Set when no one will read the results: the client cancelled the
+    // request, or went away without a journal to resume from
+    asr_http::Cancellation cancellation;
+    
+    StreamContext(uint32_t capture, std::shared_ptr<WakeFd> wake)
+        : streaming(false), complete(false), held(false), capture_id(capture),
+          wake_fd(std::move(wake)), raw(false), audio_start_ms(0), audio_end_ms(0), transcribed(false) {}
+    
+    void wake() {
+        if (!wake_fd) return; // Bulk runs read the results once complete
+        uint64_t one = 1;
+        if (write(wake_fd->fd(), &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            ASR_LOG_RATE_LIMITED(asr_log::Level::Warn, 5, "Session wakeup failed: %s",
+                                 strerror(errno));
+        }
+    }
+    
+    // Upstream response data. With conversion or rules on it is queued as
+    // rewritten result objects rather than as it arrived.
+    void push(const char* data, size_t len) {
+        const asr_convert::Converter& converter = asr_convert::Converter::instance();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!raw && (converter.enabled() || rules)) {
+                std::shared_ptr<const asr_rules::Rules> current =
+                    rules ? rules->current() : nullptr;
+                rewrite_splitter.feed(data, len, [&](const std::string& object) {
+                    const std::string* result = &object;
+                    if (converter.enabled()) {
+                        converter.convert(object, converted, convert_scratch);
+                        result = &converted;
+                    }
+                    if (current) {
+                        apply_rules(*current, *result);
+                        result = &ruled;
+                    }
+                    result_queue.push(*result);
+                });
+            } else {
+                result_queue.emplace(data, len);
+            }
+            journal_locked();
+        }
+        wake();
+    }
+    
+    // Queues the messages that end this request
+    void finish(std::vector<std::string> messages, bool success = false) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = std::move(messages);
+            complete = true;
+            transcribed = success;
+            journal_locked();
+        }
+        wake();
+    }
     
-    StreamContext() : streaming(false) {}
+    // Drops a request the client never asked for (a live upload that was
+    // replaced or failed before finalize)
+    void abandon() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::queue<std::string>().swap(result_queue);
+            closing.clear();
+            held = false;
+            complete = true;
+        }
+        wake();
+    }
+    
+    // Hands results held back so far to the client under `request_id`
+    void release(const std::string& request_id, uint64_t end_ms) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            id = request_id;
+            held = false;
+            audio_end_ms = end_ms;
+            journal_locked();
+        }
+        wake();
+    }
+    
+private:
+    // Sets `ruled` to `object` with the rules applied to its "text" members.
+    // Must hold mutex.
+    void apply_rules(const asr_rules::Rules& current, const std::string& object) {
+        ruled.clear();
+        size_t copied = 0, begin, end;
+        while (asr_protocol::find_string_member(object, "text", copied, begin, end)) {
+            ruled.append(object, copied, begin - copied);
+            current.apply(std::string_view(object).substr(begin, end - begin), ruled, true);
+            copied = end;
+        }
+        ruled.append(object, copied, std::string::npos);
+    }
+    
+    // Moves what is queued into the journal, one record per result object.
+    // Must hold mutex.
+    void journal_locked() {
+        if (!journal || held) return;
+        std::queue<std::string> results;
+        results.swap(result_queue);
+        for (; !results.empty(); results.pop()) {
+            const std::string& chunk = results.front();
+            journal_splitter.feed(chunk.data(), chunk.size(), [&](const std::string& object) {
+                if (!record(object, audio_start_ms)) {
+                    result_queue.push(object);
+                }
+            });
+        }
+        const uint64_t closing_ms = transcribed ? audio_end_ms : audio_start_ms;
+        auto kept = std::remove_if(closing.begin(), closing.end(), [&](const std::string& m) {
+            return record(m, closing_ms);
+        });
+        closing.erase(kept, closing.end());
+    }
+    
+    bool record(const std::string& message, uint64_t audio_ms) {
+        std::string tagged;
+        asr_protocol::append_tagged(tagged, message, id);
+        return journal->append(audio_ms, tagged) != 0;
+    }
+};
+
+// Where a request's response data goes. Attempts of a hedged request share
+// `winner`: the first to receive data claims it and the others abort.
+struct ResponseSink {
+    StreamContext* stream;
+    int* winner; // Null unless hedged
+    int attempt;
+    std::chrono::steady_clock::time_point last_data; // Of the response
+    
+    bool lost() const { return winner && *winner >= 0 && *winner != attempt; }
 };
 
 // Callback for writing HTTP response data (streaming results)
 static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
-    StreamContext* ctx = static_cast<StreamContext*>(userp);
+    ResponseSink* sink = static_cast<ResponseSink*>(userp);
+    StreamContext* ctx = sink->stream;
     size_t total_size = size * nmemb;
-    
-    std::lock_guard<std::mutex> lock(ctx->mutex);
-    std::string chunk(reinterpret_cast<char*>(contents), total_size);
-    ctx->result_queue.push(chunk);
+    if (sink->winner && *sink->winner < 0) {
+        *sink->winner = sink->attempt;
+    }
+    if (sink->lost() || ctx->cancellation.cancelled()) {
+        return 0; // Aborts the transfer
+    }
+    sink->last_data = std::chrono::steady_clock::now();
+    asr_capture::record(ctx->capture_id, asr_capture::Kind::UpstreamMessage,
+                        contents, total_size);
+    ctx->push(static_cast<const char*>(contents), total_size);
     
     return total_size;
 }
 
+// Upstream replicas (ASR_API_URLS) and the latencies behind the hedge delay
+struct Upstream {
+    asr_upstream::Endpoints endpoints{asr_http::api_urls()};
+    asr_upstream::LatencyWindow short_clips;
+};
+
 class ASRConnection {
 private:
     CURL* curl_;
@@ -86,13 +316,26 @@ private:
     StreamContext* current_stream_;
     
 public:
-    ASRConnection() : curl_(nullptr), in_use_(false), current_stream_(nullptr) {
+    explicit ASRConnection(asr_http::CurlShare& share)
+        : curl_(nullptr), in_use_(false), current_stream_(nullptr) {
         curl_ = curl_easy_init();
         if (curl_) {
             curl_easy_setopt(curl_, CURLOPT_SSL_VERIFYPEER, 1L);
             curl_easy_setopt(curl_, CURLOPT_SSL_VERIFYHOST, 2L);
             curl_easy_setopt(curl_, CURLOPT_TIMEOUT, HTTP_TIMEOUT_SEC);
             curl_easy_setopt(curl_, CURLOPT_CONNECTTIMEOUT, CONNECTION_TIMEOUT_SEC);
+            curl_easy_setopt(curl_, CURLOPT_LOW_SPEED_LIMIT, 1L);
+            curl_easy_setopt(curl_, CURLOPT_LOW_SPEED_TIME, STALL_TIMEOUT_SEC);
+            curl_easy_setopt(curl_, CURLOPT_TCP_KEEPALIVE, 1L);
+            curl_easy_setopt(curl_, CURLOPT_NOSIGNAL, 1L);
+            
+            // Request state that never changes between requests
+            if (share.handle()) {
+                curl_easy_setopt(curl_, CURLOPT_SHARE, share.handle());
+            }
+            curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, share.headers());
+            curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, WriteCallback);
+            curl_easy_setopt(curl_, CURLOPT_VERBOSE, 0L);
         }
     }
     
@@ -107,10 +350,17 @@ public:
     }
     
     bool transcribe_audio(const uint8_t* audio_data, size_t audio_len, 
-                         StreamContext* stream_ctx) {
+                         StreamContext* stream_ctx, const asr_trace::Context& trace,
+                         const std::string& url, const std::string& language,
+                         bool stream = true) {
         std::lock_guard<std::mutex> lock(mutex_);
         if (!curl_) return false;
         
+        // Driven through a multi handle so that cancellation interrupts the
+        // wait for the response at once
+        CURLM* multi = curl_multi_init();
+        if (!multi) return false;
+        
         current_stream_ = stream_ctx;
         
         // Mark streaming as active
@@ -119,73 +369,144 @@ public:
             stream_ctx->streaming = true;
         }
         
-        // Prepare multipart form data
-        struct curl_httppost* formpost = nullptr;
-        struct curl_httppost* lastptr = nullptr;
-        
-        // Add form fields
-        curl_formadd(&formpost, &lastptr,
-                    CURLFORM_COPYNAME, "model",
-                    CURLFORM_COPYCONTENTS, ASR_MODEL,
-                    CURLFORM_END);
-        
-        curl_formadd(&formpost, &lastptr,
-                    CURLFORM_COPYNAME, "file",
-                    CURLFORM_BUFFER, "audio.mp3",
-                    CURLFORM_BUFFERPTR, audio_data,
-                    CURLFORM_BUFFERLENGTH, audio_len,
-                    CURLFORM_END);
-        
-        curl_formadd(&formpost, &lastptr,
-                    CURLFORM_COPYNAME, "stream",
-                    CURLFORM_COPYCONTENTS, "True",
-                    CURLFORM_END);
-        
-        curl_formadd(&formpost, &lastptr,
-                    CURLFORM_COPYNAME, "language",
-                    CURLFORM_COPYCONTENTS, ASR_LANGUAGE,
-                    CURLFORM_END);
-        
-        curl_formadd(&formpost, &lastptr,
-                    CURLFORM_COPYNAME, "timestamp_granularities",
-                    CURLFORM_COPYCONTENTS, ASR_TIMESTAMP_GRANULARITIES,
-                    CURLFORM_END);
-        
-        curl_formadd(&formpost, &lastptr,
-                    CURLFORM_COPYNAME, "response_format",
-                    CURLFORM_COPYCONTENTS, ASR_RESPONSE_FORMAT,
-                    CURLFORM_END);
-        
-        curl_formadd(&formpost, &lastptr,
-                    CURLFORM_COPYNAME, "vad_filter",
-                    CURLFORM_COPYCONTENTS, "True",
-                    CURLFORM_END);
-        
-        // Set up HTTP request
-        std::string api_key = get_api_key();
-        std::string api_key_header = "x-api-key: " + api_key;
-        struct curl_slist* headers = nullptr;
-        headers = curl_slist_append(headers, api_key_header.c_str());
-        
-        curl_easy_setopt(curl_, CURLOPT_URL, ASR_API_URL);
-        curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, headers);
-        curl_easy_setopt(curl_, CURLOPT_HTTPPOST, formpost);
-        curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl_, CURLOPT_WRITEDATA, stream_ctx);
-        curl_easy_setopt(curl_, CURLOPT_VERBOSE, 0L);
+        // Results are streamed back through WriteCallback as they arrive
+        // (or, unless `stream`, arrive as one verbose_json response)
+        ResponseSink sink = {stream_ctx, nullptr, 0, {}};
+        asr_http::TranscriptionForm form(curl_, audio_data, audio_len, stream, language);
+        curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl_, CURLOPT_MIMEPOST, form.get());
+        curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &sink);
         
         // Perform request (this will block until complete or error)
-        CURLcode res = curl_easy_perform(curl_);
+        asr_capture::record(stream_ctx->capture_id, asr_capture::Kind::UpstreamOpen,
+                            nullptr, 0);
+        asr_trace::Span span("upstream_request", trace);
+        stream_ctx->cancellation.attach(multi);
+        curl_multi_add_handle(multi, curl_);
+        CURLcode res = perform(multi, stream_ctx->cancellation);
+        curl_multi_remove_handle(multi, curl_);
+        stream_ctx->cancellation.attach(nullptr);
+        curl_multi_cleanup(multi);
+        asr_http::trace_phases(curl_, form, span.context(), span.start_ns());
+        span.end();
         
         // Get error details if failed
-        if (res != CURLE_OK) {
+        if (res != CURLE_OK && !stream_ctx->cancellation.cancelled()) {
             const char* err_str = curl_easy_strerror(res);
-            std::cerr << "CURL error: " << err_str << " (code: " << res << ")" << std::endl;
+            ASR_LOG_ERROR("CURL error: %s (code: %d)", err_str, static_cast<int>(res));
         }
         
         // Cleanup
-        curl_formfree(formpost);
-        curl_slist_free_all(headers);
+        curl_easy_setopt(curl_, CURLOPT_MIMEPOST, nullptr);
+        
+        {
+            std::lock_guard<std::mutex> ctx_lock(stream_ctx->mutex);
+            stream_ctx->streaming = false;
+        }
+        
+        current_stream_ = nullptr;
+        return (res == CURLE_OK);
+    }
+    
+    // Sends audio while it is still being recorded: the multipart body is
+    // streamed with chunked transfer encoding from `body`, pausing whenever
+    // it has been sent in full. Returns once the response is complete, the
+    // body is cancelled or the recording goes idle.
+    bool transcribe_progressive(asr_http::ProgressiveBody& body, StreamContext* stream_ctx,
+                                const asr_trace::Context& trace, const std::string& url,
+                                const std::string& language,
+                                std::chrono::steady_clock::duration& response_time) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!curl_) return false;
+        
+        CURLM* multi = curl_multi_init();
+        if (!multi) return false;
+        
+        current_stream_ = stream_ctx;
+        {
+            std::lock_guard<std::mutex> ctx_lock(stream_ctx->mutex);
+            stream_ctx->streaming = true;
+        }
+        
+        ResponseSink sink = {stream_ctx, nullptr, 0, {}};
+        asr_http::TranscriptionForm form(curl_, body, true, language);
+        curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl_, CURLOPT_MIMEPOST, form.get());
+        curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &sink);
+        // The recording length is open-ended, and the upload pauses between
+        // chunks; the response deadline and stall limit are enforced below
+        // from the moment the body is finished
+        curl_easy_setopt(curl_, CURLOPT_TIMEOUT, 0L);
+        curl_easy_setopt(curl_, CURLOPT_LOW_SPEED_TIME, 0L);
+        
+        asr_capture::record(stream_ctx->capture_id, asr_capture::Kind::UpstreamOpen,
+                            nullptr, 0);
+        asr_trace::Span span("upstream_request", trace);
+        body.attach(multi);
+        stream_ctx->cancellation.attach(multi);
+        curl_multi_add_handle(multi, curl_);
+        
+        std::chrono::steady_clock::time_point deadline;
+        std::chrono::steady_clock::time_point finished_at;
+        bool deadline_set = false;
+        int running = 1;
+        CURLMcode mres = CURLM_OK;
+        while (running && mres == CURLM_OK) {
+            if (body.cancelled() || stream_ctx->cancellation.cancelled() ||
+                body.idle() > std::chrono::seconds(PROGRESSIVE_IDLE_SEC)) {
+                break;
+            }
+            const auto now = std::chrono::steady_clock::now();
+            if (body.finished() && !deadline_set) {
+                finished_at = now;
+                deadline = finished_at + std::chrono::seconds(HTTP_TIMEOUT_SEC);
+                deadline_set = true;
+            }
+            if (deadline_set && now > deadline) {
+                ASR_LOG_ERROR("Progressive upload timed out");
+                break;
+            }
+            if (deadline_set &&
+                now - std::max(finished_at, sink.last_data) >
+                    std::chrono::seconds(STALL_TIMEOUT_SEC)) {
+                ASR_LOG_ERROR("Progressive upload stalled");
+                break;
+            }
+            if (body.resume_pending()) {
+                curl_easy_pause(curl_, CURLPAUSE_CONT);
+            }
+            mres = curl_multi_perform(multi, &running);
+            if (running && mres == CURLM_OK) {
+                mres = curl_multi_poll(multi, nullptr, 0, POLL_TIMEOUT_MS, nullptr);
+            }
+        }
+        
+        CURLcode res = CURLE_ABORTED_BY_CALLBACK;
+        int pending = 0;
+        while (CURLMsg* m = curl_multi_info_read(multi, &pending)) {
+            if (m->msg == CURLMSG_DONE) {
+                res = m->data.result;
+            }
+        }
+        if (running == 0 && res != CURLE_OK) {
+            ASR_LOG_ERROR("CURL error: %s (code: %d)", curl_easy_strerror(res),
+                          static_cast<int>(res));
+        }
+        
+        // Only the wait after the last audio byte says anything about the
+        // endpoint
+        response_time = deadline_set ? std::chrono::steady_clock::now() - finished_at
+                                     : std::chrono::steady_clock::duration::zero();
+        curl_multi_remove_handle(multi, curl_);
+        body.attach(nullptr);
+        stream_ctx->cancellation.attach(nullptr);
+        curl_multi_cleanup(multi);
+        asr_http::trace_phases(curl_, form, span.context(), span.start_ns());
+        span.end();
+        
+        curl_easy_setopt(curl_, CURLOPT_MIMEPOST, nullptr);
+        curl_easy_setopt(curl_, CURLOPT_TIMEOUT, HTTP_TIMEOUT_SEC);
+        curl_easy_setopt(curl_, CURLOPT_LOW_SPEED_TIME, STALL_TIMEOUT_SEC);
         
         {
             std::lock_guard<std::mutex> ctx_lock(stream_ctx->mutex);
@@ -196,6 +517,45 @@ public:
         return (res == CURLE_OK);
     }
     
+    // Drives the one transfer on `multi` until it completes or is cancelled
+    // (CURLE_ABORTED_BY_CALLBACK)
+    static CURLcode perform(CURLM* multi, const asr_http::Cancellation& cancellation) {
+        int running = 1;
+        CURLMcode mres = CURLM_OK;
+        while (running && mres == CURLM_OK && !cancellation.cancelled()) {
+            mres = curl_multi_perform(multi, &running);
+            if (running && mres == CURLM_OK) {
+                mres = curl_multi_poll(multi, nullptr, 0, POLL_TIMEOUT_MS, nullptr);
+            }
+        }
+        CURLcode res = CURLE_ABORTED_BY_CALLBACK;
+        int pending = 0;
+        while (CURLMsg* m = curl_multi_info_read(multi, &pending)) {
+            if (m->msg == CURLMSG_DONE) {
+                res = m->data.result;
+            }
+        }
+        return res;
+    }
+    
+    // One attempt of a hedged request, run on the caller's multi handle
+    // (see MCPSession::transcribe_hedged) so that the loser can be removed
+    // as soon as the winner is known.
+    void start_attempt(CURLM* multi, asr_http::TranscriptionForm& form, ResponseSink& sink,
+                       const std::string& url) {
+        curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl_, CURLOPT_MIMEPOST, form.get());
+        curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &sink);
+        curl_multi_add_handle(multi, curl_);
+    }
+    
+    void end_attempt(CURLM* multi) {
+        curl_multi_remove_handle(multi, curl_);
+        curl_easy_setopt(curl_, CURLOPT_MIMEPOST, nullptr);
+    }
+    
+    CURL* handle() const { return curl_; }
+    
     bool get_result(std::string& result) {
         std::lock_guard<std::mutex> lock(mutex_);
         if (!current_stream_) return false;
@@ -214,398 +574,1766 @@ public:
     void set_in_use(bool use) { in_use_ = use; }
 };
 
-class ASRConnectionPool {
-private:
-    std::vector<std::unique_ptr<ASRConnection>> connections_;
-    std::mutex pool_mutex_;
-    std::condition_variable cv_;
-    size_t pool_size_;
-    
+using ASRConnectionPool = asr_pool::ConnectionPool<ASRConnection>;
+
+// ============================================================================
+// Micro-batching of Short Clips
+// ============================================================================
+// Short clips from any session, in the same language, that arrive within the
+// window are sent as one upload: joined by silence, with a non-streamed
+// verbose_json response whose segments are handed back to their clips by
+// timestamp. The clips of a failed batch, and clips a segment straddles, are
+// sent on their own instead.
+class MicroBatcher {
 public:
-    ASRConnectionPool(size_t size) : pool_size_(size) {
-        for (size_t i = 0; i < pool_size_; ++i) {
-            auto conn = std::make_unique<ASRConnection>();
-            if (conn->is_valid()) {
-                connections_.push_back(std::move(conn));
-            }
-        }
+    // A clip's result object, or nullopt if it has to be sent on its own
+    using Outcome = std::optional<std::string>;
+    
+    // Null unless ASR_MICROBATCH_MS sets a window
+    static std::unique_ptr<MicroBatcher> create(ASRConnectionPool& pool, Upstream& upstream) {
+        const char* env = std::getenv("ASR_MICROBATCH_MS");
+        const long window_ms = env ? std::atol(env) : 0;
+        if (window_ms <= 0) return nullptr;
+        return std::make_unique<MicroBatcher>(pool, upstream,
+                                              std::chrono::milliseconds(window_ms));
     }
     
-    ASRConnection* acquire() {
-        std::unique_lock<std::mutex> lock(pool_mutex_);
-        cv_.wait(lock, [this] {
-            return std::any_of(connections_.begin(), connections_.end(),
-                [](const auto& conn) { return !conn->is_in_use(); });
-        });
-        
-        for (auto& conn : connections_) {
-            if (!conn->is_in_use()) {
-                conn->set_in_use(true);
-                return conn.get();
-            }
+    MicroBatcher(ASRConnectionPool& pool, Upstream& upstream, std::chrono::milliseconds window)
+        : pool_(pool), upstream_(upstream), window_(window), running_(true) {
+        for (size_t i = 0; i < MICROBATCH_SENDERS; ++i) {
+            senders_.emplace_back([this] { send_loop(); });
         }
-        return nullptr;
     }
     
-    void release(ASRConnection* conn) {
-        std::lock_guard<std::mutex> lock(pool_mutex_);
-        conn->set_in_use(false);
-        cv_.notify_one();
+    ~MicroBatcher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        cv_.notify_all();
+        for (std::thread& t : senders_) {
+            t.join();
+        }
     }
-};
-
-// ============================================================================
-// MCP Protocol Handler
-// ============================================================================
-class MCPSession {
-private:
-    int client_fd_;
-    ASRConnectionPool& pool_;
-    std::atomic<bool> active_;
-    std::atomic<bool> finished_;
-    std::thread worker_thread_;
-    std::unique_ptr<StreamContext> stream_ctx_;
-    std::vector<uint8_t> accumulated_audio_;
-    std::mutex audio_mutex_;
-    std::vector<std::thread> transcription_threads_;
-    std::mutex threads_mutex_;
     
-public:
-    MCPSession(int fd, ASRConnectionPool& pool) 
-        : client_fd_(fd), pool_(pool), active_(true), finished_(false) {
-        stream_ctx_ = std::make_unique<StreamContext>();
-    }
+    std::chrono::milliseconds window() const { return window_; }
     
-    ~MCPSession() {
-        active_ = false;
-        finished_ = true;
-        
-        // Wait for all transcription threads to complete
+    // Queues a clip, a WAV upload of normalized PCM (see make_wav_upload), for
+    // the next batch in `language`
+    std::future<Outcome> submit(const std::vector<uint8_t>& wav, const std::string& language) {
+        const size_t pcm_bytes = wav.size() - 44;
+        std::future<Outcome> outcome;
+        bool ready = false;
         {
-            std::lock_guard<std::mutex> lock(threads_mutex_);
-            for (auto& t : transcription_threads_) {
-                if (t.joinable()) {
-                    t.join();
-                }
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto open = std::find_if(open_.begin(), open_.end(), [&](const Batch& b) {
+                return b.language == language && !b.closed;
+            });
+            if (open != open_.end() &&
+                asr_audio::pcm_duration_ms(open->wav.size() - 44 + gap_bytes() + pcm_bytes) >
+                    MICROBATCH_MAX_AUDIO_MS) {
+                close(*open);
+                ready = true;
+                open = open_.end();
+            }
+            if (open == open_.end()) {
+                open_.emplace_back();
+                open = std::prev(open_.end());
+                open->language = language;
+                open->deadline = std::chrono::steady_clock::now() + window_;
+                open->wav.reserve(44 + MICROBATCH_MAX_AUDIO_MS * bytes_per_ms());
+                open->wav.resize(44); // Header written when sent
+            } else {
+                open->wav.resize(open->wav.size() + gap_bytes(), 0);
+            }
+            
+            Clip& clip = open->clips.emplace_back();
+            clip.offset_ms = asr_audio::pcm_duration_ms(open->wav.size() - 44);
+            clip.duration_ms = asr_audio::pcm_duration_ms(pcm_bytes);
+            outcome = clip.outcome.get_future();
+            open->wav.insert(open->wav.end(), wav.begin() + 44, wav.end());
+            if (open->clips.size() == 1) {
+                ready = true; // A sender waits for its deadline
+            }
+            if (open->clips.size() >= MICROBATCH_MAX_CLIPS) {
+                close(*open);
+                ready = true;
             }
         }
-        
-        if (worker_thread_.joinable()) {
-            worker_thread_.join();
-        }
-        
-        if (client_fd_ >= 0) {
-            close(client_fd_);
+        if (ready) {
+            cv_.notify_all();
         }
+        return outcome;
     }
     
-    bool is_finished() const {
-        return finished_.load();
-    }
+private:
+    struct Clip {
+        uint64_t offset_ms = 0; // Into the batch's audio
+        uint64_t duration_ms = 0;
+        std::promise<Outcome> outcome;
+    };
     
-    void start() {
-        worker_thread_ = std::thread(&MCPSession::handle_session, this);
+    struct Batch {
+        std::string language;
+        std::vector<uint8_t> wav;
+        std::vector<Clip> clips;
+        std::chrono::steady_clock::time_point deadline;
+        bool closed = false; // Full: sent without waiting for the deadline
+    };
+    
+    static constexpr size_t bytes_per_ms() { return asr_audio::TARGET_SAMPLE_RATE * 2 / 1000; }
+    static constexpr size_t gap_bytes() { return MICROBATCH_GAP_MS * bytes_per_ms(); }
+    
+    static void close(Batch& batch) {
+        batch.closed = true;
+        batch.deadline = std::chrono::steady_clock::now();
     }
     
-private:
-    void handle_session() {
-        uint8_t buffer[BUFFER_SIZE];
-        
-        // Send initial handshake
-        send_response("{\"type\":\"initialized\",\"server\":\"asr-mcp\",\"version\":\"1.0\"}");
-        
-        while (active_) {
-            // Poll for data from client
-            struct pollfd pfd = {client_fd_, POLLIN, 0};
-            int ret = poll(&pfd, 1, POLL_TIMEOUT_MS);
-            
-            if (ret > 0 && (pfd.revents & POLLIN)) {
-                ssize_t n = recv(client_fd_, buffer, BUFFER_SIZE, MSG_DONTWAIT);
-                
-                if (n <= 0) {
-                    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
-                        break; // Connection closed or error
-                    }
-                    continue;
-                }
-                
-                // Safe string construction with explicit length
-                std::string msg(reinterpret_cast<char*>(buffer), static_cast<size_t>(n));
-                
-                if (msg.find("\"method\":\"transcribe\"") != std::string::npos) {
-                    handle_transcribe_request(msg);
-                } else if (msg.find("\"method\":\"stream_audio\"") != std::string::npos) {
-                    handle_audio_stream(buffer, n);
-                } else if (msg.find("\"method\":\"finalize_transcription\"") != std::string::npos) {
-                    handle_finalize_transcription();
-                }
-            }
-            
-            // Check for results from ASR backend (streaming)
-            std::string result;
-            {
-                std::lock_guard<std::mutex> lock(stream_ctx_->mutex);
-                if (!stream_ctx_->result_queue.empty()) {
-                    result = stream_ctx_->result_queue.front();
-                    stream_ctx_->result_queue.pop();
-                }
+    // Sender thread: sends each batch once it is due
+    void send_loop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (running_ || !open_.empty()) {
+            if (open_.empty()) {
+                cv_.wait(lock);
+                continue;
             }
-            
-            if (!result.empty()) {
-                // Forward partial results immediately
-                send_response(result);
+            auto due = std::min_element(open_.begin(), open_.end(),
+                                        [](const Batch& a, const Batch& b) {
+                                            return a.deadline < b.deadline;
+                                        });
+            if (running_ && due->deadline > std::chrono::steady_clock::now()) {
+                cv_.wait_until(lock, due->deadline);
+                continue;
             }
+            Batch batch = std::move(*due);
+            open_.erase(due);
+            lock.unlock();
+            send(batch);
+            lock.lock();
         }
     }
     
-    void handle_transcribe_request(const std::string& msg) {
-        // Extract audio data from message (simplified)
-        // In production, parse JSON properly and extract base64 audio
-        // For now, assume audio is in the message body or will be streamed
+    void send(Batch& batch) {
+        std::vector<uint8_t> header;
+        asr_audio::append_wav_header(header, batch.wav.size() - 44);
+        std::copy(header.begin(), header.end(), batch.wav.begin());
         
-        std::vector<uint8_t> audio_copy;
-        {
-            std::lock_guard<std::mutex> audio_lock(audio_mutex_);
-            
-            if (accumulated_audio_.empty()) {
-                send_error("No audio data provided");
-                return;
+        std::string response;
+        bool success = false;
+        if (ASRConnection* asr_conn = pool_.acquire()) {
+            StreamContext stream(0, nullptr);
+            stream.raw = true; // Rewritten per clip, for its session's tenant
+            asr_upstream::Lease lease = upstream_.endpoints.acquire();
+            const auto started = std::chrono::steady_clock::now();
+            success = asr_conn->transcribe_audio(batch.wav.data(), batch.wav.size(), &stream,
+                                                 stream.trace,
+                                                 upstream_.endpoints.address(lease.index()),
+                                                 batch.language, false);
+            pool_.release(asr_conn);
+            if (success) {
+                upstream_.endpoints.record(lease.index(),
+                                           std::chrono::steady_clock::now() - started);
+            } else {
+                upstream_.endpoints.record_failure(lease.index());
             }
-            
-            // Check size limit
-            if (accumulated_audio_.size() > MAX_AUDIO_SIZE) {
-                send_error("Audio data too large (max " + std::to_string(MAX_AUDIO_SIZE) + " bytes)");
-                return;
+            for (; !stream.result_queue.empty(); stream.result_queue.pop()) {
+                response += stream.result_queue.front();
             }
-            
-            // Copy audio data for thread safety
-            audio_copy = accumulated_audio_;
         }
         
-        ASRConnection* asr_conn = pool_.acquire();
-        if (!asr_conn) {
-            send_error("No ASR connection available");
-            return;
+        const size_t n = batch.clips.size();
+        std::vector<std::vector<asr_protocol::Segment>> segments(n);
+        std::vector<bool> alone(n, !success);
+        if (success && !asr_protocol::for_each_segment(response, [&](const asr_protocol::Segment& s) {
+                assign(batch, s, segments, alone);
+            })) {
+            alone.assign(n, true);
         }
-        
-        // Create thread and track it
-        std::thread transcribe_thread([this, asr_conn, audio_copy]() {
-            bool success = asr_conn->transcribe_audio(
-                audio_copy.data(), 
-                audio_copy.size(), 
-                stream_ctx_.get()
-            );
-            if (!success) {
-                send_error("Transcription request failed");
+        size_t sent_alone = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (alone[i]) {
+                ++sent_alone;
+                batch.clips[i].outcome.set_value(std::nullopt);
+            } else {
+                batch.clips[i].outcome.set_value(result_object(segments[i]));
             }
-            pool_.release(asr_conn);
-        });
-        
-        // Store thread reference for cleanup
-        {
-            std::lock_guard<std::mutex> threads_lock(threads_mutex_);
-            transcription_threads_.push_back(std::move(transcribe_thread));
-        }
-    }
-    
-    void handle_audio_stream(const uint8_t* data, size_t len) {
-        // Validate input
-        if (!data || len == 0) {
-            send_error("Invalid audio data");
-            return;
-        }
-        
-        std::lock_guard<std::mutex> audio_lock(audio_mutex_);
-        
-        // Check size limit
-        if (accumulated_audio_.size() + len > MAX_AUDIO_SIZE) {
-            send_error("Audio data too large (max " + std::to_string(MAX_AUDIO_SIZE) + " bytes)");
-            return;
         }
-        
-        // Accumulate audio chunks
-        accumulated_audio_.insert(accumulated_audio_.end(), data, data + len);
-        size_t total_size = accumulated_audio_.size();
-        
-        // Send acknowledgment
-        send_response("{\"type\":\"audio_received\",\"bytes\":" + 
-                     std::to_string(total_size) + "}");
+        ASR_LOG_DEBUG("Micro-batch of %zu clips (%llu ms): %zu sent alone", n,
+                      static_cast<unsigned long long>(
+                          asr_audio::pcm_duration_ms(batch.wav.size() - 44)),
+                      sent_alone);
     }
     
-    void handle_finalize_transcription() {
-        std::vector<uint8_t> audio_copy;
-        {
-            std::lock_guard<std::mutex> audio_lock(audio_mutex_);
-            
-            if (accumulated_audio_.empty()) {
-                send_error("No audio data to transcribe");
-                return;
-            }
-            
-            // Check size limit
-            if (accumulated_audio_.size() > MAX_AUDIO_SIZE) {
-                send_error("Audio data too large (max " + std::to_string(MAX_AUDIO_SIZE) + " bytes)");
-                return;
+    // Gives `segment` (batch time) to the clip holding its midpoint, or the
+    // nearest clip if that falls in a gap, in the clip's time. A segment that
+    // reaches well into another clip cannot be split, so both clips go alone.
+    static void assign(const Batch& batch, const asr_protocol::Segment& segment,
+                       std::vector<std::vector<asr_protocol::Segment>>& segments,
+                       std::vector<bool>& alone) {
+        const double mid = (segment.start + segment.end) / 2;
+        size_t owner = 0;
+        double nearest = -1;
+        for (size_t i = 0; i < batch.clips.size(); ++i) {
+            const double begin = batch.clips[i].offset_ms / 1000.0;
+            const double end = begin + batch.clips[i].duration_ms / 1000.0;
+            const double distance = mid < begin ? begin - mid : mid > end ? mid - end : 0;
+            if (nearest < 0 || distance < nearest) {
+                owner = i;
+                nearest = distance;
             }
-            
-            // Copy audio data for thread safety and clear
-            audio_copy = accumulated_audio_;
-            accumulated_audio_.clear();
-        }
-        
-        ASRConnection* asr_conn = pool_.acquire();
-        if (!asr_conn) {
-            send_error("No ASR connection available");
-            return;
         }
-        
-        // Start transcription in background thread
-        std::thread transcribe_thread([this, asr_conn, audio_copy]() {
-            bool success = asr_conn->transcribe_audio(
-                audio_copy.data(), 
-                audio_copy.size(), 
-                stream_ctx_.get()
-            );
-            
-            if (!success) {
-                send_error("Transcription request failed");
+        for (size_t i = 0; i < batch.clips.size(); ++i) {
+            const double begin = batch.clips[i].offset_ms / 1000.0;
+            const double end = begin + batch.clips[i].duration_ms / 1000.0;
+            const double overlap = std::min(segment.end, end) - std::max(segment.start, begin);
+            if (i != owner && overlap > MICROBATCH_OVERLAP_SEC) {
+                alone[i] = true;
+                alone[owner] = true;
             }
-            
-            // Send final result marker
-            send_response("{\"type\":\"transcription_complete\"}");
-            
-            pool_.release(asr_conn);
-        });
-        
-        // Store thread reference for cleanup
-        {
-            std::lock_guard<std::mutex> threads_lock(threads_mutex_);
-            transcription_threads_.push_back(std::move(transcribe_thread));
         }
-    }
-    
-    void send_response(const std::string& response) {
-        if (client_fd_ < 0) return;
         
-        std::string msg = response + "\n";
-        ssize_t sent = send(client_fd_, msg.c_str(), msg.length(), MSG_NOSIGNAL);
-        if (sent < 0) {
-            std::cerr << "Error sending response: " << strerror(errno) << std::endl;
-        }
+        const Clip& clip = batch.clips[owner];
+        const double begin = clip.offset_ms / 1000.0;
+        const double duration = clip.duration_ms / 1000.0;
+        asr_protocol::Segment local = segment;
+        local.start = std::clamp(segment.start - begin, 0.0, duration);
+        local.end = std::clamp(segment.end - begin, local.start, duration);
+        segments[owner].push_back(std::move(local));
     }
     
-    void send_error(const std::string& error) {
-        // Escape error message for JSON safety
-        std::string escaped;
-        for (char c : error) {
-            if (c == '"') escaped += "\\\"";
-            else if (c == '\\') escaped += "\\\\";
-            else if (c == '\n') escaped += "\\n";
-            else if (c == '\r') escaped += "\\r";
-            else escaped += c;
+    // A clip's share of the response: {"text":...,"segments":[...]}
+    static std::string result_object(const std::vector<asr_protocol::Segment>& segments) {
+        std::string text;
+        for (const asr_protocol::Segment& s : segments) {
+            text += s.text;
         }
+        const size_t first = text.find_first_not_of(' ');
+        text = first == std::string::npos ? "" : text.substr(first);
         
-        std::stringstream ss;
-        ss << "{\"type\":\"error\",\"message\":\"" << escaped << "\"}\n";
-        send_response(ss.str());
+        std::string object = "{\"text\":\"";
+        asr_protocol::append_json_escaped(object, text);
+        object += "\",\"segments\":[";
+        char times[64];
+        for (size_t i = 0; i < segments.size(); ++i) {
+            snprintf(times, sizeof(times), "%s{\"start\":%.2f,\"end\":%.2f,\"text\":\"",
+                     i ? "," : "", segments[i].start, segments[i].end);
+            object += times;
+            asr_protocol::append_json_escaped(object, segments[i].text);
+            object += "\"}";
+        }
+        object += "]}";
+        return object;
     }
+    
+    ASRConnectionPool& pool_;
+    Upstream& upstream_;
+    const std::chrono::milliseconds window_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::list<Batch> open_; // Not yet sent, in order of arrival
+    bool running_;
+    std::vector<std::thread> senders_;
 };
 
-// ============================================================================
-// Main MCP Server
-// ============================================================================
-class MCPServer {
+// Messages that end a request, as queued on its StreamContext
+static std::string error_message(const std::string& error) {
+    // Escape error message for JSON safety
+    std::stringstream ss;
+    ss << "{\"type\":\"error\",\"message\":\"" << asr_protocol::json_escape(error) << "\"}";
+    return ss.str();
+}
+
+static std::vector<std::string> closing_messages(bool success) {
+    std::vector<std::string> messages;
+    if (!success) {
+        messages.push_back(error_message("Transcription request failed"));
+    }
+    messages.push_back("{\"type\":\"transcription_complete\"}");
+    return messages;
+}
+
+static std::vector<std::string> cancelled_messages() {
+    return {"{\"type\":\"transcription_cancelled\"}"};
+}
+
+// ============================================================================
+// Transcription Requests
+// ============================================================================
+// Runs the sessions' requests against the shared pool and endpoints, each on
+// a detached thread. A request owns its StreamContext, and through it the
+// journal and the session's wakeup, so it can outlive its session: the
+// results of a journaled session that lost its client are still recorded
+// for a resume, and tearing the session down never waits on upstream.
+class Transcriber {
+public:
+    Transcriber(ASRConnectionPool& pool, Upstream& upstream, MicroBatcher* batcher)
+        : pool_(pool), upstream_(upstream), batcher_(batcher), in_flight_(0) {}
+    
+    // Waits for the requests still running; they use the pool and endpoints
+    ~Transcriber() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return in_flight_ == 0; });
+    }
+    
+    Transcriber(const Transcriber&) = delete;
+    Transcriber& operator=(const Transcriber&) = delete;
+    
+    ASRConnectionPool& pool() { return pool_; }
+    bool batching() const { return batcher_ != nullptr; }
+    
+    // Uploads a complete WAV. The thread waits for a pooled connection
+    // itself so that the session reads further requests meanwhile.
+    void start(std::shared_ptr<StreamContext> stream, std::vector<uint8_t> audio,
+               const std::string& language) {
+        run([this, stream, audio = std::move(audio), language]() {
+            if (batcher_ && audio.size() <= 44 + MICROBATCH_MAX_CLIP_BYTES &&
+                transcribe_batched(audio, *stream, language)) {
+                return;
+            }
+            ASRConnection* asr_conn = acquire_connection(*stream);
+            if (stream->cancellation.cancelled()) {
+                if (asr_conn) {
+                    pool_.release(asr_conn);
+                }
+                stream->finish(cancelled_messages());
+                return;
+            }
+            if (!asr_conn) {
+                stream->finish({error_message("No ASR connection available")});
+                return;
+            }
+            bool success;
+            if (audio.size() <= 44 + HEDGE_MAX_AUDIO_BYTES && upstream_.endpoints.size() > 1) {
+                success = transcribe_hedged(asr_conn, audio, *stream, language);
+            } else {
+                success = transcribe_single(asr_conn, audio, *stream, language);
+            }
+            pool_.release(asr_conn);
+            if (stream->cancellation.cancelled()) {
+                stream->finish(cancelled_messages());
+                return;
+            }
+            stream->finish(closing_messages(success), success);
+        });
+    }
+    
+    // Runs a progressive upload (see ASRConnection::transcribe_progressive)
+    // over `asr_conn`, which the caller took from the pool
+    void start_progressive(ASRConnection* asr_conn,
+                           std::shared_ptr<asr_http::ProgressiveBody> upload,
+                           std::shared_ptr<StreamContext> stream, const std::string& language) {
+        run([this, asr_conn, upload, stream, language]() {
+            asr_upstream::Lease lease = upstream_.endpoints.acquire();
+            std::chrono::steady_clock::duration response_time;
+            bool success = asr_conn->transcribe_progressive(
+                *upload, stream.get(), stream->trace,
+                upstream_.endpoints.address(lease.index()), language, response_time);
+            pool_.release(asr_conn);
+            const bool cancelled = upload->cancelled() || stream->cancellation.cancelled();
+            if (!success && !cancelled) {
+                upstream_.endpoints.record_failure(lease.index());
+            } else if (success) {
+                upstream_.endpoints.record(lease.index(), response_time);
+            }
+            
+            // Before finalize a failed upload is dropped quietly; finalize
+            // then sends the recording in full
+            if (!upload->settle()) {
+                stream->abandon();
+                return;
+            }
+            if (stream->cancellation.cancelled()) {
+                stream->finish(cancelled_messages());
+                return;
+            }
+            stream->finish(closing_messages(success), success);
+        });
+    }
+    
+private:
+    template <typename Fn> void run(Fn work) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++in_flight_;
+        }
+        std::thread([this, work = std::move(work)]() mutable {
+            work();
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--in_flight_ == 0) {
+                idle_.notify_all();
+            }
+        }).detach();
+    }
+    
+    // Sends a short clip in a micro-batch with others. False if it has to be
+    // sent on its own after all.
+    bool transcribe_batched(const std::vector<uint8_t>& audio, StreamContext& stream,
+                            const std::string& language) {
+        asr_trace::Span span("microbatch", stream.trace);
+        std::future<MicroBatcher::Outcome> pending = batcher_->submit(audio, language);
+        while (pending.wait_for(MICROBATCH_CANCEL_POLL) != std::future_status::ready) {
+            if (stream.cancellation.cancelled()) {
+                stream.finish(cancelled_messages());
+                return true;
+            }
+        }
+        MicroBatcher::Outcome result = pending.get();
+        if (!result) {
+            return false;
+        }
+        if (stream.cancellation.cancelled()) {
+            stream.finish(cancelled_messages());
+            return true;
+        }
+        stream.push(result->data(), result->size());
+        stream.finish(closing_messages(true), true);
+        return true;
+    }
+    
+    // Sends the clip once, to the best endpoint
+    bool transcribe_single(ASRConnection* asr_conn, const std::vector<uint8_t>& audio,
+                           StreamContext& stream, const std::string& language) {
+        asr_upstream::Lease lease = upstream_.endpoints.acquire();
+        const auto started = std::chrono::steady_clock::now();
+        const bool success = asr_conn->transcribe_audio(
+            audio.data(), 
+            audio.size(), 
+            &stream,
+            stream.trace,
+            upstream_.endpoints.address(lease.index()),
+            language
+        );
+        if (!stream.cancellation.cancelled()) {
+            record_attempt(lease.index(), success,
+                           std::chrono::steady_clock::now() - started,
+                           audio.size() <= 44 + HEDGE_MAX_AUDIO_BYTES);
+        }
+        return success;
+    }
+    
+    // One upload of a hedged request
+    struct HedgeAttempt {
+        ASRConnection* conn = nullptr;
+        asr_upstream::Lease lease;
+        std::unique_ptr<asr_http::TranscriptionForm> form;
+        ResponseSink sink = {};
+        std::chrono::steady_clock::time_point started;
+        bool active = false;
+    };
+    
+    // Sends a short clip to the best endpoint and, if it has not answered by
+    // the p95 latency of recent short clips (or fails first), to the next
+    // best one as well. The first attempt to return data streams the
+    // results; the other is removed from the transfer at once, which closes
+    // its connection. The backup only uses an idle pooled connection.
+    bool transcribe_hedged(ASRConnection* primary, const std::vector<uint8_t>& audio,
+                           StreamContext& stream, const std::string& language) {
+        CURLM* multi = curl_multi_init();
+        if (!multi) {
+            ASR_LOG_RATE_LIMITED(asr_log::Level::Warn, 1,
+                                 "curl_multi_init failed, sending the clip unhedged");
+            return transcribe_single(primary, audio, stream, language);
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(stream.mutex);
+            stream.streaming = true;
+        }
+        
+        int winner = -1;
+        HedgeAttempt attempts[2];
+        auto start_attempt = [&](int i, ASRConnection* conn, asr_upstream::Lease lease) {
+            HedgeAttempt& a = attempts[i];
+            a.conn = conn;
+            a.lease = std::move(lease);
+            a.form = std::make_unique<asr_http::TranscriptionForm>(
+                conn->handle(), audio.data(), audio.size(), true, language);
+            a.sink = {&stream, &winner, i, {}};
+            a.started = std::chrono::steady_clock::now();
+            a.active = true;
+            asr_capture::record(stream.capture_id, asr_capture::Kind::UpstreamOpen, nullptr, 0);
+            conn->start_attempt(multi, *a.form, a.sink,
+                                upstream_.endpoints.address(a.lease.index()));
+        };
+        auto end_attempt = [&](int i) {
+            HedgeAttempt& a = attempts[i];
+            a.conn->end_attempt(multi);
+            a.active = false;
+            if (a.conn != primary) {
+                pool_.release(a.conn);
+            }
+        };
+        
+        // With too few samples for a meaningful deadline, only fail over
+        std::chrono::steady_clock::duration hedge_delay =
+            upstream_.short_clips.percentile(HEDGE_PERCENTILE);
+        hedge_delay = hedge_delay == hedge_delay.zero()
+            ? std::chrono::seconds(HTTP_TIMEOUT_SEC)
+            : std::max<std::chrono::steady_clock::duration>(hedge_delay, MIN_HEDGE_DELAY);
+        
+        asr_trace::Span span("upstream_request", stream.trace);
+        uint64_t hedge_start_ns = 0;
+        stream.cancellation.attach(multi);
+        start_attempt(0, primary, upstream_.endpoints.acquire());
+        auto hedge_at = attempts[0].started + hedge_delay;
+        bool hedged = false;
+        bool success = false;
+        int running = 1;
+        CURLMcode mres = CURLM_OK;
+        while (mres == CURLM_OK && !stream.cancellation.cancelled()) {
+            mres = curl_multi_perform(multi, &running);
+            
+            int pending = 0;
+            bool primary_failed = false;
+            while (CURLMsg* m = curl_multi_info_read(multi, &pending)) {
+                if (m->msg != CURLMSG_DONE) continue;
+                const int i = attempts[0].active &&
+                              m->easy_handle == attempts[0].conn->handle() ? 0 : 1;
+                HedgeAttempt& a = attempts[i];
+                const CURLcode res = m->data.result;
+                const bool won = res == CURLE_OK && (winner < 0 || winner == i);
+                if (won) {
+                    winner = i;
+                    success = true;
+                } else if (winner < 0 || winner == i) {
+                    ASR_LOG_ERROR("CURL error: %s (code: %d)", curl_easy_strerror(res),
+                                  static_cast<int>(res));
+                    primary_failed = i == 0;
+                }
+                if (winner == i || winner < 0) {
+                    record_attempt(a.lease.index(), won,
+                                   std::chrono::steady_clock::now() - a.started, true);
+                }
+                if (winner == i) {
+                    asr_http::trace_phases(a.conn->handle(), *a.form, span.context(),
+                                           span.start_ns());
+                }
+                end_attempt(i);
+            }
+            
+            // The loser goes as soon as the winner has sent anything; its
+            // time so far is a lower bound on that endpoint's latency
+            for (int i = 0; i < 2; ++i) {
+                if (winner >= 0 && i != winner && attempts[i].active) {
+                    upstream_.endpoints.record(
+                        attempts[i].lease.index(),
+                        std::chrono::steady_clock::now() - attempts[i].started);
+                    end_attempt(i);
+                }
+            }
+            
+            if (!hedged && winner < 0 &&
+                (primary_failed || std::chrono::steady_clock::now() >= hedge_at)) {
+                hedged = true;
+                if (ASRConnection* backup = pool_.try_acquire()) {
+                    hedge_start_ns = asr_trace::now_ns(stream.trace);
+                    start_attempt(1, backup,
+                                  upstream_.endpoints.acquire(attempts[0].lease.index()));
+                    continue;
+                }
+            }
+            if (!attempts[0].active && !attempts[1].active) {
+                break;
+            }
+            
+            auto wait = POLL_TIMEOUT_MS;
+            if (!hedged) {
+                auto until_hedge = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    hedge_at - std::chrono::steady_clock::now()).count() + 1;
+                wait = static_cast<int>(
+                    std::max<long long>(0, std::min<long long>(wait, until_hedge)));
+            }
+            mres = curl_multi_poll(multi, nullptr, 0, wait, nullptr);
+        }
+        for (int i = 0; i < 2; ++i) {
+            if (attempts[i].active) {
+                end_attempt(i);
+            }
+        }
+        stream.cancellation.attach(nullptr);
+        curl_multi_cleanup(multi);
+        
+        if (hedge_start_ns) {
+            asr_trace::record("upstream_hedge", span.context(), hedge_start_ns,
+                              asr_trace::now_ns(stream.trace));
+        }
+        span.end();
+        {
+            std::lock_guard<std::mutex> lock(stream.mutex);
+            stream.streaming = false;
+        }
+        return success;
+    }
+    
+    // Feeds an upload's outcome into endpoint selection and, for short
+    // clips, the hedge deadline
+    void record_attempt(size_t endpoint, bool success,
+                        std::chrono::steady_clock::duration latency, bool short_clip) {
+        if (!success) {
+            upstream_.endpoints.record_failure(endpoint);
+            return;
+        }
+        upstream_.endpoints.record(endpoint, latency);
+        if (short_clip) {
+            upstream_.short_clips.add(latency);
+        }
+    }
+    
+    // Blocks until a pooled connection is free; the wait shows up as its own
+    // span since it is where a saturated pool spends a request's time.
+    ASRConnection* acquire_connection(StreamContext& stream) {
+        asr_trace::Span span("pool_wait", stream.trace);
+        return pool_.acquire_unless([&stream] { return stream.cancellation.cancelled(); });
+    }
+    
+    ASRConnectionPool& pool_;
+    Upstream& upstream_;
+    MicroBatcher* batcher_; // Null unless micro-batching is on
+    std::mutex mutex_;
+    std::condition_variable idle_;
+    size_t in_flight_;
+};
+
+// ============================================================================
+// MCP Protocol Handler
+// ============================================================================
+class MCPSession {
+public:
+    using Registry = asr_registry::SessionRegistry<MCPSession>;
+    
+private:
+    asr_ws::ClientChannel channel_;
+    Transcriber& transcriber_;
+    std::atomic<bool> active_;
+    std::thread worker_thread_;
+    Registry::Registration registration_;
+    uint32_t capture_id_; // asr_capture session, 0 when capture is off
+    std::shared_ptr<WakeFd> wake_; // Signalled by the requests with results
+    // Requests whose results are still to be sent; session thread only
+    std::vector<std::shared_ptr<StreamContext>> streams_;
+    std::vector<uint8_t> accumulated_audio_; // 16 kHz mono s16le
+    asr_audio::AudioNormalizer normalizer_;
+    std::string language_; // Of recordings from now on; guarded by audio_mutex_
+    // Tenant rules for results of requests from now on, null when there are
+    // none; session thread only
+    std::shared_ptr<asr_rules::TenantRules> rules_;
+    std::mutex audio_mutex_;
+    // Upload of the current recording while it is in progress and its
+    // results, held until finalize; guarded by audio_mutex_. Null when no
+    // connection was free as recording started.
+    std::shared_ptr<asr_http::ProgressiveBody> upload_;
+    std::shared_ptr<StreamContext> upload_stream_;
+    asr_trace::Context session_trace_;
+    asr_trace::Context trace_; // Current request; session thread only
+    std::string request_id_;   // Current request's "id"; session thread only
+    uint32_t requests_;
+    // Results are sent from here when journaling is on (see asr_journal.h);
+    // session thread only
+    std::shared_ptr<asr_journal::Journal> journal_;
+    size_t journal_cursor_;
+    uint64_t audio_ms_; // Session audio finalized so far
+    // Scratch for the message or results being handled; session thread only
+    asr_arena::MessageArena arena_;
+    // Audio ring of a local client (see asr_local.h); session thread only
+    std::unique_ptr<asr_local::Ring> ring_;
+    
+public:
+    MCPSession(int fd, Transcriber& transcriber, bool websocket) 
+        : channel_(fd, websocket), transcriber_(transcriber),
+          active_(true),
+          capture_id_(asr_capture::open_session()),
+          wake_(std::make_shared<WakeFd>()),
+          language_(asr_http::default_language()),
+          rules_(asr_rules::Library::instance().find("default")),
+          session_trace_(asr_trace::begin_session()), requests_(0),
+          journal_(asr_journal::Journal::create()), journal_cursor_(0), audio_ms_(0) {}
+    
+    // Requests still in flight are left to finish on their own (see
+    // Transcriber); they no longer refer to the session
+    ~MCPSession() {
+        active_ = false;
+        
+        if (worker_thread_.joinable()) {
+            worker_thread_.join();
+        }
+        
+        if (channel_.fd() >= 0) {
+            close(channel_.fd());
+        }
+    }
+    
+    // Tells the client this process is being replaced; it should reconnect
+    // once its pending transcriptions have completed.
+    void notify_draining() {
+        send_response("{\"type\":\"draining\"}");
+        channel_.flush();
+    }
+    
+    // `registration` is released when the client goes away, which hands the
+    // session to the registry's reaper.
+    void start(Registry::Registration registration) {
+        registration_ = registration;
+        worker_thread_ = std::thread(&MCPSession::handle_session, this);
+    }
+    
+private:
+    void handle_session() {
+        // WebSocket clients complete the upgrade before anything is sent
+        bool open = channel_.handshake();
+        if (open) {
+            send_response(asr_protocol::initialized_message(journal_ ? journal_->token() : ""));
+        }
+        
+        asr_ws::MessageBatch messages;
+        while (open && active_) {
+            // Wait for data from the client or results from the ASR backend,
+            // or for room to send a backlog. A local client's ring rings its
+            // doorbell only while the session sleeps.
+            short client_events = POLLIN | (channel_.pending() ? POLLOUT : 0);
+            int timeout = POLL_TIMEOUT_MS;
+            if (ring_ && !ring_->prepare_wait()) {
+                timeout = 0;
+            }
+            struct pollfd pfds[3] = {{channel_.fd(), client_events, 0},
+                                     {wake_->fd(), POLLIN, 0},
+                                     {ring_ ? ring_->doorbell() : -1, POLLIN, 0}};
+            int ret = poll(pfds, 3, timeout);
+            if (ring_) {
+                ring_->end_wait(ret > 0 && (pfds[2].revents & POLLIN));
+            }
+            
+            if (ret > 0 && (pfds[0].revents & POLLIN)) {
+                const uint64_t recv_start = asr_trace::now_ns(session_trace_);
+                messages.clear();
+                if (!channel_.receive(messages)) {
+                    break; // Connection closed or error
+                }
+                for (const asr_ws::Message& message : messages) {
+                    handle_message(message, recv_start);
+                }
+            }
+            drain_ring();
+            
+            if (ret > 0 && (pfds[1].revents & POLLIN)) {
+                uint64_t signals;
+                if (read(wake_->fd(), &signals, sizeof(signals)) < 0 && errno != EAGAIN) {
+                    break;
+                }
+            }
+            forward_results();
+            
+            // Everything queued this iteration goes out in one write
+            if (!channel_.flush()) {
+                ASR_LOG_WARN("Dropping client: %s", strerror(errno));
+                break;
+            }
+        }
+        
+        // Give back the audio buffer now. Without a journal to resume from
+        // no one will read the results either, so the requests in flight are
+        // cancelled and the reaper does not wait on them.
+        {
+            std::lock_guard<std::mutex> audio_lock(audio_mutex_);
+            std::vector<uint8_t>().swap(accumulated_audio_);
+            if (upload_) {
+                upload_->cancel();
+                upload_.reset();
+                upload_stream_.reset();
+            }
+        }
+        if (!journal_) {
+            cancel_requests(std::string());
+        }
+        asr_capture::close_session(capture_id_);
+        registration_.release();
+    }
+    
+    void handle_message(const asr_ws::Message& message, uint64_t recv_start) {
+        // Ring audio written before this message was sent belongs before it
+        drain_ring();
+        arena_.reset();
+        record_client_message(message);
+        
+        const std::string& msg = message.data;
+        const asr_protocol::Method method = message.binary
+            ? asr_protocol::Method::StreamAudio
+            : asr_protocol::parse_method(msg);
+        request_id_ = message.binary ? std::string() : asr_protocol::request_id(msg);
+        asr_trace::Span request_span(asr_protocol::method_name(method),
+                                     session_trace_.for_request(++requests_),
+                                     recv_start);
+        trace_ = request_span.context();
+        asr_trace::record("socket_recv", trace_, recv_start,
+                          asr_trace::now_ns(trace_));
+        
+        switch (method) {
+            case asr_protocol::Method::Transcribe:
+                handle_transcribe_request(msg);
+                break;
+            case asr_protocol::Method::StreamAudio:
+                if (message.binary) {
+                    handle_audio(reinterpret_cast<const uint8_t*>(msg.data()), msg.size());
+                } else {
+                    handle_audio_stream(msg);
+                }
+                break;
+            case asr_protocol::Method::ConfigureAudio:
+                handle_configure_audio(msg);
+                break;
+            case asr_protocol::Method::FinalizeTranscription:
+                handle_finalize_transcription();
+                break;
+            case asr_protocol::Method::Resume:
+                handle_resume(msg);
+                break;
+            case asr_protocol::Method::OpenRing:
+                handle_open_ring();
+                break;
+            case asr_protocol::Method::Cancel:
+                handle_cancel();
+                break;
+            case asr_protocol::Method::Unknown:
+                break;
+        }
+    }
+    
+    // Binary WebSocket and ring audio is recorded as the equivalent
+    // stream_audio message so that asr_replay can send it over TCP.
+    void record_client_message(const asr_ws::Message& message) {
+        if (!message.binary) {
+            asr_capture::record(capture_id_, asr_capture::Kind::ClientFrame, message.data);
+        } else {
+            record_client_audio(reinterpret_cast<const uint8_t*>(message.data.data()),
+                                message.data.size());
+        }
+    }
+    
+    void record_client_audio(const uint8_t* audio, size_t audio_len) {
+        if (!asr_capture::Capture::instance().enabled()) {
+            return;
+        }
+        asr_capture::record(capture_id_, asr_capture::Kind::ClientFrame,
+                            "{\"method\":\"stream_audio\",\"data\":\"" +
+                                asr_protocol::base64_encode(audio, audio_len) + "\"}\n");
+    }
+    
+    // Gives a client on the local socket a shared-memory ring to write its
+    // audio to; the ring and its doorbell go with the reply
+    void handle_open_ring() {
+        if (!asr_local::is_local(channel_.fd())) {
+            send_error("open_ring is only available on the local socket");
+            return;
+        }
+        std::unique_ptr<asr_local::Ring> ring = asr_local::Ring::create();
+        if (!ring) {
+            send_error(std::string("Cannot create audio ring: ") + strerror(errno));
+            return;
+        }
+        asr_arena::String opened(arena_.resource());
+        asr_protocol::append_tagged(opened, asr_local::ring_opened_message(), request_id_);
+        asr_capture::record(capture_id_, asr_capture::Kind::ServerFrame, opened.data(),
+                            opened.size());
+        const int fds[] = {ring->memfd(), ring->doorbell()};
+        if (!channel_.send_with_fds(opened, fds, 2)) {
+            send_error(std::string("Cannot pass audio ring: ") + strerror(errno));
+            return;
+        }
+        ring_ = std::move(ring);
+    }
+    
+    // Hands the audio written to the ring since the last call to
+    // handle_audio, in place. Unlike stream_audio messages and binary frames
+    // it is not acknowledged: the ring's read index tells the client what
+    // was taken.
+    void drain_ring() {
+        if (!ring_ || ring_->empty()) {
+            return;
+        }
+        arena_.reset();
+        request_id_.clear();
+        asr_trace::Span request_span("ring_audio", session_trace_.for_request(++requests_));
+        trace_ = request_span.context();
+        bool valid = ring_->drain([this](const uint8_t* audio, size_t audio_len) {
+            record_client_audio(audio, audio_len);
+            handle_audio(audio, audio_len, false);
+        });
+        if (!valid) {
+            ring_.reset();
+            send_error("Audio ring indices are corrupt, ring closed");
+        }
+    }
+    
+    void handle_transcribe_request(const std::string& msg) {
+        // Extract audio data from message (simplified)
+        // In production, parse JSON properly and extract base64 audio
+        // For now, assume audio is in the message body or will be streamed
+        
+        std::vector<uint8_t> audio_copy;
+        std::string language;
+        {
+            std::lock_guard<std::mutex> audio_lock(audio_mutex_);
+            
+            if (!apply_language(msg) || !apply_tenant(msg) ||
+                (asr_audio::has_format_fields(msg) && !apply_format(msg))) {
+                return;
+            }
+            
+            if (accumulated_audio_.empty()) {
+                // Session handshake: audio follows via stream_audio
+                reply("{\"type\":\"transcription_started\",\"format\":" +
+                      asr_audio::format_json(normalizer_.format()) + "}");
+                return;
+            }
+            
+            // Check size limit
+            if (accumulated_audio_.size() > MAX_AUDIO_SIZE) {
+                send_error("Audio data too large (max " + std::to_string(MAX_AUDIO_SIZE) + " bytes)");
+                return;
+            }
+            
+            // Copy audio data for thread safety
+            asr_trace::Span span("build_wav", trace_);
+            audio_copy = make_wav_upload();
+            language = language_;
+        }
+        
+        start_transcription(std::move(audio_copy), language, audio_ms_);
+    }
+    
+    void handle_configure_audio(const std::string& msg) {
+        std::lock_guard<std::mutex> audio_lock(audio_mutex_);
+        if (!apply_language(msg) || !apply_tenant(msg) || !apply_format(msg)) {
+            return;
+        }
+        reply("{\"type\":\"audio_configured\",\"format\":" +
+              asr_audio::format_json(normalizer_.format()) + "}");
+    }
+    
+    // Negotiates the client's input format. Must hold audio_mutex_; audio
+    // already accumulated stays as it is (it was normalized on arrival).
+    bool apply_format(const std::string& msg) {
+        asr_audio::AudioFormat fmt = normalizer_.format();
+        if (!asr_audio::parse_format(msg, fmt) || !normalizer_.configure(fmt)) {
+            send_error("Unsupported audio format");
+            return false;
+        }
+        ASR_LOG_INFO("Client audio format: %u Hz, %u ch, %s", fmt.sample_rate,
+                     fmt.channels, asr_audio::encoding_name(fmt.encoding));
+        return true;
+    }
+    
+    // Takes the request's "language", if any, for recordings started from
+    // now on. Must hold audio_mutex_.
+    bool apply_language(const std::string& msg) {
+        if (!asr_protocol::parse_language(msg, language_)) {
+            send_error("Unsupported language");
+            return false;
+        }
+        return true;
+    }
+    
+    // Takes the request's "tenant", if any, whose rules then apply to the
+    // results of requests from now on
+    bool apply_tenant(const std::string& msg) {
+        std::string tenant;
+        if (!asr_protocol::parse_tenant(msg, tenant)) {
+            send_error("Invalid tenant");
+            return false;
+        }
+        if (tenant.empty()) {
+            return true;
+        }
+        std::shared_ptr<asr_rules::TenantRules> rules =
+            asr_rules::Library::instance().find(tenant);
+        if (!rules) {
+            send_error("Unknown tenant");
+            return false;
+        }
+        rules_ = std::move(rules);
+        return true;
+    }
+    
+    void handle_audio_stream(const std::string& msg) {
+        // Extract base64 data
+        size_t data_pos = msg.find("\"data\":\"");
+        if (data_pos == std::string::npos) {
+            send_error("Invalid audio data");
+            return;
+        }
+        size_t data_start = data_pos + 8;
+        size_t data_end = msg.find('"', data_start);
+        if (data_end == std::string::npos) {
+            send_error("Invalid audio data");
+            return;
+        }
+        
+        asr_trace::Span decode_span("base64_decode", trace_);
+        asr_arena::Bytes audio(arena_.resource());
+        asr_protocol::base64_decode(msg.data() + data_start, data_end - data_start, audio);
+        decode_span.end();
+        handle_audio(audio.data(), audio.size());
+    }
+    
+    // Audio in the client's format, from stream_audio, a binary frame or the
+    // ring
+    void handle_audio(const uint8_t* audio, size_t audio_len, bool acknowledge = true) {
+        if (audio_len == 0) {
+            send_error("Invalid audio data");
+            return;
+        }
+        
+        std::lock_guard<std::mutex> audio_lock(audio_mutex_);
+        
+        // Convert to 16 kHz mono s16le and accumulate
+        size_t previous_size = accumulated_audio_.size();
+        asr_trace::Span normalize_span("normalize", trace_);
+        normalizer_.process(audio, audio_len, accumulated_audio_);
+        normalize_span.end();
+        size_t total_size = accumulated_audio_.size();
+        
+        // Check size limit
+        if (total_size > MAX_AUDIO_SIZE) {
+            accumulated_audio_.resize(previous_size);
+            send_error("Audio data too large (max " + std::to_string(MAX_AUDIO_SIZE) + " bytes)");
+            return;
+        }
+        
+        // Forward the new audio to the upload in flight, opening one when
+        // this is the start of a recording. With micro-batching, recordings
+        // short enough to be batched never get one of their own.
+        const size_t open_at = transcriber_.batching() ? MICROBATCH_MAX_CLIP_BYTES : 0;
+        size_t unsent = previous_size;
+        if (previous_size <= open_at && total_size > open_at) {
+            start_progressive_upload();
+            unsent = 0;
+        }
+        if (upload_) {
+            upload_->append(accumulated_audio_.data() + unsent, total_size - unsent);
+        }
+        
+        // Send acknowledgment
+        if (acknowledge) {
+            asr_arena::String ack(arena_.resource());
+            asr_protocol::format_count(ack, asr_protocol::AUDIO_RECEIVED, total_size);
+            reply(ack);
+        }
+    }
+    
+    // Opens the upstream request as soon as audio starts so that finalize
+    // only has to send the tail. Must hold audio_mutex_. Only uses an idle
+    // connection: if the pool is busy the recording is uploaded in one go at
+    // finalize instead.
+    void start_progressive_upload() {
+        if (upload_) {
+            upload_->cancel();
+            upload_.reset();
+            upload_stream_.reset();
+        }
+        ASRConnection* asr_conn = transcriber_.pool().try_acquire();
+        if (!asr_conn) {
+            return;
+        }
+        
+        upload_ = std::make_shared<asr_http::ProgressiveBody>();
+        upload_stream_ = open_stream();
+        upload_stream_->held = true;
+        std::vector<uint8_t> header;
+        asr_audio::append_streaming_wav_header(header);
+        upload_->append(header.data(), header.size());
+        
+        transcriber_.start_progressive(asr_conn, upload_, upload_stream_, language_);
+    }
+    
+    void handle_finalize_transcription() {
+        std::vector<uint8_t> audio_copy;
+        std::string language;
+        uint64_t audio_start_ms;
+        {
+            std::lock_guard<std::mutex> audio_lock(audio_mutex_);
+            
+            if (accumulated_audio_.empty()) {
+                send_error("No audio data to transcribe");
+                return;
+            }
+            
+            // Check size limit
+            if (accumulated_audio_.size() > MAX_AUDIO_SIZE) {
+                send_error("Audio data too large (max " + std::to_string(MAX_AUDIO_SIZE) + " bytes)");
+                return;
+            }
+            
+            // Most of the recording is usually uploaded already
+            std::shared_ptr<asr_http::ProgressiveBody> upload = std::move(upload_);
+            std::shared_ptr<StreamContext> upload_stream = std::move(upload_stream_);
+            if (upload && upload->finish()) {
+                accept_audio(accumulated_audio_.size());
+                accumulated_audio_.clear();
+                normalizer_.reset();
+                upload_stream->release(request_id_, audio_ms_);
+                return;
+            }
+            
+            // Copy audio data for thread safety and clear
+            asr_trace::Span span("build_wav", trace_);
+            audio_copy = make_wav_upload();
+            audio_start_ms = audio_ms_;
+            accept_audio(accumulated_audio_.size());
+            accumulated_audio_.clear();
+            normalizer_.reset();
+            language = language_;
+        }
+        
+        start_transcription(std::move(audio_copy), language, audio_start_ms);
+    }
+    
+    // Cancels the request tagged with this message's "id", or with no id
+    // every request in flight and the recording in progress. Cancelled
+    // requests end with transcription_cancelled.
+    void handle_cancel() {
+        if (request_id_.empty()) {
+            std::lock_guard<std::mutex> audio_lock(audio_mutex_);
+            if (upload_) {
+                upload_->cancel();
+                upload_.reset();
+                upload_stream_.reset();
+            }
+            accumulated_audio_.clear();
+            normalizer_.reset();
+        }
+        const size_t cancelled = cancel_requests(request_id_);
+        reply("{\"type\":\"cancelled\",\"requests\":" + std::to_string(cancelled) + "}");
+    }
+    
+    // Cancels the incomplete requests tagged `id` (all of them if empty);
+    // returns how many there were
+    size_t cancel_requests(const std::string& id) {
+        size_t cancelled = 0;
+        for (const std::shared_ptr<StreamContext>& stream : streams_) {
+            std::lock_guard<std::mutex> lock(stream->mutex);
+            if (stream->complete || (!id.empty() && stream->id != id)) {
+                continue;
+            }
+            stream->cancellation.cancel();
+            ++cancelled;
+        }
+        // Requests still waiting for a connection give up too
+        transcriber_.pool().wake_all();
+        return cancelled;
+    }
+    
+    // Counts a finalized clip of `pcm_bytes` as the session's to transcribe
+    void accept_audio(size_t pcm_bytes) {
+        audio_ms_ += asr_audio::pcm_duration_ms(pcm_bytes);
+        if (journal_) {
+            journal_->accept_audio(audio_ms_);
+        }
+    }
+    
+    // Uploads a complete WAV in the background. The thread waits for a
+    // pooled connection itself so that further requests on this session are
+    // read meanwhile.
+    void start_transcription(std::vector<uint8_t> audio, const std::string& language,
+                             uint64_t audio_start_ms) {
+        std::shared_ptr<StreamContext> stream = open_stream();
+        stream->audio_start_ms = audio_start_ms;
+        stream->audio_end_ms = audio_start_ms + asr_audio::pcm_duration_ms(audio.size() - 44);
+        transcriber_.start(std::move(stream), std::move(audio), language);
+    }
+    
+    // Result stream for the current request, tagged with its id
+    std::shared_ptr<StreamContext> open_stream() {
+        auto stream = std::make_shared<StreamContext>(capture_id_, wake_);
+        stream->id = request_id_;
+        stream->trace = trace_;
+        stream->journal = journal_;
+        stream->rules = rules_;
+        stream->audio_start_ms = audio_ms_;
+        streams_.push_back(stream);
+        return stream;
+    }
+    
+    // Sends whatever the transcription threads have produced, in request
+    // order per stream, and forgets requests that have completed
+    void forward_results() {
+        arena_.reset();
+        for (auto it = streams_.begin(); it != streams_.end();) {
+            StreamContext& stream = **it;
+            std::queue<std::string> results;
+            std::vector<std::string> closing;
+            std::string id;
+            bool held;
+            bool complete = false;
+            {
+                std::lock_guard<std::mutex> lock(stream.mutex);
+                held = stream.held;
+                if (!held) {
+                    results.swap(stream.result_queue);
+                    complete = stream.complete;
+                    closing.swap(stream.closing);
+                    id = stream.id;
+                }
+            }
+            
+            if (!results.empty()) {
+                asr_trace::Span span("forward_result", stream.trace);
+                for (; !results.empty(); results.pop()) {
+                    forward_chunk(stream, id, results.front());
+                }
+            }
+            for (const std::string& message : closing) {
+                send_tagged(message, id);
+            }
+            it = complete ? streams_.erase(it) : it + 1;
+        }
+        
+        if (journal_) {
+            journal_->read(journal_cursor_, [&](const asr_journal::Record& record) {
+                send_record(record);
+            });
+        }
+    }
+    
+    void send_record(const asr_journal::Record& record) {
+        asr_arena::String message(arena_.resource());
+        asr_protocol::append_sequenced(message, record.payload, record.seq);
+        send_response(message);
+    }
+    
+    // Continues an earlier session after a reconnect: sends the journaled
+    // results after the client's last "seq" and tells it where to resume its
+    // audio. Only valid as the first request.
+    void handle_resume(const std::string& msg) {
+        std::string token;
+        uint32_t seen = 0;
+        asr_audio::find_json_string(msg, "session", token);
+        asr_audio::find_json_uint(msg, "seq", seen);
+        if (requests_ != 1) {
+            send_error("Resume must be the first request");
+            return;
+        }
+        std::shared_ptr<asr_journal::Journal> journal = asr_journal::Journal::open(token);
+        if (!journal) {
+            send_error("Unknown session");
+            return;
+        }
+        
+        journal_ = std::move(journal);
+        journal_cursor_ = 0;
+        uint64_t last = 0;
+        journal_->read(journal_cursor_, [&](const asr_journal::Record& record) {
+            if (record.seq > seen) {
+                send_record(record);
+            }
+            last = record.seq;
+        });
+        audio_ms_ = journal_->audio_ms();
+        reply(asr_protocol::resumed_message(journal_->token(), last, audio_ms_));
+    }
+    
+    // Upstream chunks go out as they are, unless the request has an id: then
+    // each result object in them is tagged with it
+    void forward_chunk(StreamContext& stream, const std::string& id, const std::string& chunk) {
+        if (id.empty()) {
+            send_response(chunk);
+            return;
+        }
+        stream.splitter.feed(chunk.data(), chunk.size(), [&](const std::string& object) {
+            send_tagged(object, id);
+        });
+    }
+    
+    // Wraps the accumulated PCM in a WAV container for upload. Must hold
+    // audio_mutex_.
+    std::vector<uint8_t> make_wav_upload() const {
+        std::vector<uint8_t> upload;
+        upload.reserve(44 + accumulated_audio_.size());
+        asr_audio::append_wav_header(upload, accumulated_audio_.size());
+        upload.insert(upload.end(), accumulated_audio_.begin(), accumulated_audio_.end());
+        return upload;
+    }
+    
+    void send_response(std::string_view response) {
+        if (channel_.fd() < 0) return;
+        
+        asr_capture::record(capture_id_, asr_capture::Kind::ServerFrame, response.data(),
+                            response.size());
+        if (!channel_.queue(response)) {
+            ASR_LOG_RATE_LIMITED(asr_log::Level::Warn, 5,
+                                 "Error sending response: %s", strerror(errno));
+        }
+    }
+    
+    // Answers the request being handled, tagged with its id
+    void reply(std::string_view response) {
+        send_tagged(response, request_id_);
+    }
+    
+    // Session thread only: the tagged copy lives in the arena
+    void send_tagged(std::string_view response, const std::string& id) {
+        if (id.empty()) {
+            send_response(response);
+            return;
+        }
+        asr_arena::String tagged(arena_.resource());
+        asr_protocol::append_tagged(tagged, response, id);
+        send_response(tagged);
+    }
+    
+    void send_error(const std::string& error) {
+        reply(error_message(error));
+    }
+    
+};
+
+// ============================================================================
+// Main MCP Server
+// ============================================================================
+class MCPServer {
 private:
     int server_fd_;
+    int ws_fd_; // WebSocket clients; -1 when disabled
+    asr_http::CurlShare curl_share_; // Declared before pool_ so it outlives the handles
     ASRConnectionPool pool_;
-    std::vector<std::unique_ptr<MCPSession>> sessions_;
+    Upstream upstream_;
+    std::unique_ptr<MicroBatcher> micro_batcher_; // Null unless ASR_MICROBATCH_MS is set
+    Transcriber transcriber_; // Outlives the sessions, whose requests it runs
+    MCPSession::Registry sessions_; // Declared after pool_; sessions use it
     std::atomic<bool> running_;
-    std::mutex sessions_mutex_;
+    asr_handoff::HandoffListener handoff_;
+    asr_local::Listener local_; // Clients on this host; not handed over
     
 public:
-    MCPServer(size_t pool_size)
-        : pool_(pool_size), running_(true) {
+    MCPServer(size_t pool_size, bool upgrade)
+        : server_fd_(-1), ws_fd_(-1), pool_(pool_size, curl_share_),
+          micro_batcher_(MicroBatcher::create(pool_, upstream_)),
+          transcriber_(pool_, upstream_, micro_batcher_.get()), running_(true) {
+        
+        const std::string handoff_path = asr_handoff::socket_path(MCP_PORT);
+        int handoff_channel = -1;
+        
+        if (upgrade) {
+            int inherited[asr_handoff::MAX_LISTENERS] = {-1, -1};
+            if (asr_handoff::acquire_listeners(handoff_path, inherited,
+                                               asr_handoff::MAX_LISTENERS,
+                                               handoff_channel) > 0) {
+                server_fd_ = inherited[0];
+                ws_fd_ = inherited[1];
+                ASR_LOG_INFO("Inherited listening socket from running instance");
+            } else {
+                ASR_LOG_WARN("No running instance at %s, binding port %d",
+                             handoff_path.c_str(), MCP_PORT);
+            }
+        }
         
-        server_fd_ = socket(AF_INET, SOCK_STREAM, 0);
         if (server_fd_ < 0) {
-            throw std::runtime_error("Failed to create socket");
+            server_fd_ = asr_handoff::bind_listener(MCP_PORT, MAX_CONNECTIONS);
+            if (server_fd_ < 0) {
+                throw std::runtime_error("Failed to bind");
+            }
         }
         
-        int opt = 1;
-        setsockopt(server_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        const int ws_port = asr_ws::listen_port();
+        if (ws_port <= 0 && ws_fd_ >= 0) {
+            close(ws_fd_);
+            ws_fd_ = -1;
+        } else if (ws_port > 0 && ws_fd_ < 0) {
+            ws_fd_ = asr_handoff::bind_listener(ws_port, MAX_CONNECTIONS);
+            if (ws_fd_ < 0) {
+                ASR_LOG_WARN("WebSocket port %d unavailable: %s", ws_port, strerror(errno));
+            }
+        }
         
-        struct sockaddr_in addr;
-        addr.sin_family = AF_INET;
-        addr.sin_addr.s_addr = INADDR_ANY;
-        addr.sin_port = htons(MCP_PORT);
+        // Shared with the predecessor during handoff, so accept must not
+        // block when the other process wins a connection
+        for (int fd : {server_fd_, ws_fd_}) {
+            if (fd >= 0) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            }
+        }
         
-        if (bind(server_fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-            throw std::runtime_error("Failed to bind");
+        if (!handoff_.open(handoff_path)) {
+            ASR_LOG_WARN("Handoff socket %s unavailable, --upgrade disabled",
+                         handoff_path.c_str());
         }
         
-        if (listen(server_fd_, MAX_CONNECTIONS) < 0) {
-            throw std::runtime_error("Failed to listen");
+        // Bound before the predecessor is released: it unlinks the path on
+        // exit unless a successor has replaced it
+        const std::string local_path = asr_local::socket_path(MCP_PORT);
+        if (!local_path.empty() && !local_.open(local_path)) {
+            ASR_LOG_WARN("Local socket %s unavailable: %s", local_path.c_str(),
+                         strerror(errno));
         }
+        asr_handoff::acknowledge(handoff_channel);
         
         std::cout << "MCP Server listening on port " << MCP_PORT << std::endl;
-        std::cout << "ASR API: " << ASR_API_URL << std::endl;
+        if (ws_fd_ >= 0) {
+            std::cout << "WebSocket clients on port " << ws_port << std::endl;
+        }
+        if (local_.fd() >= 0) {
+            std::cout << "Local clients on " << local_path << std::endl;
+        }
+        for (size_t i = 0; i < upstream_.endpoints.size(); ++i) {
+            std::cout << "ASR API: " << upstream_.endpoints.address(i) << std::endl;
+        }
+        if (micro_batcher_) {
+            std::cout << "Micro-batching short clips within "
+                      << micro_batcher_->window().count() << " ms" << std::endl;
+        }
     }
     
     ~MCPServer() {
         running_ = false;
-        close(server_fd_);
+        close_listeners();
     }
     
     void run() {
-        // Cleanup thread for finished sessions
-        std::thread cleanup_thread([this]() {
-            while (running_) {
-                std::this_thread::sleep_for(std::chrono::seconds(5));
-                cleanup_finished_sessions();
-            }
-        });
-        
         while (running_) {
-            struct sockaddr_in client_addr;
-            socklen_t client_len = sizeof(client_addr);
+            // poll() skips negative descriptors, so disabled entries are inert
+            struct pollfd pfds[4] = {{server_fd_, POLLIN, 0},
+                                     {ws_fd_, POLLIN, 0},
+                                     {handoff_.fd(), POLLIN, 0},
+                                     {local_.fd(), POLLIN, 0}};
+            if (poll(pfds, 4, POLL_TIMEOUT_MS) <= 0) {
+                continue;
+            }
             
-            int client_fd = accept(server_fd_, (struct sockaddr*)&client_addr, &client_len);
-            if (client_fd < 0) {
-                if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                    std::cerr << "Accept error: " << strerror(errno) << std::endl;
+            // A successor is taking over the listening sockets
+            if (pfds[2].revents & POLLIN) {
+                const int listeners[] = {server_fd_, ws_fd_};
+                if (handoff_.serve(listeners, ws_fd_ >= 0 ? 2 : 1)) {
+                    break;
                 }
                 continue;
             }
             
-            // Set TCP_NODELAY for client connection
+            if (pfds[0].revents & POLLIN) {
+                accept_client(server_fd_, false);
+            }
+            if (pfds[1].revents & POLLIN) {
+                accept_client(ws_fd_, true);
+            }
+            if (pfds[3].revents & POLLIN) {
+                accept_client(local_.fd(), false);
+            }
+        }
+        
+        if (running_) {
+            drain();
+        }
+        
+        running_ = false;
+        sessions_.shutdown();
+    }
+    
+private:    
+    void accept_client(int listen_fd, bool websocket) {
+        struct sockaddr_storage client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        
+        int client_fd = accept(listen_fd, (struct sockaddr*)&client_addr, &client_len);
+        if (client_fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ASR_LOG_RATE_LIMITED(asr_log::Level::Error, 5,
+                                     "Accept error: %s", strerror(errno));
+            }
+            return;
+        }
+        
+        // The WebSocket handshake uses blocking sends; some platforms
+        // inherit O_NONBLOCK
+        fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL) & ~O_NONBLOCK);
+        
+        const bool local = client_addr.ss_family == AF_UNIX;
+        
+        // Set TCP_NODELAY for client connection
+        if (!local) {
             int flag = 1;
             setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
-            
-            std::cout << "New connection from " 
-                     << inet_ntoa(client_addr.sin_addr) << std::endl;
-            
-            auto session = std::make_unique<MCPSession>(client_fd, pool_);
-            session->start();
-            
-            {
-                std::lock_guard<std::mutex> lock(sessions_mutex_);
-                sessions_.push_back(std::move(session));
+        }
+        
+        auto registration = sessions_.add(
+            std::make_unique<MCPSession>(client_fd, transcriber_, websocket));
+        registration.session()->start(registration);
+        
+        char ip[INET_ADDRSTRLEN] = "this host";
+        if (!local) {
+            inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in&>(client_addr).sin_addr, ip,
+                      sizeof(ip));
+        }
+        ASR_LOG_INFO("New %s connection from %s (%zu live, %zu reaping)",
+                     websocket ? "WebSocket" : local ? "local" : "TCP", ip,
+                     sessions_.live(), sessions_.reaping());
+    }
+    
+    void close_listeners() {
+        for (int* fd : {&server_fd_, &ws_fd_}) {
+            if (*fd >= 0) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+        local_.close_fd();
+    }
+    
+    // The successor owns the listening sockets now. Existing sessions keep
+    // running (clients are told to migrate when convenient) until they
+    // finish or DRAIN_TIMEOUT_SEC passes.
+    void drain() {
+        close_listeners();
+        handoff_.close_fd();
+        
+        size_t remaining = sessions_.live();
+        sessions_.for_each([](MCPSession& session) { session.notify_draining(); });
+        ASR_LOG_INFO("Listener handed to successor, draining %zu sessions", remaining);
+        
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(DRAIN_TIMEOUT_SEC);
+        while (true) {
+            remaining = sessions_.live();
+            if (remaining == 0) {
+                ASR_LOG_INFO("All sessions drained, exiting");
+                break;
+            }
+            if (std::chrono::steady_clock::now() >= deadline) {
+                ASR_LOG_WARN("Drain timeout, closing %zu sessions", remaining);
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(DRAIN_POLL_MS));
+        }
+    }
+};
+
+// ============================================================================
+// Offline Bulk Transcription (--bulk, see asr_bulk.h)
+// ============================================================================
+// Transcribes a directory or manifest of WAV files through the same pool,
+// endpoints, conversion and "default" tenant rules as client sessions. Every
+// pooled connection takes files in turn; records are written in input order,
+// at most BULK_WINDOW_PER_CONNECTION files per connection ahead of the next
+// one due.
+constexpr size_t BULK_WINDOW_PER_CONNECTION = 4;
+
+class BulkTranscriber {
+private:
+    // One input file. Set up before the workers start; the outcome is filled
+    // in by a worker under mutex_.
+    struct Job {
+        std::string path;
+        std::string srt_name; // See asr_bulk::srt_names
+        bool done = false;
+        bool success = false;
+        uint64_t audio_ms = 0;
+        std::vector<std::string> results;
+        std::string error;
+    };
+    
+    asr_http::CurlShare curl_share_; // Declared before pool_ so it outlives the handles
+    ASRConnectionPool pool_;
+    Upstream upstream_;
+    std::shared_ptr<asr_rules::TenantRules> rules_;
+    std::string language_;
+    std::vector<Job> jobs_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t next_started_ = 0;
+    size_t next_written_ = 0;
+    size_t window_ = 0;
+    
+public:
+    explicit BulkTranscriber(size_t pool_size)
+        : pool_(pool_size, curl_share_),
+          rules_(asr_rules::Library::instance().find("default")),
+          language_(asr_http::default_language()) {}
+    
+    // Transcribes what `source` lists into `output` (and `srt_dir`, unless
+    // empty), skipping the files `output` already records. Returns the exit
+    // status: 0 once every file is recorded.
+    int run(const std::string& source, const std::string& output, const std::string& srt_dir) {
+        std::vector<std::string> inputs;
+        std::string error;
+        if (!asr_bulk::list_inputs(source, inputs, error)) {
+            std::cerr << "Cannot read " << source << ": " << error << std::endl;
+            return 1;
+        }
+        std::vector<std::string> srt_names;
+        if (!srt_dir.empty() && !asr_bulk::srt_names(inputs, srt_names, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        std::unordered_set<std::string> done;
+        if (!asr_bulk::load_checkpoint(output, done)) {
+            std::cerr << "Cannot resume from " << output << ": " << strerror(errno) << std::endl;
+            return 1;
+        }
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            if (!done.count(inputs[i])) {
+                jobs_.emplace_back();
+                jobs_.back().path = inputs[i];
+                if (!srt_dir.empty()) {
+                    jobs_.back().srt_name = srt_names[i];
+                }
             }
         }
+        std::cout << "Bulk transcription: " << inputs.size() << " file(s), "
+                  << inputs.size() - jobs_.size() << " already in " << output << std::endl;
+        
+        int out_fd = open(output.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (out_fd < 0) {
+            std::cerr << "Cannot open " << output << ": " << strerror(errno) << std::endl;
+            return 1;
+        }
+        std::error_code ec;
+        if (!srt_dir.empty() && !std::filesystem::create_directories(srt_dir, ec) && ec) {
+            std::cerr << "Cannot create " << srt_dir << ": " << ec.message() << std::endl;
+            close(out_fd);
+            return 1;
+        }
+        
+        const size_t workers = std::min(pool_.size(), jobs_.size());
+        window_ = workers * BULK_WINDOW_PER_CONNECTION;
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < workers; ++i) {
+            threads.emplace_back([this] { work(); });
+        }
         
-        if (cleanup_thread.joinable()) {
-            cleanup_thread.join();
+        size_t failed = 0;
+        for (size_t i = 0; i < jobs_.size(); ++i) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [&] { return jobs_[i].done; });
+                job = std::move(jobs_[i]);
+            }
+            if (job.success) {
+                error = write_outputs(job, out_fd, srt_dir);
+                job.success = error.empty();
+                job.error = error;
+            }
+            if (job.success) {
+                std::cout << "[" << i + 1 << "/" << jobs_.size() << "] " << job.path << ": "
+                          << job.results.size() << " result(s), " << job.audio_ms << " ms"
+                          << std::endl;
+            } else {
+                ++failed;
+                std::cerr << "[" << i + 1 << "/" << jobs_.size() << "] " << job.path << ": "
+                          << job.error << std::endl;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                ++next_written_;
+            }
+            cv_.notify_all();
+        }
+        for (std::thread& t : threads) {
+            t.join();
         }
+        close(out_fd);
+        
+        std::cout << "Bulk transcription done: " << jobs_.size() - failed << " transcribed, "
+                  << failed << " failed" << (failed ? " (rerun to retry)" : "") << std::endl;
+        return failed ? 1 : 0;
     }
     
 private:
-    void cleanup_finished_sessions() {
-        std::lock_guard<std::mutex> lock(sessions_mutex_);
-        auto it = std::remove_if(sessions_.begin(), sessions_.end(),
-            [](const std::unique_ptr<MCPSession>& session) {
-                return session && session->is_finished();
+    // Worker thread: transcribes files in input order, staying within the
+    // window ahead of the writer
+    void work() {
+        while (true) {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [&] {
+                    return next_started_ >= jobs_.size() ||
+                           next_started_ < next_written_ + window_;
+                });
+                if (next_started_ >= jobs_.size()) return;
+                index = next_started_++;
+            }
+            Job outcome;
+            transcribe(jobs_[index].path, outcome);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                Job& job = jobs_[index];
+                job.done = true;
+                job.success = outcome.success;
+                job.audio_ms = outcome.audio_ms;
+                job.results = std::move(outcome.results);
+                job.error = std::move(outcome.error);
+            }
+            cv_.notify_all();
+        }
+    }
+    
+    // Uploads the file straight from its mapping; no copy, no base64
+    void transcribe(const std::string& path, Job& job) {
+        asr_bulk::MappedFile file;
+        if (!file.open(path)) {
+            job.error = strerror(errno);
+            return;
+        }
+        if (!asr_bulk::wav_duration_ms(file.data(), file.size(), job.audio_ms)) {
+            job.error = "Not a WAV file";
+            return;
+        }
+        if (file.size() > MAX_AUDIO_SIZE) {
+            job.error = "Audio too large";
+            return;
+        }
+        
+        StreamContext stream(0, nullptr);
+        stream.rules = rules_;
+        ASRConnection* asr_conn = pool_.acquire();
+        if (!asr_conn) {
+            job.error = "No ASR connection available";
+            return;
+        }
+        asr_upstream::Lease lease = upstream_.endpoints.acquire();
+        const auto started = std::chrono::steady_clock::now();
+        const bool success = asr_conn->transcribe_audio(file.data(), file.size(), &stream,
+                                                        stream.trace,
+                                                        upstream_.endpoints.address(lease.index()),
+                                                        language_);
+        pool_.release(asr_conn);
+        if (!success) {
+            upstream_.endpoints.record_failure(lease.index());
+            job.error = "Transcription request failed";
+            return;
+        }
+        upstream_.endpoints.record(lease.index(), std::chrono::steady_clock::now() - started);
+        
+        for (; !stream.result_queue.empty(); stream.result_queue.pop()) {
+            const std::string& chunk = stream.result_queue.front();
+            stream.splitter.feed(chunk.data(), chunk.size(), [&](const std::string& object) {
+                job.results.push_back(object);
             });
-        sessions_.erase(it, sessions_.end());
+        }
+        job.success = true;
+    }
+    
+    // Writes the SRT, then the record that marks the file done. Returns an
+    // error message, empty on success.
+    std::string write_outputs(const Job& job, int out_fd, const std::string& srt_dir) {
+        if (!srt_dir.empty()) {
+            const std::filesystem::path srt = std::filesystem::path(srt_dir) / job.srt_name;
+            std::ofstream out(srt, std::ios::binary | std::ios::trunc);
+            out << asr_bulk::make_srt(job.results, job.audio_ms);
+            if (!out.flush()) {
+                return "Cannot write " + srt.string();
+            }
+        }
+        std::string record;
+        asr_bulk::append_record(record, job.path, job.audio_ms, job.results);
+        // An interrupted run leaves at most a partial last line, which the
+        // next run cuts off
+        size_t written = 0;
+        while (written < record.size()) {
+            ssize_t n = write(out_fd, record.data() + written, record.size() - written);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                return std::string("Cannot write output: ") + strerror(errno);
+            }
+            written += static_cast<size_t>(n);
+        }
+        return "";
     }
 };
 
@@ -619,15 +2347,48 @@ int main(int argc, char* argv[]) {
         
         // Connection pool size (number of concurrent ASR requests)
         size_t pool_size = 10;
+        bool upgrade = false;
+        // Offline mode: --bulk <dir|manifest> --output <file.jsonl> [--srt <dir>]
+        std::string bulk_source, bulk_output, srt_dir;
         
-        if (argc >= 2) {
-            pool_size = std::stoul(argv[1]);
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--upgrade") {
+                upgrade = true;
+            } else if ((arg == "--bulk" || arg == "--output" || arg == "--srt") && i + 1 < argc) {
+                std::string& value = arg == "--bulk" ? bulk_source
+                                     : arg == "--output" ? bulk_output : srt_dir;
+                value = argv[++i];
+            } else {
+                pool_size = std::stoul(arg);
+            }
+        }
+        if (!bulk_source.empty() && bulk_output.empty()) {
+            throw std::invalid_argument("--bulk needs --output");
         }
         
-        std::cout << "Starting ASR MCP Server..." << std::endl;
+        if (bulk_source.empty()) {
+            std::cout << "Starting ASR MCP Server..." << std::endl;
+        }
         std::cout << "Connection pool size: " << pool_size << std::endl;
         
-        MCPServer server(pool_size);
+        // Conversion dictionaries are loaded before the first client arrives
+        const asr_convert::Converter& converter = asr_convert::Converter::instance();
+        if (converter.enabled()) {
+            std::cout << "Text conversion: " << converter.stages().size() << " stage(s)"
+                      << std::endl;
+        }
+        if (asr_rules::Library::instance().enabled()) {
+            std::cout << "Transcript rules: " << std::getenv("ASR_RULES_DIR") << std::endl;
+        }
+        
+        if (!bulk_source.empty()) {
+            int status = BulkTranscriber(pool_size).run(bulk_source, bulk_output, srt_dir);
+            curl_global_cleanup();
+            return status;
+        }
+        
+        MCPServer server(pool_size, upgrade);
         server.run();
         
         // Cleanup libcurl
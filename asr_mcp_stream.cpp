@@ -6,9 +6,12 @@
 #include <atomic>
 #include <cerrno>
 #include <chrono>
+#include <condition_variable>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <fcntl.h>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <mutex>
@@ -22,16 +25,34 @@
 #include <sys/socket.h>
 #include <thread>
 #include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
 #include <boost/asio/connect.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl/host_name_verification.hpp>
 #include <boost/asio/ssl/stream.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/ssl.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/beast/websocket/ssl.hpp>
 
+#include "asr_arena.h"
+#include "asr_audio.h"
+#include "asr_capture.h"
+#include "asr_convert.h"
+#include "asr_handoff.h"
+#include "asr_http.h"
+#include "asr_journal.h"
+#include "asr_local.h"
+#include "asr_log.h"
+#include "asr_protocol.h"
+#include "asr_rules.h"
+#include "asr_session_registry.h"
+#include "asr_trace.h"
+#include "asr_upstream.h"
+#include "asr_ws.h"
+
 namespace beast = boost::beast;
 namespace websocket = beast::websocket;
 namespace net = boost::asio;
@@ -43,20 +64,42 @@ using tcp = boost::asio::ip::tcp;
 // ============================================================================
 constexpr int MCP_PORT = 8080;
 constexpr int MAX_CONNECTIONS = 100;
-constexpr int BUFFER_SIZE = 16384;
 
 // ASR WebSocket API Configuration
 const std::string ASR_WS_HOST = "asr-ws.votee-demo.votee.dev";
 const std::string ASR_WS_PORT = "443";
 const std::string ASR_WS_PATH = "/v1/audio/transcriptions";
-const std::string ASR_LANGUAGE = "yue"; // Cantonese (default)
 
 constexpr int CONNECTION_TIMEOUT_MS = 10000;
 constexpr int POLL_TIMEOUT_MS = 100;
-
-// Base64 decoding table
-static const std::string BASE64_CHARS =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+constexpr int ACCEPT_POLL_MS = 1000;
+
+// Graceful upgrade: how long a predecessor waits for sessions to finish
+constexpr int DRAIN_TIMEOUT_SEC = 600;
+constexpr int DRAIN_POLL_MS = 200;
+
+// Upstream send pacing. PCM is coalesced into frames of MIN..MAX_FRAME_MS
+// (scaled with measured RTT) and released at real-time rate, with a burst
+// allowance so normal client chunks are not delayed.
+constexpr size_t PCM_BYTES_PER_MS = 32; // 16 kHz mono s16le
+constexpr int MIN_FRAME_MS = 40;
+constexpr int MAX_FRAME_MS = 100;
+constexpr int PACING_BURST_MS = 300;
+constexpr size_t MAX_COALESCED_BYTES = 16000; // Fits a single TLS record
+constexpr size_t MAX_SEND_BACKLOG = 10000 * PCM_BYTES_PER_MS; // 10 s
+constexpr int RTT_PING_INTERVAL_MS = 5000;
+// An upstream that has sent nothing, not even a pong, for this long is
+// dropped; the session's next audio reconnects
+constexpr int UPSTREAM_STALL_MS = 3 * RTT_PING_INTERVAL_MS;
+// How long stop() waits for the close handshake
+constexpr int UPSTREAM_CLOSE_TIMEOUT_MS = 2000;
+
+// Batch refinement of finalized utterances (ASR_REFINE=1)
+constexpr int REFINE_WORKERS = 2;
+constexpr size_t MAX_REFINE_QUEUE = 32;
+constexpr size_t MAX_REFINE_BYTES = 30000 * PCM_BYTES_PER_MS; // 30 s
+constexpr long REFINE_TIMEOUT_SEC = 60L;
+constexpr long REFINE_STALL_SEC = 15L; // With no bytes either way
 
 // Get API key from environment
 static std::string get_api_key() {
@@ -67,110 +110,505 @@ static std::string get_api_key() {
   return "votee_69e3377e77d40f345a792848";
 }
 
-// Get language from environment
-static std::string get_language() {
-  const char *env_lang = std::getenv("ASR_LANGUAGE");
-  if (env_lang && strlen(env_lang) > 0) {
-    return std::string(env_lang);
+// TLS verification of the upstream is on unless ASR_TLS_VERIFY=0 (for
+// development against hosts with self-signed certificates)
+static bool tls_verify_enabled() {
+  const char *env_verify = std::getenv("ASR_TLS_VERIFY");
+  return !(env_verify && strcmp(env_verify, "0") == 0);
+}
+
+// Upstream endpoint, overridable (e.g. to point at tools/asr_replay's mock)
+static std::string get_ws_host() {
+  const char *env_host = std::getenv("ASR_WS_HOST");
+  if (env_host && strlen(env_host) > 0) {
+    return std::string(env_host);
   }
-  return ASR_LANGUAGE;
+  return ASR_WS_HOST;
 }
 
-// Base64 decode
-static std::vector<uint8_t> base64_decode(const std::string &encoded) {
-  std::vector<uint8_t> decoded;
-  int val = 0, valb = -8;
-  for (char c : encoded) {
-    if (c == '=')
-      break;
-    size_t pos = BASE64_CHARS.find(c);
-    if (pos == std::string::npos)
-      continue;
-    val = (val << 6) + static_cast<int>(pos);
-    valb += 6;
-    if (valb >= 0) {
-      decoded.push_back(static_cast<uint8_t>((val >> valb) & 0xFF));
-      valb -= 8;
-    }
+static std::string get_ws_port() {
+  const char *env_port = std::getenv("ASR_WS_PORT");
+  if (env_port && strlen(env_port) > 0) {
+    return std::string(env_port);
+  }
+  return ASR_WS_PORT;
+}
+
+// Streaming replicas as host[:port] entries of ASR_WS_HOSTS; the single
+// ASR_WS_HOST/ASR_WS_PORT endpoint otherwise
+static asr_upstream::Endpoints &ws_endpoints() {
+  static asr_upstream::Endpoints endpoints(asr_upstream::env_list(
+      "ASR_WS_HOSTS", get_ws_host() + ":" + get_ws_port()));
+  return endpoints;
+}
+
+static void split_host_port(const std::string &address, std::string &host,
+                            std::string &port) {
+  size_t colon = address.rfind(':');
+  if (colon == std::string::npos ||
+      address.find(']', colon) != std::string::npos) {
+    host = address;
+    port = ASR_WS_PORT;
+    return;
   }
-  return decoded;
+  host = address.substr(0, colon);
+  port = address.substr(colon + 1);
+}
+
+// Hybrid mode: refine streamed finals with the batch endpoint
+static bool refine_enabled() {
+  const char *env_refine = std::getenv("ASR_REFINE");
+  return env_refine && strcmp(env_refine, "1") == 0;
 }
 
 // ============================================================================
 // Stream Context
 // ============================================================================
-struct StreamContext {
+struct StreamContext : std::enable_shared_from_this<StreamContext> {
   std::queue<std::string> result_queue;
   std::mutex mutex;
   std::atomic<bool> streaming{false};
   std::atomic<bool> connected{false};
   std::string last_message;
+  uint32_t capture_id = 0; // asr_capture session, 0 when capture is off
+  asr_trace::Context trace; // Session-level spans (upstream I/O threads)
+
+  // Audio of the utterance in progress, kept for the refinement pass
+  uint32_t utterance_id = 0;
+  std::vector<uint8_t> utterance_pcm; // 16 kHz mono s16le
+  bool utterance_overflow = false;
+
+  // Finals go to the journal when there is one (see asr_journal.h); the
+  // session sends them from there
+  std::shared_ptr<asr_journal::Journal> journal;
+  std::atomic<uint64_t> sent_pcm_bytes{0}; // Session audio sent upstream
+  // The tenant's rules for finals (see asr_rules.h), null when it has none.
+  // Guarded by mutex.
+  std::shared_ptr<asr_rules::TenantRules> rules;
+
+  // Queues a final result for the client, covering the session's audio up
+  // to `audio_ms`. Must hold mutex.
+  void deliver_locked(std::string message, uint64_t audio_ms) {
+    if (journal) {
+      journal->accept_audio(audio_ms);
+      if (journal->append(audio_ms, message))
+        return;
+    }
+    result_queue.push(std::move(message));
+  }
+};
+
+// ============================================================================
+// Shared TLS Context
+// ============================================================================
+// One client context for the whole process: the CA bundle is parsed once and
+// every upstream connection shares it. Sessions (including TLS 1.3 tickets,
+// which arrive after the handshake) are cached per SNI host so reconnects
+// take an abbreviated handshake.
+class TLSClientContext {
+public:
+  static TLSClientContext &instance() {
+    static TLSClientContext ctx;
+    return ctx;
+  }
+
+  ssl::context &context() { return ctx_; }
+
+  // Prepares a new stream for `host`: SNI, peer verification and the cached
+  // session, if any.
+  void prepare(beast::ssl_stream<tcp::socket> &stream, const std::string &host) {
+    SSL *ssl = stream.native_handle();
+    if (!SSL_set_tlsext_host_name(ssl, host.c_str())) {
+      throw beast::system_error(
+          beast::error_code(static_cast<int>(::ERR_get_error()),
+                            net::error::get_ssl_category()),
+          "Failed to set SNI");
+    }
+    if (verify_) {
+      stream.set_verify_callback(ssl::host_name_verification(host));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sessions_.find(host);
+    if (it != sessions_.end()) {
+      SSL_set_session(ssl, it->second);
+    }
+  }
+
+  static bool resumed(beast::ssl_stream<tcp::socket> &stream) {
+    return SSL_session_reused(stream.native_handle()) == 1;
+  }
+
+  ~TLSClientContext() {
+    for (auto &entry : sessions_) {
+      SSL_SESSION_free(entry.second);
+    }
+  }
+
+private:
+  TLSClientContext() : verify_(tls_verify_enabled()) {
+    SSL_CTX *native = ctx_.native_handle();
+    SSL_CTX_set_min_proto_version(native, TLS1_2_VERSION);
+    if (verify_) {
+      ctx_.set_default_verify_paths();
+      ctx_.set_verify_mode(ssl::verify_peer);
+    } else {
+      ctx_.set_verify_mode(ssl::verify_none);
+      ASR_LOG_WARN("Upstream TLS verification disabled (ASR_TLS_VERIFY=0)");
+    }
+    SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_CLIENT |
+                                               SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(native, &TLSClientContext::on_new_session);
+  }
+
+  TLSClientContext(const TLSClientContext &) = delete;
+  TLSClientContext &operator=(const TLSClientContext &) = delete;
+
+  // Keeps the newest session per host; returning 1 takes ownership.
+  static int on_new_session(SSL *ssl, SSL_SESSION *session) {
+    const char *host = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+    if (!host) {
+      return 0;
+    }
+    TLSClientContext &self = instance();
+    std::lock_guard<std::mutex> lock(self.mutex_);
+    SSL_SESSION *&slot = self.sessions_[host];
+    if (slot) {
+      SSL_SESSION_free(slot);
+    }
+    slot = session;
+    return 1;
+  }
+
+  ssl::context ctx_{ssl::context::tls_client};
+  bool verify_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, SSL_SESSION *> sessions_;
+};
+
+// ============================================================================
+// Batch Refinement
+// ============================================================================
+// Streamed finals arrive quickly but are less accurate than the batch
+// endpoint, which also applies VAD. In hybrid mode each finalized utterance
+// is re-transcribed over HTTP in the background and the client gets a
+// "refined" event that replaces the streamed text of that utterance. A
+// failed or dropped refinement just leaves the streamed text in place.
+class BatchRefiner {
+public:
+  static BatchRefiner &instance() {
+    static BatchRefiner refiner;
+    return refiner;
+  }
+
+  bool enabled() const { return enabled_; }
+
+  // Queues `pcm` (16 kHz mono s16le) of `utterance`. The oldest job is
+  // dropped if the queue is full.
+  void submit(std::weak_ptr<StreamContext> ctx, const asr_trace::Context &trace,
+              uint32_t utterance, uint64_t audio_ms, std::vector<uint8_t> pcm,
+              const std::string &language) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (jobs_.size() >= MAX_REFINE_QUEUE) {
+        jobs_.pop_front();
+        ASR_LOG_RATE_LIMITED(asr_log::Level::Warn, 1,
+                             "Refinement queue full, dropping oldest");
+      }
+      jobs_.push_back({std::move(ctx), trace, utterance, audio_ms,
+                       std::move(pcm), language});
+    }
+    cv_.notify_one();
+  }
+
+  ~BatchRefiner() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto &worker : workers_) {
+      if (worker.joinable())
+        worker.join();
+    }
+  }
+
+private:
+  struct Job {
+    std::weak_ptr<StreamContext> ctx;
+    asr_trace::Context trace;
+    uint32_t utterance;
+    uint64_t audio_ms; // Of the streamed final
+    std::vector<uint8_t> pcm;
+    std::string language;
+  };
+
+  BatchRefiner()
+      : enabled_(refine_enabled()), endpoints_(asr_http::api_urls()) {
+    if (!enabled_)
+      return;
+    for (int i = 0; i < REFINE_WORKERS; ++i) {
+      workers_.emplace_back(&BatchRefiner::worker_loop, this);
+    }
+    for (size_t i = 0; i < endpoints_.size(); ++i)
+      ASR_LOG_INFO("Batch refinement enabled: %s",
+                   endpoints_.address(i).c_str());
+  }
+
+  BatchRefiner(const BatchRefiner &) = delete;
+  BatchRefiner &operator=(const BatchRefiner &) = delete;
+
+  static size_t collect_body(void *contents, size_t size, size_t nmemb,
+                             void *userp) {
+    static_cast<std::string *>(userp)->append(static_cast<char *>(contents),
+                                              size * nmemb);
+    return size * nmemb;
+  }
+
+  // Aborts the refinement of a session that has ended
+  static int session_gone(void *job, curl_off_t, curl_off_t, curl_off_t,
+                          curl_off_t) {
+    return static_cast<Job *>(job)->ctx.expired() ? 1 : 0;
+  }
+
+  void worker_loop() {
+    CURL *curl = curl_easy_init();
+    if (!curl) {
+      ASR_LOG_ERROR("Refinement worker: curl_easy_init failed");
+      return;
+    }
+    curl_easy_setopt(curl, CURLOPT_SHARE, share_.handle());
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, share_.headers());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, collect_body);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, REFINE_TIMEOUT_SEC);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, REFINE_STALL_SEC);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, session_gone);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+      if (stopping_)
+        break;
+      Job job = std::move(jobs_.front());
+      jobs_.pop_front();
+      lock.unlock();
+      refine(curl, job);
+      lock.lock();
+    }
+    curl_easy_cleanup(curl);
+  }
+
+  void refine(CURL *curl, Job &job) {
+    if (job.ctx.expired())
+      return; // Session already gone
+
+    std::vector<uint8_t> wav;
+    wav.reserve(44 + job.pcm.size());
+    asr_audio::append_wav_header(wav, job.pcm.size());
+    wav.insert(wav.end(), job.pcm.begin(), job.pcm.end());
+    std::vector<uint8_t>().swap(job.pcm);
+
+    std::string body;
+    auto start = std::chrono::steady_clock::now();
+    asr_trace::Span span("batch_refine", job.trace);
+    asr_upstream::Lease lease = endpoints_.acquire();
+    asr_http::TranscriptionForm form(curl, wav.data(), wav.size(), false,
+                                     job.language);
+    curl_easy_setopt(curl, CURLOPT_URL,
+                     endpoints_.address(lease.index()).c_str());
+    curl_easy_setopt(curl, CURLOPT_MIMEPOST, form.get());
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &job);
+    const uint64_t request_start = asr_trace::now_ns(job.trace);
+    CURLcode res = curl_easy_perform(curl);
+    asr_http::trace_phases(curl, form, span.context(), request_start);
+    curl_easy_setopt(curl, CURLOPT_MIMEPOST, nullptr);
+    if (res == CURLE_ABORTED_BY_CALLBACK)
+      return; // The session ended meanwhile
+
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    if (res == CURLE_OK && status == 200)
+      endpoints_.record(lease.index(),
+                        std::chrono::steady_clock::now() - start);
+    else
+      endpoints_.record_failure(lease.index());
+    lease.reset();
+
+    std::string text;
+    if (res != CURLE_OK || status != 200 ||
+        !asr_http::response_text(body, text)) {
+      ASR_LOG_RATE_LIMITED(asr_log::Level::Warn, 1,
+                           "Refinement failed: %s (HTTP %ld)",
+                           curl_easy_strerror(res), status);
+      return;
+    }
+
+    auto ctx = job.ctx.lock();
+    if (!ctx)
+      return;
+    const asr_convert::Converter &converter =
+        asr_convert::Converter::instance();
+    if (converter.enabled()) {
+      std::string raw, scratch;
+      raw.swap(text);
+      converter.convert(raw, text, scratch);
+    }
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    if (ctx->rules) {
+      std::string ruled;
+      ctx->rules->current()->apply(text, ruled, false);
+      text.swap(ruled);
+    }
+    ASR_LOG_DEBUG(
+        "Refined utterance %u in %lld ms: \"%s\"", job.utterance,
+        static_cast<long long>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start)
+                .count()),
+        text.c_str());
+    ctx->deliver_locked("{\"type\":\"refined\",\"utterance\":" +
+                            std::to_string(job.utterance) + ",\"text\":\"" +
+                            asr_protocol::json_escape(text) + "\"}",
+                        job.audio_ms);
+  }
+
+  const bool enabled_;
+  asr_upstream::Endpoints endpoints_;
+  asr_http::CurlShare share_; // Outlives the workers' handles
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Job> jobs_;
+  bool stopping_ = false;
+  std::vector<std::thread> workers_;
 };
 
 // ============================================================================
 // Beast WebSocket ASR Connection
 // ============================================================================
+// Once connected, every operation on the stream runs on io_thread_: reads
+// (which may write pong and close replies themselves), paced writes and
+// pings. Beast streams and the TLS session under them are not thread-safe.
 class ASRConnection {
 private:
   net::io_context ioc_;
-  ssl::context ssl_ctx_{ssl::context::tlsv12_client};
   std::unique_ptr<websocket::stream<beast::ssl_stream<tcp::socket>>> ws_;
-  std::thread read_thread_;
+  std::thread io_thread_;
+  // Keeps io_thread_ running for writes after the reads have ended
+  std::unique_ptr<net::executor_work_guard<net::io_context::executor_type>>
+      io_work_;
   std::atomic<bool> active_{false};
   StreamContext *stream_ctx_{nullptr};
   std::mutex mutex_;
+  // io_thread_ only. Both keep their capacity from one message to the next.
   beast::flat_buffer read_buffer_;
+  std::string read_message_;
+  bool ping_pending_{false};
+
+  // Send queue drained by send_thread_ (see send_loop)
+  std::thread send_thread_;
+  std::mutex send_mutex_;
+  std::condition_variable send_cv_;
+  std::vector<uint8_t> send_queue_;
+  std::chrono::steady_clock::time_point oldest_pending_;
+  bool send_stopping_{false};
+  std::atomic<bool> send_failed_{false};
+  std::atomic<int64_t> rtt_us_{0}; // EWMA, 0 until the first pong
+  std::atomic<int64_t> last_heard_ms_{0}; // steady_ms() of the last read
+
+  asr_upstream::Lease endpoint_; // Held while connected
+  std::string language_;         // Of the current connection
+  // Converted final text and its scratch (see asr_convert.h), and the text
+  // after the tenant's rules; read thread
+  std::string converted_;
+  std::string convert_scratch_;
+  std::string ruled_;
 
 public:
-  ASRConnection() {
-    // Configure SSL
-    ssl_ctx_.set_default_verify_paths();
-    ssl_ctx_.set_verify_mode(ssl::verify_none); // For development
-  }
+  ASRConnection() = default;
 
   ~ASRConnection() { stop(); }
 
   bool is_valid() const { return true; }
 
-  bool connect(StreamContext *stream_ctx) {
-    std::lock_guard<std::mutex> lock(mutex_);
-
-    if (ws_ && stream_ctx_ && stream_ctx_->connected) {
+  // Connects to the best streaming endpoint, or failing that to the next
+  // best one.
+  bool connect(StreamContext *stream_ctx, const asr_trace::Context &trace,
+               const std::string &language) {
+    if (is_connected()) {
       return true;
     }
 
+    // Reap the workers of a previous, dropped connection
+    stop_sender(false);
+    active_ = false;
+    stop_io();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
     stream_ctx_ = stream_ctx;
+    language_ = language;
+    asr_upstream::Endpoints &endpoints = ws_endpoints();
+    size_t failed = asr_upstream::NO_ENDPOINT;
+    for (size_t tries = std::min<size_t>(2, endpoints.size()); tries > 0;
+         --tries) {
+      asr_upstream::Lease lease = endpoints.acquire(failed);
+      const auto start = std::chrono::steady_clock::now();
+      if (open(endpoints.address(lease.index()), trace)) {
+        endpoints.record(lease.index(),
+                         std::chrono::steady_clock::now() - start);
+        endpoint_ = std::move(lease);
+        return true;
+      }
+      endpoints.record_failure(lease.index());
+      failed = lease.index();
+    }
+    return false;
+  }
 
+  // Connects to `address` (host[:port]) and starts the reader and sender.
+  // Must hold mutex_.
+  bool open(const std::string &address, const asr_trace::Context &trace) {
     try {
       // Resolve the host
+      std::string host, port;
+      split_host_port(address, host, port);
       tcp::resolver resolver(ioc_);
-      auto const results = resolver.resolve(ASR_WS_HOST, ASR_WS_PORT);
+      asr_trace::Span dns_span("dns_resolve", trace);
+      auto const results = resolver.resolve(host, port);
+      dns_span.end();
 
-      // Create WebSocket stream
+      // Create WebSocket stream on the shared TLS context
+      TLSClientContext &tls = TLSClientContext::instance();
       ws_ = std::make_unique<websocket::stream<beast::ssl_stream<tcp::socket>>>(
-          ioc_, ssl_ctx_);
-
-      // Set SNI
-      if (!SSL_set_tlsext_host_name(ws_->next_layer().native_handle(),
-                                    ASR_WS_HOST.c_str())) {
-        throw beast::system_error(
-            beast::error_code(static_cast<int>(::ERR_get_error()),
-                              net::error::get_ssl_category()),
-            "Failed to set SNI");
-      }
+          ioc_, tls.context());
+
+      // SNI, verification and cached session for resumption
+      tls.prepare(ws_->next_layer(), host);
 
       // Connect to the server
+      asr_trace::Span tcp_span("tcp_connect", trace);
       net::connect(ws_->next_layer().next_layer(), results.begin(),
                    results.end());
+      tcp_span.end();
 
       // SSL handshake
+      asr_trace::Span tls_span("tls_handshake", trace);
       ws_->next_layer().handshake(ssl::stream_base::client);
+      tls_span.end();
+      ASR_LOG_DEBUG("TLS handshake %s",
+                    TLSClientContext::resumed(ws_->next_layer())
+                        ? "resumed"
+                        : "full");
 
       // Build the target path with query params
       std::string api_key = get_api_key();
-      std::string language = get_language();
       std::string target =
-          ASR_WS_PATH + "?language=" + language + "&api-key=" + api_key;
+          ASR_WS_PATH + "?language=" + language_ + "&api-key=" + api_key;
 
       // Set WebSocket options
       ws_->set_option(
@@ -180,50 +618,91 @@ public:
                     "https://asr-ws.votee-demo.votee.dev");
           }));
 
-      std::cout << "Connecting to WebSocket: wss://" << ASR_WS_HOST
-                << ASR_WS_PATH << std::endl;
-      std::cout << "Language: " << language
-                << ", API Key: " << api_key.substr(0, 10) << "..." << std::endl;
+      ASR_LOG_INFO("Connecting to WebSocket: wss://%s%s (language: %s, "
+                   "API Key: %.10s...)",
+                   host.c_str(), ASR_WS_PATH.c_str(), language_.c_str(),
+                   api_key.c_str());
+
+      // One unfragmented binary message per coalesced frame; the write
+      // buffer holds a whole masked frame so it leaves in one TLS record
+      ws_->binary(true);
+      ws_->auto_fragment(false);
+      ws_->write_buffer_bytes(MAX_COALESCED_BYTES + 64);
+      ws_->control_callback(
+          [this](websocket::frame_type kind, beast::string_view payload) {
+            if (kind == websocket::frame_type::pong)
+              on_pong(payload);
+          });
 
       // WebSocket handshake
-      ws_->handshake(ASR_WS_HOST, target);
+      asr_trace::Span ws_span("ws_handshake", trace);
+      ws_->handshake(host, target);
+      ws_span.end();
+      asr_capture::record(stream_ctx_->capture_id,
+                          asr_capture::Kind::UpstreamOpen, host);
 
       stream_ctx_->connected = true;
       stream_ctx_->streaming = true;
       active_ = true;
-
-      std::cout << "✓ WebSocket connected successfully!" << std::endl;
-
-      // Start async read thread
-      read_thread_ = std::thread(&ASRConnection::read_loop, this);
+      last_heard_ms_ = steady_ms();
+
+      ASR_LOG_INFO("✓ WebSocket connected successfully!");
+
+      // Start the I/O thread, reading, and the paced sender
+      ioc_.restart();
+      io_work_ = std::make_unique<
+          net::executor_work_guard<net::io_context::executor_type>>(
+          ioc_.get_executor());
+      ping_pending_ = false;
+      read_next();
+      io_thread_ = std::thread([this] { ioc_.run(); });
+      {
+        std::lock_guard<std::mutex> send_lock(send_mutex_);
+        send_queue_.clear();
+        send_stopping_ = false;
+      }
+      send_failed_ = false;
+      send_thread_ = std::thread(&ASRConnection::send_loop, this);
 
       return true;
 
     } catch (const std::exception &e) {
-      std::cerr << "✗ WebSocket connection failed: " << e.what() << std::endl;
+      ASR_LOG_ERROR("✗ WebSocket connection failed: %s", e.what());
       stream_ctx_->connected = false;
       stream_ctx_->streaming = false;
       return false;
     }
   }
 
-  void read_loop() {
-    while (active_ && stream_ctx_ && stream_ctx_->connected) {
-      try {
-        beast::flat_buffer buffer;
-        ws_->read(buffer);
+  // Reads the next message on io_thread_, until the connection ends
+  void read_next() {
+    read_buffer_.clear();
+    ws_->async_read(read_buffer_,
+                    [this](beast::error_code ec, size_t) { on_read(ec); });
+  }
 
-        std::string message = beast::buffers_to_string(buffer.data());
+  void on_read(beast::error_code ec) {
+    if (!ec) {
+      last_heard_ms_ = steady_ms();
 
-        // Parse and handle the message
-        handle_message(message);
+      read_message_.assign(
+          static_cast<const char *>(read_buffer_.data().data()),
+          read_buffer_.size());
+      asr_capture::record(stream_ctx_->capture_id,
+                          asr_capture::Kind::UpstreamMessage, read_message_);
 
-      } catch (const beast::system_error &e) {
-        if (e.code() != websocket::error::closed) {
-          std::cerr << "WebSocket read error: " << e.what() << std::endl;
-        }
-        break;
+      // Parse and handle the message
+      {
+        asr_trace::Span span("upstream_message", stream_ctx_->trace);
+        handle_message(read_message_);
       }
+      if (active_ && stream_ctx_ && stream_ctx_->connected) {
+        read_next();
+        return;
+      }
+    } else if (ec != websocket::error::closed && active_) {
+      // Not when abort() shut the socket down under the read
+      ASR_LOG_WARN("WebSocket read error: %s", ec.message().c_str());
     }
 
     if (stream_ctx_) {
@@ -260,46 +739,70 @@ public:
           if (value_start != std::string::npos) {
             size_t value_end = message.find("\"", value_start + 1);
             if (value_end != std::string::npos) {
-              std::string text =
-                  message.substr(value_start + 1, value_end - value_start - 1);
+              const char *text_start = message.data() + value_start + 1;
+              const size_t text_len = value_end - value_start - 1;
 
               if (!is_final) {
-                std::cout << "[Partial] " << text.substr(0, 50) << "..."
-                          << std::endl;
+                const int shown =
+                    static_cast<int>(std::min<size_t>(text_len, 50));
+                ASR_LOG_RATE_LIMITED(asr_log::Level::Debug, 20,
+                                     "[Partial] %.*s...", shown, text_start);
                 return;
               }
-
-              // Remove duplicate prefix
-              std::string non_duplicate = text;
-              std::lock_guard<std::mutex> lock(stream_ctx_->mutex);
-              if (!stream_ctx_->last_message.empty() &&
-                  text.length() >= stream_ctx_->last_message.length() &&
-                  text.substr(0, stream_ctx_->last_message.length()) ==
-                      stream_ctx_->last_message) {
-                non_duplicate = text.substr(stream_ctx_->last_message.length());
-              }
-
-              if (!non_duplicate.empty()) {
-                std::string escaped;
-                for (char c : non_duplicate) {
-                  if (c == '"')
-                    escaped += "\\\"";
-                  else if (c == '\\')
-                    escaped += "\\\\";
-                  else if (c == '\n')
-                    escaped += "\\n";
-                  else
-                    escaped += c;
+              std::string text(text_start, text_len);
+
+              // Remove duplicate prefix. Finals come at a pause, so the
+              // audio sent up to now is what this one covers.
+              uint32_t utterance = 0;
+              const uint64_t audio_ms = asr_audio::pcm_duration_ms(
+                  stream_ctx_->sent_pcm_bytes.load());
+              std::vector<uint8_t> span;
+              bool refine = false;
+              {
+                std::lock_guard<std::mutex> lock(stream_ctx_->mutex);
+                std::string non_duplicate =
+                    asr_protocol::strip_duplicate_prefix(
+                        stream_ctx_->last_message, text);
+
+                if (!non_duplicate.empty()) {
+                  // The audio retained so far is this utterance's span
+                  utterance = ++stream_ctx_->utterance_id;
+                  span.swap(stream_ctx_->utterance_pcm);
+                  refine = !stream_ctx_->utterance_overflow && !span.empty();
+                  stream_ctx_->utterance_overflow = false;
+
+                  const asr_convert::Converter &converter =
+                      asr_convert::Converter::instance();
+                  const std::string *final_text = &non_duplicate;
+                  if (converter.enabled()) {
+                    converter.convert(non_duplicate, converted_,
+                                      convert_scratch_);
+                    final_text = &converted_;
+                  }
+                  if (stream_ctx_->rules) {
+                    ruled_.clear();
+                    stream_ctx_->rules->current()->apply(*final_text, ruled_,
+                                                         false);
+                    final_text = &ruled_;
+                  }
+                  stream_ctx_->deliver_locked(
+                      "{\"type\":\"transcription\",\"utterance\":" +
+                          std::to_string(utterance) + ",\"text\":\"" +
+                          asr_protocol::json_escape(*final_text) + "\"}",
+                      audio_ms);
+                  ASR_LOG_INFO("✓✓✓ FINAL: \"%s\" ✓✓✓",
+                               final_text->c_str());
                 }
 
-                stream_ctx_->result_queue.push(
-                    "{\"type\":\"transcription\",\"text\":\"" + escaped +
-                    "\"}");
-                std::cout << "✓✓✓ FINAL: \"" << non_duplicate << "\" ✓✓✓"
-                          << std::endl;
+                stream_ctx_->last_message = text;
               }
 
-              stream_ctx_->last_message = text;
+              if (refine) {
+                BatchRefiner::instance().submit(stream_ctx_->weak_from_this(),
+                                                stream_ctx_->trace, utterance,
+                                                audio_ms, std::move(span),
+                                                language_);
+              }
             }
           }
         }
@@ -307,44 +810,272 @@ public:
     }
   }
 
+  // Queues 16 kHz mono PCM for the paced sender. Returns false if the
+  // connection is down or the backlog is full.
   bool send_audio_chunk(const uint8_t *data, size_t len) {
-    if (!ws_ || !stream_ctx_ || !stream_ctx_->connected) {
+    if (!ws_ || !stream_ctx_ || !stream_ctx_->connected || send_failed_) {
       return false;
     }
 
-    try {
-      std::lock_guard<std::mutex> lock(mutex_);
-      ws_->binary(true);
-      ws_->write(net::buffer(data, len));
-      return true;
-    } catch (const std::exception &e) {
-      std::cerr << "Send error: " << e.what() << std::endl;
-      return false;
+    {
+      std::lock_guard<std::mutex> lock(send_mutex_);
+      if (send_stopping_ || send_queue_.size() + len > MAX_SEND_BACKLOG) {
+        return false;
+      }
+      if (send_queue_.empty()) {
+        oldest_pending_ = std::chrono::steady_clock::now();
+      }
+      send_queue_.insert(send_queue_.end(), data, data + len);
     }
+    send_cv_.notify_one();
+    return true;
   }
 
   void stop() {
+    // An upstream that does not finish the close handshake in time is cut
+    // off like in abort()
+    std::mutex watchdog_mutex;
+    std::condition_variable watchdog_cv;
+    bool stopped = false;
+    std::thread watchdog;
+    if (ws_ && is_connected()) {
+      watchdog = std::thread([&] {
+        std::unique_lock<std::mutex> lock(watchdog_mutex);
+        if (!watchdog_cv.wait_for(
+                lock, std::chrono::milliseconds(UPSTREAM_CLOSE_TIMEOUT_MS),
+                [&] { return stopped; }))
+          shutdown_transport();
+      });
+    }
+
+    // Flush queued audio before closing so the tail of an utterance is not
+    // lost on finalize
+    stop_sender(true);
     active_ = false;
 
     if (ws_ && stream_ctx_ && stream_ctx_->connected) {
-      try {
-        ws_->close(websocket::close_code::normal);
-      } catch (...) {
-      }
+      net::post(ioc_, [this] {
+        ws_->async_close(websocket::close_code::normal,
+                         [](beast::error_code) {});
+      });
     }
+    stop_io();
 
-    if (read_thread_.joinable()) {
-      read_thread_.join();
+    if (watchdog.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(watchdog_mutex);
+        stopped = true;
+      }
+      watchdog_cv.notify_one();
+      watchdog.join();
     }
+    finish_stop();
+  }
 
+  // Drops the upstream connection at once: queued audio is discarded and
+  // the close handshake skipped, for a client that has gone or cancelled.
+  void abort() {
+    active_ = false;
+    shutdown_transport();
+    stop_sender(false);
+    stop_io();
+    finish_stop();
+  }
+
+  bool is_connected() const {
+    return stream_ctx_ && stream_ctx_->connected.load();
+  }
+
+private:
+  void finish_stop() {
     if (stream_ctx_) {
       stream_ctx_->connected = false;
       stream_ctx_->streaming = false;
     }
+    endpoint_.reset();
   }
 
-  bool is_connected() const {
-    return stream_ctx_ && stream_ctx_->connected.load();
+  // Lets io_thread_ finish the operations under way and waits for it
+  void stop_io() {
+    io_work_.reset();
+    if (io_thread_.joinable())
+      io_thread_.join();
+  }
+
+  // Shuts the socket down under the reader and sender, whose pending
+  // operations then fail at once
+  void shutdown_transport() {
+    if (ws_)
+      ::shutdown(ws_->next_layer().next_layer().native_handle(), SHUT_RDWR);
+  }
+
+  static int64_t steady_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  int current_frame_ms() const {
+    int64_t rtt_ms = rtt_us_.load(std::memory_order_relaxed) / 1000;
+    return static_cast<int>(std::min<int64_t>(
+        MAX_FRAME_MS, std::max<int64_t>(MIN_FRAME_MS, rtt_ms / 2)));
+  }
+
+  // Paces queued PCM upstream. Whole frames are released while pacing
+  // credit lasts (several at once are coalesced into one message); a partial
+  // frame is sent once it has waited a full frame duration.
+  void send_loop() {
+    using clock = std::chrono::steady_clock;
+    double credit_ms = PACING_BURST_MS;
+    auto last_refill = clock::now();
+    auto next_ping = last_refill;
+    std::vector<uint8_t> frame;
+
+    std::unique_lock<std::mutex> lock(send_mutex_);
+    while (true) {
+      auto now = clock::now();
+      credit_ms = std::min<double>(
+          PACING_BURST_MS,
+          credit_ms +
+              std::chrono::duration<double, std::milli>(now - last_refill)
+                  .count());
+      last_refill = now;
+
+      const int frame_ms = current_frame_ms();
+      const size_t frame_bytes = frame_ms * PCM_BYTES_PER_MS;
+      auto wake = next_ping;
+      size_t take = 0;
+
+      if (send_stopping_) {
+        if (send_queue_.empty())
+          break;
+        take = std::min(send_queue_.size(), MAX_COALESCED_BYTES);
+      } else if (send_queue_.size() >= frame_bytes) {
+        size_t frames = std::min(
+            {send_queue_.size() / frame_bytes,
+             MAX_COALESCED_BYTES / frame_bytes,
+             static_cast<size_t>(credit_ms / frame_ms)});
+        if (frames > 0) {
+          take = frames * frame_bytes;
+        } else {
+          wake = std::min(
+              wake, now + std::chrono::milliseconds(
+                              static_cast<int>(frame_ms - credit_ms) + 1));
+        }
+      } else if (!send_queue_.empty()) {
+        auto deadline = oldest_pending_ + std::chrono::milliseconds(frame_ms);
+        if (now >= deadline)
+          take = send_queue_.size();
+        else
+          wake = std::min(wake, deadline);
+      }
+
+      if (take == 0) {
+        if (now >= next_ping) {
+          next_ping = now + std::chrono::milliseconds(RTT_PING_INTERVAL_MS);
+          if (steady_ms() - last_heard_ms_ > UPSTREAM_STALL_MS) {
+            ASR_LOG_WARN("Upstream silent for %d ms, dropping connection",
+                         UPSTREAM_STALL_MS);
+            shutdown_transport();
+            send_failed_ = true;
+            send_queue_.clear();
+            break;
+          }
+          lock.unlock();
+          send_ping();
+          lock.lock();
+        } else {
+          send_cv_.wait_until(lock, wake);
+        }
+        continue;
+      }
+
+      frame.assign(send_queue_.begin(), send_queue_.begin() + take);
+      send_queue_.erase(send_queue_.begin(), send_queue_.begin() + take);
+      oldest_pending_ = now;
+      credit_ms -= static_cast<double>(take) / PCM_BYTES_PER_MS;
+
+      lock.unlock();
+      bool ok = write_frame(frame);
+      lock.lock();
+      if (!ok) {
+        send_failed_ = true;
+        send_queue_.clear();
+        break;
+      }
+      stream_ctx_->sent_pcm_bytes += frame.size();
+    }
+  }
+
+  // Writes `frame` on io_thread_ and waits for it to go out
+  bool write_frame(const std::vector<uint8_t> &frame) {
+    asr_trace::Span span("upstream_write", stream_ctx_->trace);
+    std::promise<beast::error_code> written;
+    std::future<beast::error_code> result = written.get_future();
+    net::post(ioc_, [this, &frame, &written] {
+      ws_->async_write(net::buffer(frame),
+                       [&written](beast::error_code ec, size_t) {
+                         written.set_value(ec);
+                       });
+    });
+    const beast::error_code ec = result.get();
+    if (ec) {
+      ASR_LOG_RATE_LIMITED(asr_log::Level::Warn, 5, "Send error: %s",
+                           ec.message().c_str());
+      return false;
+    }
+    return true;
+  }
+
+  // Pings carry their send time so on_pong() can measure RTT.
+  void send_ping() {
+    auto now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
+    // Skipped while the last ping is still being written: a stream takes
+    // one at a time
+    net::post(ioc_, [this, payload = std::to_string(now_us)] {
+      if (ping_pending_)
+        return;
+      ping_pending_ = true;
+      ws_->async_ping(websocket::ping_data(payload.c_str()),
+                      [this](beast::error_code) { ping_pending_ = false; });
+    });
+  }
+
+  void on_pong(beast::string_view payload) {
+    last_heard_ms_ = steady_ms();
+    int64_t sent_us = 0;
+    for (char c : payload) {
+      if (c < '0' || c > '9')
+        return;
+      sent_us = sent_us * 10 + (c - '0');
+    }
+    int64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now().time_since_epoch())
+                         .count();
+    int64_t sample = now_us - sent_us;
+    if (sample <= 0)
+      return;
+    int64_t prev = rtt_us_.load(std::memory_order_relaxed);
+    rtt_us_.store(prev == 0 ? sample : (prev * 7 + sample) / 8,
+                  std::memory_order_relaxed);
+    ASR_LOG_DEBUG("Upstream RTT %.1f ms, frame %d ms", sample / 1000.0,
+                  current_frame_ms());
+  }
+
+  // Stops the sender thread; with `flush` it first drains the queue
+  // without pacing.
+  void stop_sender(bool flush) {
+    {
+      std::lock_guard<std::mutex> lock(send_mutex_);
+      send_stopping_ = true;
+      if (!flush)
+        send_queue_.clear();
+    }
+    send_cv_.notify_one();
+    if (send_thread_.joinable())
+      send_thread_.join();
   }
 };
 
@@ -352,97 +1083,356 @@ public:
 // MCP Session Handler
 // ============================================================================
 class MCPSession {
+public:
+  using Registry = asr_registry::SessionRegistry<MCPSession>;
+
 private:
-  int client_fd_;
+  asr_ws::ClientChannel channel_;
   std::atomic<bool> active_{true};
-  std::atomic<bool> finished_{false};
   std::thread worker_thread_;
-  std::unique_ptr<StreamContext> stream_ctx_;
+  Registry::Registration registration_;
+  std::shared_ptr<StreamContext> stream_ctx_; // Refinement jobs hold weak refs
   std::unique_ptr<ASRConnection> asr_connection_;
+  asr_trace::Context trace_; // Current request; session thread only
+  uint32_t requests_ = 0;
+  asr_audio::AudioNormalizer normalizer_;
+  std::string language_ = asr_http::default_language(); // Next connection's
+  std::vector<uint8_t> pcm_;
+  asr_arena::MessageArena arena_; // Scratch for the message being handled
+  size_t journal_cursor_ = 0;     // Next journaled result to send
+  std::unique_ptr<asr_local::Ring> ring_; // A local client's audio ring
 
 public:
-  MCPSession(int fd) : client_fd_(fd) {
-    stream_ctx_ = std::make_unique<StreamContext>();
+  MCPSession(int fd, bool websocket) : channel_(fd, websocket) {
+    stream_ctx_ = std::make_shared<StreamContext>();
+    stream_ctx_->capture_id = asr_capture::open_session();
+    stream_ctx_->trace = asr_trace::begin_session();
+    stream_ctx_->journal = asr_journal::Journal::create();
+    stream_ctx_->rules = asr_rules::Library::instance().find("default");
     asr_connection_ = std::make_unique<ASRConnection>();
   }
 
   ~MCPSession() {
     active_ = false;
-    finished_ = true;
     if (asr_connection_)
       asr_connection_->stop();
     if (worker_thread_.joinable())
       worker_thread_.join();
-    if (client_fd_ >= 0)
-      close(client_fd_);
+    if (channel_.fd() >= 0)
+      close(channel_.fd());
   }
 
-  bool is_finished() const { return finished_.load(); }
+  // Tells the client this process is being replaced; it should reconnect
+  // once its current utterance is done.
+  void notify_draining() {
+    send_response("{\"type\":\"draining\"}");
+    channel_.flush();
+  }
 
-  void start() {
+  // `registration` is released when the client goes away, which hands the
+  // session to the registry's reaper.
+  void start(Registry::Registration registration) {
+    registration_ = registration;
     worker_thread_ = std::thread(&MCPSession::handle_session, this);
   }
 
 private:
   void handle_session() {
-    uint8_t buffer[BUFFER_SIZE];
-    send_response("{\"type\":\"initialized\",\"server\":\"asr-mcp\","
-                  "\"version\":\"1.0\"}");
-
-    while (active_) {
-      struct pollfd pfd = {client_fd_, POLLIN, 0};
-      int ret = poll(&pfd, 1, POLL_TIMEOUT_MS);
-
-      if (ret > 0 && (pfd.revents & POLLIN)) {
-        ssize_t n = recv(client_fd_, buffer, BUFFER_SIZE, MSG_DONTWAIT);
-        if (n <= 0) {
-          if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
-            break;
-          continue;
-        }
-
-        std::string msg(reinterpret_cast<char *>(buffer),
-                        static_cast<size_t>(n));
-
-        if (msg.find("\"method\":\"transcribe\"") != std::string::npos) {
-          handle_transcribe();
-        } else if (msg.find("\"method\":\"stream_audio\"") !=
-                   std::string::npos) {
-          handle_audio_stream(buffer, n);
-        } else if (msg.find("\"method\":\"finalize_transcription\"") !=
-                   std::string::npos) {
-          handle_finalize();
-        }
+    // WebSocket clients complete the upgrade before anything is sent
+    bool open = channel_.handshake();
+    if (open)
+      send_response(asr_protocol::initialized_message(
+          stream_ctx_->journal ? stream_ctx_->journal->token() : ""));
+
+    asr_ws::MessageBatch messages;
+    while (open && active_) {
+      // A local client's ring rings its doorbell only while the session
+      // sleeps
+      short events = POLLIN | (channel_.pending() ? POLLOUT : 0);
+      int timeout = POLL_TIMEOUT_MS;
+      if (ring_ && !ring_->prepare_wait())
+        timeout = 0;
+      struct pollfd pfds[2] = {{channel_.fd(), events, 0},
+                               {ring_ ? ring_->doorbell() : -1, POLLIN, 0}};
+      int ret = poll(pfds, 2, timeout);
+      if (ring_)
+        ring_->end_wait(ret > 0 && (pfds[1].revents & POLLIN));
+
+      if (ret > 0 && (pfds[0].revents & POLLIN)) {
+        const uint64_t recv_start = asr_trace::now_ns(stream_ctx_->trace);
+        messages.clear();
+        if (!channel_.receive(messages))
+          break;
+        for (const asr_ws::Message &message : messages)
+          handle_message(message, recv_start);
       }
+      drain_ring();
 
       // Forward results to client
-      std::string result;
+      std::queue<std::string> results;
       {
         std::lock_guard<std::mutex> lock(stream_ctx_->mutex);
-        if (!stream_ctx_->result_queue.empty()) {
-          result = stream_ctx_->result_queue.front();
-          stream_ctx_->result_queue.pop();
-        }
+        results.swap(stream_ctx_->result_queue);
       }
-      if (!result.empty()) {
-        send_response(result);
+      if (!results.empty()) {
+        asr_trace::Span span("forward_result", stream_ctx_->trace);
+        for (; !results.empty(); results.pop())
+          send_response(results.front());
       }
+      forward_journal();
+
+      // Everything queued this iteration goes out in one write
+      if (!channel_.flush()) {
+        ASR_LOG_WARN("Dropping client: %s", strerror(errno));
+        break;
+      }
+    }
+
+    // No one is left to read what the upstream still has to say
+    if (asr_connection_)
+      asr_connection_->abort();
+    asr_capture::close_session(stream_ctx_->capture_id);
+    registration_.release();
+  }
+
+  void handle_message(const asr_ws::Message &message, uint64_t recv_start) {
+    // Ring audio written before this message was sent belongs before it
+    drain_ring();
+    arena_.reset();
+    record_client_message(message);
+
+    const std::string &msg = message.data;
+    const asr_protocol::Method method =
+        message.binary ? asr_protocol::Method::StreamAudio
+                       : asr_protocol::parse_method(msg);
+    asr_trace::Span request_span(
+        asr_protocol::method_name(method),
+        stream_ctx_->trace.for_request(++requests_), recv_start);
+    trace_ = request_span.context();
+    asr_trace::record("socket_recv", trace_, recv_start,
+                      asr_trace::now_ns(trace_));
+
+    switch (method) {
+    case asr_protocol::Method::Transcribe:
+      handle_transcribe(msg);
+      break;
+    case asr_protocol::Method::ConfigureAudio:
+      handle_configure_audio(msg);
+      break;
+    case asr_protocol::Method::StreamAudio:
+      if (message.binary)
+        handle_audio(reinterpret_cast<const uint8_t *>(msg.data()),
+                     msg.size());
+      else
+        handle_audio_stream(msg);
+      break;
+    case asr_protocol::Method::Cancel:
+      handle_cancel();
+      break;
+    case asr_protocol::Method::FinalizeTranscription:
+      handle_finalize();
+      break;
+    case asr_protocol::Method::Resume:
+      handle_resume(msg);
+      break;
+    case asr_protocol::Method::OpenRing:
+      handle_open_ring();
+      break;
+    case asr_protocol::Method::Unknown:
+      break;
+    }
+  }
+
+  // Sends the results journaled since the last call
+  void forward_journal() {
+    if (!stream_ctx_->journal)
+      return;
+    arena_.reset();
+    stream_ctx_->journal->read(journal_cursor_,
+                               [&](const asr_journal::Record &record) {
+                                 send_record(record);
+                               });
+  }
+
+  void send_record(const asr_journal::Record &record) {
+    asr_arena::String message(arena_.resource());
+    asr_protocol::append_sequenced(message, record.payload, record.seq);
+    send_response(message);
+  }
+
+  // Continues an earlier session after a reconnect: sends the journaled
+  // results after the client's last "seq" and tells it where to resume its
+  // audio. Utterance numbers carry on from the earlier session. Only valid
+  // as the first request.
+  void handle_resume(const std::string &msg) {
+    std::string token;
+    uint32_t seen = 0;
+    asr_audio::find_json_string(msg, "session", token);
+    asr_audio::find_json_uint(msg, "seq", seen);
+    if (requests_ != 1) {
+      send_error("Resume must be the first request");
+      return;
+    }
+    std::shared_ptr<asr_journal::Journal> journal =
+        asr_journal::Journal::open(token);
+    if (!journal) {
+      send_error("Unknown session");
+      return;
     }
 
-    finished_ = true;
+    uint64_t last = 0;
+    uint32_t utterance = 0;
+    journal_cursor_ = 0;
+    journal->read(journal_cursor_, [&](const asr_journal::Record &record) {
+      if (record.seq > seen)
+        send_record(record);
+      last = record.seq;
+      uint32_t number = 0;
+      if (asr_audio::find_json_uint(std::string(record.payload), "utterance",
+                                    number))
+        utterance = std::max(utterance, number);
+    });
+    const uint64_t audio_ms = journal->audio_ms();
+    {
+      std::lock_guard<std::mutex> lock(stream_ctx_->mutex);
+      stream_ctx_->journal = std::move(journal);
+      stream_ctx_->utterance_id = utterance;
+    }
+    stream_ctx_->sent_pcm_bytes = audio_ms * PCM_BYTES_PER_MS;
+    send_response(asr_protocol::resumed_message(token, last, audio_ms));
+  }
+
+  // Binary WebSocket and ring audio is recorded as the equivalent
+  // stream_audio message so that asr_replay can send it over TCP.
+  void record_client_message(const asr_ws::Message &message) {
+    if (!message.binary)
+      asr_capture::record(stream_ctx_->capture_id,
+                          asr_capture::Kind::ClientFrame, message.data);
+    else
+      record_client_audio(
+          reinterpret_cast<const uint8_t *>(message.data.data()),
+          message.data.size());
+  }
+
+  void record_client_audio(const uint8_t *audio, size_t audio_len) {
+    if (!asr_capture::Capture::instance().enabled())
+      return;
+    asr_capture::record(stream_ctx_->capture_id,
+                        asr_capture::Kind::ClientFrame,
+                        "{\"method\":\"stream_audio\",\"data\":\"" +
+                            asr_protocol::base64_encode(audio, audio_len) +
+                            "\"}\n");
+  }
+
+  // Gives a client on the local socket a shared-memory ring to write its
+  // audio to; the ring and its doorbell go with the reply
+  void handle_open_ring() {
+    if (!asr_local::is_local(channel_.fd())) {
+      send_error("open_ring is only available on the local socket");
+      return;
+    }
+    std::unique_ptr<asr_local::Ring> ring = asr_local::Ring::create();
+    if (!ring) {
+      send_error(std::string("Cannot create audio ring: ") + strerror(errno));
+      return;
+    }
+    const std::string opened = asr_local::ring_opened_message();
+    asr_capture::record(stream_ctx_->capture_id, asr_capture::Kind::ServerFrame,
+                        opened.data(), opened.size());
+    const int fds[] = {ring->memfd(), ring->doorbell()};
+    if (!channel_.send_with_fds(opened, fds, 2)) {
+      send_error(std::string("Cannot pass audio ring: ") + strerror(errno));
+      return;
+    }
+    ring_ = std::move(ring);
+  }
+
+  // Hands the audio written to the ring since the last call to handle_audio,
+  // in place. It is not acknowledged: the ring's read index tells the client
+  // what was taken.
+  void drain_ring() {
+    if (!ring_ || ring_->empty())
+      return;
+    arena_.reset();
+    asr_trace::Span request_span("ring_audio",
+                                 stream_ctx_->trace.for_request(++requests_));
+    trace_ = request_span.context();
+    bool valid = ring_->drain([this](const uint8_t *audio, size_t audio_len) {
+      record_client_audio(audio, audio_len);
+      handle_audio(audio, audio_len, false);
+    });
+    if (!valid) {
+      ring_.reset();
+      send_error("Audio ring indices are corrupt, ring closed");
+    }
   }
 
-  void handle_transcribe() {
-    if (!asr_connection_->connect(stream_ctx_.get())) {
+  void handle_transcribe(const std::string &msg) {
+    if (!apply_language(msg) || !apply_tenant(msg) ||
+        (asr_audio::has_format_fields(msg) && !apply_format(msg)))
+      return;
+    asr_trace::Span span("upstream_connect", trace_);
+    if (!asr_connection_->connect(stream_ctx_.get(), span.context(),
+                                  language_)) {
       send_error("Failed to connect to ASR service");
       return;
     }
-    send_response("{\"type\":\"transcription_started\"}");
+    send_response("{\"type\":\"transcription_started\",\"format\":" +
+                  asr_audio::format_json(normalizer_.format()) + "}");
+  }
+
+  void handle_configure_audio(const std::string &msg) {
+    if (!apply_language(msg) || !apply_tenant(msg) || !apply_format(msg))
+      return;
+    send_response("{\"type\":\"audio_configured\",\"format\":" +
+                  asr_audio::format_json(normalizer_.format()) + "}");
+  }
+
+  // Negotiates the client's input format; audio is converted to 16 kHz mono
+  // s16le before it goes upstream.
+  bool apply_format(const std::string &msg) {
+    asr_audio::AudioFormat fmt = normalizer_.format();
+    if (!asr_audio::parse_format(msg, fmt) || !normalizer_.configure(fmt)) {
+      send_error("Unsupported audio format");
+      return false;
+    }
+    ASR_LOG_INFO("Client audio format: %u Hz, %u ch, %s", fmt.sample_rate,
+                 fmt.channels, asr_audio::encoding_name(fmt.encoding));
+    return true;
+  }
+
+  // Takes the request's "language", if any. The upstream stream is opened
+  // with it, so it applies from the next connection on.
+  bool apply_language(const std::string &msg) {
+    if (!asr_protocol::parse_language(msg, language_)) {
+      send_error("Unsupported language");
+      return false;
+    }
+    return true;
   }
 
-  void handle_audio_stream(const uint8_t *data, size_t len) {
-    std::string msg(reinterpret_cast<const char *>(data), len);
+  // Takes the request's "tenant", if any, whose rules then apply to the
+  // finals from now on
+  bool apply_tenant(const std::string &msg) {
+    std::string tenant;
+    if (!asr_protocol::parse_tenant(msg, tenant)) {
+      send_error("Invalid tenant");
+      return false;
+    }
+    if (tenant.empty())
+      return true;
+    std::shared_ptr<asr_rules::TenantRules> rules =
+        asr_rules::Library::instance().find(tenant);
+    if (!rules) {
+      send_error("Unknown tenant");
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(stream_ctx_->mutex);
+    stream_ctx_->rules = std::move(rules);
+    return true;
+  }
 
+  void handle_audio_stream(const std::string &msg) {
     // Extract base64 data
     size_t data_pos = msg.find("\"data\":\"");
     if (data_pos == std::string::npos) {
@@ -457,44 +1447,125 @@ private:
       return;
     }
 
-    std::string base64_data = msg.substr(data_start, data_end - data_start);
-    std::vector<uint8_t> audio = base64_decode(base64_data);
+    asr_trace::Span decode_span("base64_decode", trace_);
+    asr_arena::Bytes audio(arena_.resource());
+    asr_protocol::base64_decode(msg.data() + data_start, data_end - data_start,
+                                audio);
+    decode_span.end();
 
     if (audio.empty()) {
       send_error("Decode failed");
       return;
     }
+    handle_audio(audio.data(), audio.size());
+  }
+
+  // Audio in the client's format, from stream_audio, a binary frame or the
+  // ring
+  void handle_audio(const uint8_t *audio, size_t audio_len,
+                    bool acknowledge = true) {
+    if (audio_len == 0) {
+      send_error("No audio data");
+      return;
+    }
 
     if (!asr_connection_->is_connected()) {
-      if (!asr_connection_->connect(stream_ctx_.get())) {
+      asr_trace::Span span("upstream_connect", trace_);
+      if (!asr_connection_->connect(stream_ctx_.get(), span.context(),
+                                    language_)) {
         send_error("Connection failed");
         return;
       }
     }
 
-    if (asr_connection_->send_audio_chunk(audio.data(), audio.size())) {
-      send_response("{\"type\":\"audio_sent\",\"bytes\":" +
-                    std::to_string(audio.size()) + "}");
+    pcm_.clear();
+    asr_trace::Span normalize_span("normalize", trace_);
+    normalizer_.process(audio, audio_len, pcm_);
+    normalize_span.end();
+    if (pcm_.empty()) {
+      // Not enough input for a whole output sample yet
+      if (acknowledge)
+        send_audio_sent(audio_len);
+      return;
+    }
+
+    asr_trace::Span enqueue_span("enqueue_upstream", trace_);
+    bool queued = asr_connection_->send_audio_chunk(pcm_.data(), pcm_.size());
+    enqueue_span.end();
+    if (queued) {
+      retain_for_refinement();
+      if (acknowledge)
+        send_audio_sent(audio_len);
     } else {
       send_error("Send failed");
     }
   }
 
+  // Keeps the audio of the current utterance for the refinement pass. An
+  // utterance longer than MAX_REFINE_BYTES keeps its streamed text only.
+  void retain_for_refinement() {
+    if (!BatchRefiner::instance().enabled())
+      return;
+    std::lock_guard<std::mutex> lock(stream_ctx_->mutex);
+    std::vector<uint8_t> &span = stream_ctx_->utterance_pcm;
+    if (stream_ctx_->utterance_overflow)
+      return;
+    if (span.size() + pcm_.size() > MAX_REFINE_BYTES) {
+      stream_ctx_->utterance_overflow = true;
+      std::vector<uint8_t>().swap(span);
+      return;
+    }
+    span.insert(span.end(), pcm_.begin(), pcm_.end());
+  }
+
   void handle_finalize() {
-    if (asr_connection_)
+    normalizer_.reset();
+    if (asr_connection_) {
+      asr_trace::Span span("upstream_flush_close", trace_);
       asr_connection_->stop();
+    }
+    {
+      // Audio after the last final has no streamed text to refine
+      std::lock_guard<std::mutex> lock(stream_ctx_->mutex);
+      std::vector<uint8_t>().swap(stream_ctx_->utterance_pcm);
+      stream_ctx_->utterance_overflow = false;
+    }
     send_response("{\"type\":\"transcription_stopped\"}");
   }
 
-  void send_response(const std::string &response) {
-    if (client_fd_ < 0)
+  // Like finalize, but the upstream is dropped at once, without the results
+  // of audio still in flight
+  void handle_cancel() {
+    normalizer_.reset();
+    const bool streaming = asr_connection_ && asr_connection_->is_connected();
+    if (asr_connection_)
+      asr_connection_->abort();
+    {
+      std::lock_guard<std::mutex> lock(stream_ctx_->mutex);
+      std::vector<uint8_t>().swap(stream_ctx_->utterance_pcm);
+      stream_ctx_->utterance_overflow = false;
+    }
+    send_response(std::string("{\"type\":\"cancelled\",\"requests\":") +
+                  (streaming ? "1" : "0") + "}");
+  }
+
+  void send_audio_sent(size_t bytes) {
+    asr_arena::String ack(arena_.resource());
+    asr_protocol::format_count(ack, asr_protocol::AUDIO_SENT, bytes);
+    send_response(ack);
+  }
+
+  void send_response(std::string_view response) {
+    if (channel_.fd() < 0)
       return;
-    std::string msg = response + "\n";
-    send(client_fd_, msg.c_str(), msg.length(), MSG_NOSIGNAL);
+    asr_capture::record(stream_ctx_->capture_id, asr_capture::Kind::ServerFrame,
+                        response.data(), response.size());
+    channel_.queue(response);
   }
 
   void send_error(const std::string &error) {
-    send_response("{\"type\":\"error\",\"message\":\"" + error + "\"}");
+    send_response("{\"type\":\"error\",\"message\":\"" +
+                  asr_protocol::json_escape(error) + "\"}");
   }
 };
 
@@ -503,91 +1574,212 @@ private:
 // ============================================================================
 class MCPServer {
 private:
-  int server_fd_;
-  std::vector<std::unique_ptr<MCPSession>> sessions_;
+  int server_fd_{-1};
+  int ws_fd_{-1}; // WebSocket clients; -1 when disabled
+  MCPSession::Registry sessions_;
   std::atomic<bool> running_{true};
-  std::mutex sessions_mutex_;
+  asr_handoff::HandoffListener handoff_;
+  asr_local::Listener local_; // Clients on this host; not handed over
 
 public:
-  MCPServer() {
-    server_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd_ < 0)
-      throw std::runtime_error("Socket creation failed");
+  explicit MCPServer(bool upgrade) {
+    const std::string handoff_path = asr_handoff::socket_path(MCP_PORT);
+    int handoff_channel = -1;
+
+    if (upgrade) {
+      int inherited[asr_handoff::MAX_LISTENERS] = {-1, -1};
+      if (asr_handoff::acquire_listeners(handoff_path, inherited,
+                                         asr_handoff::MAX_LISTENERS,
+                                         handoff_channel) > 0) {
+        server_fd_ = inherited[0];
+        ws_fd_ = inherited[1];
+        ASR_LOG_INFO("Inherited listening socket from running instance");
+      } else {
+        ASR_LOG_WARN("No running instance at %s, binding port %d",
+                     handoff_path.c_str(), MCP_PORT);
+      }
+    }
+
+    if (server_fd_ < 0) {
+      server_fd_ = asr_handoff::bind_listener(MCP_PORT, MAX_CONNECTIONS);
+      if (server_fd_ < 0)
+        throw std::runtime_error("Bind failed");
+    }
 
-    int opt = 1;
-    setsockopt(server_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    const int ws_port = asr_ws::listen_port();
+    if (ws_port <= 0 && ws_fd_ >= 0) {
+      close(ws_fd_);
+      ws_fd_ = -1;
+    } else if (ws_port > 0 && ws_fd_ < 0) {
+      ws_fd_ = asr_handoff::bind_listener(ws_port, MAX_CONNECTIONS);
+      if (ws_fd_ < 0)
+        ASR_LOG_WARN("WebSocket port %d unavailable: %s", ws_port,
+                     strerror(errno));
+    }
 
-    struct sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(MCP_PORT);
+    // Shared with the predecessor during handoff, so accept must not block
+    // when the other process wins a connection
+    for (int fd : {server_fd_, ws_fd_}) {
+      if (fd >= 0)
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
 
-    if (bind(server_fd_, (struct sockaddr *)&addr, sizeof(addr)) < 0)
-      throw std::runtime_error("Bind failed");
+    if (!handoff_.open(handoff_path)) {
+      ASR_LOG_WARN("Handoff socket %s unavailable, --upgrade disabled",
+                   handoff_path.c_str());
+    }
 
-    if (listen(server_fd_, MAX_CONNECTIONS) < 0)
-      throw std::runtime_error("Listen failed");
+    // Bound before the predecessor is released: it unlinks the path on
+    // exit unless a successor has replaced it
+    const std::string local_path = asr_local::socket_path(MCP_PORT);
+    if (!local_path.empty() && !local_.open(local_path))
+      ASR_LOG_WARN("Local socket %s unavailable: %s", local_path.c_str(),
+                   strerror(errno));
+    asr_handoff::acknowledge(handoff_channel);
 
     std::cout << "========================================" << std::endl;
     std::cout << "ASR MCP Server (Boost.Beast WebSocket)" << std::endl;
     std::cout << "========================================" << std::endl;
     std::cout << "Port: " << MCP_PORT << std::endl;
-    std::cout << "ASR: wss://" << ASR_WS_HOST << ASR_WS_PATH << std::endl;
-    std::cout << "Language: " << get_language() << std::endl;
+    if (ws_fd_ >= 0)
+      std::cout << "WebSocket port: " << ws_port << std::endl;
+    if (local_.fd() >= 0)
+      std::cout << "Local socket: " << local_path << std::endl;
+    asr_upstream::Endpoints &endpoints = ws_endpoints();
+    for (size_t i = 0; i < endpoints.size(); ++i)
+      std::cout << "ASR: wss://" << endpoints.address(i) << ASR_WS_PATH
+                << std::endl;
+    std::cout << "Language: " << asr_http::default_language() << std::endl;
     std::cout << "========================================" << std::endl;
   }
 
   ~MCPServer() {
     running_ = false;
-    close(server_fd_);
+    close_listeners();
   }
 
   void run() {
-    std::thread cleanup([this]() {
-      while (running_) {
-        std::this_thread::sleep_for(std::chrono::seconds(5));
-        std::lock_guard<std::mutex> lock(sessions_mutex_);
-        auto it =
-            std::remove_if(sessions_.begin(), sessions_.end(),
-                           [](const auto &s) { return s && s->is_finished(); });
-        sessions_.erase(it, sessions_.end());
-      }
-    });
-
     while (running_) {
-      struct sockaddr_in client_addr;
-      socklen_t client_len = sizeof(client_addr);
+      // poll() skips negative descriptors, so disabled entries are inert
+      struct pollfd pfds[4] = {{server_fd_, POLLIN, 0},
+                               {ws_fd_, POLLIN, 0},
+                               {handoff_.fd(), POLLIN, 0},
+                               {local_.fd(), POLLIN, 0}};
+      if (poll(pfds, 4, ACCEPT_POLL_MS) <= 0)
+        continue;
 
-      int client_fd =
-          accept(server_fd_, (struct sockaddr *)&client_addr, &client_len);
-      if (client_fd < 0)
+      if (pfds[2].revents & POLLIN) {
+        const int listeners[] = {server_fd_, ws_fd_};
+        if (handoff_.serve(listeners, ws_fd_ >= 0 ? 2 : 1))
+          break;
         continue;
+      }
 
+      if (pfds[0].revents & POLLIN)
+        accept_client(server_fd_, false);
+      if (pfds[1].revents & POLLIN)
+        accept_client(ws_fd_, true);
+      if (pfds[3].revents & POLLIN)
+        accept_client(local_.fd(), false);
+    }
+
+    if (running_)
+      drain();
+
+    running_ = false;
+    sessions_.shutdown();
+  }
+
+private:
+  void accept_client(int listen_fd, bool websocket) {
+    struct sockaddr_storage client_addr;
+    socklen_t client_len = sizeof(client_addr);
+
+    int client_fd =
+        accept(listen_fd, (struct sockaddr *)&client_addr, &client_len);
+    if (client_fd < 0)
+      return;
+
+    // The WebSocket handshake uses blocking sends; some platforms inherit
+    // O_NONBLOCK
+    fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL) & ~O_NONBLOCK);
+
+    const bool local = client_addr.ss_family == AF_UNIX;
+    if (!local) {
       int flag = 1;
       setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    }
 
-      std::cout << "New connection from " << inet_ntoa(client_addr.sin_addr)
-                << std::endl;
-
-      auto session = std::make_unique<MCPSession>(client_fd);
-      session->start();
+    auto registration =
+        sessions_.add(std::make_unique<MCPSession>(client_fd, websocket));
+    registration.session()->start(registration);
+
+    char ip[INET_ADDRSTRLEN] = "this host";
+    if (!local)
+      inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in &>(client_addr).sin_addr,
+                ip, sizeof(ip));
+    ASR_LOG_INFO("New %s connection from %s (%zu live, %zu reaping)",
+                 websocket ? "WebSocket" : local ? "local" : "TCP", ip,
+                 sessions_.live(), sessions_.reaping());
+  }
 
-      std::lock_guard<std::mutex> lock(sessions_mutex_);
-      sessions_.push_back(std::move(session));
+  void close_listeners() {
+    for (int *fd : {&server_fd_, &ws_fd_}) {
+      if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+      }
     }
+    local_.close_fd();
+  }
 
-    if (cleanup.joinable())
-      cleanup.join();
+  // The successor owns the listening sockets now. Let existing sessions run
+  // to completion (clients are told to migrate at their convenience), up to
+  // DRAIN_TIMEOUT_SEC.
+  void drain() {
+    close_listeners();
+    handoff_.close_fd();
+
+    size_t remaining = sessions_.live();
+    sessions_.for_each([](MCPSession &session) { session.notify_draining(); });
+    ASR_LOG_INFO("Listener handed to successor, draining %zu sessions",
+                 remaining);
+
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::seconds(DRAIN_TIMEOUT_SEC);
+    while (true) {
+      remaining = sessions_.live();
+      if (remaining == 0) {
+        ASR_LOG_INFO("All sessions drained, exiting");
+        break;
+      }
+      if (std::chrono::steady_clock::now() >= deadline) {
+        ASR_LOG_WARN("Drain timeout, closing %zu sessions", remaining);
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(DRAIN_POLL_MS));
+    }
   }
 };
 
 // ============================================================================
 // Main
 // ============================================================================
-int main() {
+int main(int argc, char *argv[]) {
   try {
+    bool upgrade = false;
+    for (int i = 1; i < argc; ++i) {
+      if (std::string(argv[i]) == "--upgrade")
+        upgrade = true;
+    }
+
     std::cout << "Starting ASR MCP Server (Pure C++)..." << std::endl;
-    MCPServer server;
+    // Load the CA bundle once, before the first client arrives
+    TLSClientContext::instance();
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    BatchRefiner::instance();
+    asr_convert::Converter::instance();
+    MCPServer server(upgrade);
     server.run();
   } catch (const std::exception &e) {
     std::cerr << "Error: " << e.what() << std::endl;
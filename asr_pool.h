@@ -0,0 +1,105 @@
+// Fixed-size pool of upstream connections. acquire() blocks until a
+// connection is free; release() hands it back and wakes one waiter.
+// acquire_unless() also gives up when its caller's request is cancelled.
+//
+// Conn must provide is_valid(), is_in_use() and set_in_use(bool); invalid
+// connections are dropped at construction.
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace asr_pool {
+
+template <typename Conn> class ConnectionPool {
+private:
+  std::vector<std::unique_ptr<Conn>> connections_;
+  std::mutex pool_mutex_;
+  std::condition_variable cv_;
+  size_t pool_size_;
+
+public:
+  // Builds `size` connections, passing `args` to each constructor.
+  template <typename... Args>
+  explicit ConnectionPool(size_t size, Args &...args) : pool_size_(size) {
+    for (size_t i = 0; i < pool_size_; ++i) {
+      auto conn = std::make_unique<Conn>(args...);
+      if (conn->is_valid()) {
+        connections_.push_back(std::move(conn));
+      }
+    }
+  }
+
+  size_t size() const { return connections_.size(); }
+
+  // Returns nullptr only if no connection could be created.
+  Conn *acquire() {
+    std::unique_lock<std::mutex> lock(pool_mutex_);
+    if (connections_.empty())
+      return nullptr;
+    cv_.wait(lock, [this] {
+      return std::any_of(connections_.begin(), connections_.end(),
+                         [](const auto &conn) { return !conn->is_in_use(); });
+    });
+
+    for (auto &conn : connections_) {
+      if (!conn->is_in_use()) {
+        conn->set_in_use(true);
+        return conn.get();
+      }
+    }
+    return nullptr;
+  }
+
+  // Like acquire(), but gives up (nullptr) once `stop()` is true. Whoever
+  // makes it true calls wake_all() so that waiters notice.
+  template <typename Stop> Conn *acquire_unless(Stop stop) {
+    std::unique_lock<std::mutex> lock(pool_mutex_);
+    auto free = [this] {
+      return std::find_if(connections_.begin(), connections_.end(),
+                          [](const auto &conn) { return !conn->is_in_use(); });
+    };
+    cv_.wait(lock, [&] {
+      return connections_.empty() || stop() || free() != connections_.end();
+    });
+    auto it = free();
+    if (it == connections_.end())
+      return nullptr;
+    if (stop()) {
+      cv_.notify_one(); // Pass on the release that woke this waiter
+      return nullptr;
+    }
+    (*it)->set_in_use(true);
+    return it->get();
+  }
+
+  void wake_all() {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    cv_.notify_all();
+  }
+
+  // Like acquire(), but returns nullptr instead of waiting when every
+  // connection is busy.
+  Conn *try_acquire() {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    for (auto &conn : connections_) {
+      if (!conn->is_in_use()) {
+        conn->set_in_use(true);
+        return conn.get();
+      }
+    }
+    return nullptr;
+  }
+
+  void release(Conn *conn) {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    conn->set_in_use(false);
+    cv_.notify_one();
+  }
+};
+
+} // namespace asr_pool
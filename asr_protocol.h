@@ -0,0 +1,619 @@
+// MCP wire-protocol helpers shared by the ASR MCP servers: method dispatch,
+// request ids, base64 payload coding, JSON string escaping and splitting,
+// preformatted responses and de-duplication of cumulative final results.
+//
+// Helpers on the per-message path append to a caller's container, so a
+// session can point them at its arena (asr_arena.h) and reuse the memory.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace asr_protocol {
+
+enum class Method {
+  Unknown,
+  Transcribe,
+  ConfigureAudio,
+  StreamAudio,
+  FinalizeTranscription,
+  Resume,
+  OpenRing,
+  Cancel,
+};
+
+// Identifies the request in a client message with the same substring search
+// the servers have always used; the first match wins.
+inline Method parse_method(const std::string &msg) {
+  if (msg.find("\"method\":\"transcribe\"") != std::string::npos)
+    return Method::Transcribe;
+  if (msg.find("\"method\":\"stream_audio\"") != std::string::npos)
+    return Method::StreamAudio;
+  if (msg.find("\"method\":\"configure_audio\"") != std::string::npos)
+    return Method::ConfigureAudio;
+  if (msg.find("\"method\":\"finalize_transcription\"") != std::string::npos)
+    return Method::FinalizeTranscription;
+  if (msg.find("\"method\":\"resume\"") != std::string::npos)
+    return Method::Resume;
+  if (msg.find("\"method\":\"open_ring\"") != std::string::npos)
+    return Method::OpenRing;
+  if (msg.find("\"method\":\"cancel\"") != std::string::npos)
+    return Method::Cancel;
+  return Method::Unknown;
+}
+
+// Method name as sent on the wire; also used as the request's trace span
+inline const char *method_name(Method method) {
+  switch (method) {
+  case Method::Transcribe:
+    return "transcribe";
+  case Method::ConfigureAudio:
+    return "configure_audio";
+  case Method::StreamAudio:
+    return "stream_audio";
+  case Method::FinalizeTranscription:
+    return "finalize_transcription";
+  case Method::Resume:
+    return "resume";
+  case Method::OpenRing:
+    return "open_ring";
+  case Method::Cancel:
+    return "cancel";
+  default:
+    return "unknown";
+  }
+}
+
+// Base64 decoding table
+static const std::string BASE64_CHARS =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Alphabet position of each byte, -1 outside the alphabet
+inline const int8_t *base64_values() {
+  static const std::array<int8_t, 256> values = [] {
+    std::array<int8_t, 256> v{};
+    v.fill(-1);
+    for (size_t i = 0; i < BASE64_CHARS.size(); ++i)
+      v[static_cast<uint8_t>(BASE64_CHARS[i])] = static_cast<int8_t>(i);
+    return v;
+  }();
+  return values.data();
+}
+
+// Base64 decode, appending to `out`; characters outside the alphabet are
+// skipped
+template <typename Bytes>
+void base64_decode(const char *encoded, size_t len, Bytes &out) {
+  const int8_t *values = base64_values();
+  out.reserve(out.size() + len / 4 * 3 + 3);
+  int val = 0, valb = -8;
+  for (size_t i = 0; i < len; ++i) {
+    if (encoded[i] == '=')
+      break;
+    int8_t v = values[static_cast<uint8_t>(encoded[i])];
+    if (v < 0)
+      continue;
+    val = ((val << 6) + v) & 0xFFFFFF;
+    valb += 6;
+    if (valb >= 0) {
+      out.push_back(static_cast<uint8_t>((val >> valb) & 0xFF));
+      valb -= 8;
+    }
+  }
+}
+
+inline std::vector<uint8_t> base64_decode(const std::string &encoded) {
+  std::vector<uint8_t> decoded;
+  base64_decode(encoded.data(), encoded.size(), decoded);
+  return decoded;
+}
+
+inline std::string base64_encode(const uint8_t *data, size_t len) {
+  std::string out;
+  out.reserve((len + 2) / 3 * 4);
+  size_t i = 0;
+  for (; i + 3 <= len; i += 3) {
+    uint32_t n = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+    out += BASE64_CHARS[(n >> 18) & 0x3F];
+    out += BASE64_CHARS[(n >> 12) & 0x3F];
+    out += BASE64_CHARS[(n >> 6) & 0x3F];
+    out += BASE64_CHARS[n & 0x3F];
+  }
+  if (i < len) {
+    uint32_t n = data[i] << 16;
+    if (i + 1 < len)
+      n |= data[i + 1] << 8;
+    out += BASE64_CHARS[(n >> 18) & 0x3F];
+    out += BASE64_CHARS[(n >> 12) & 0x3F];
+    out += i + 1 < len ? BASE64_CHARS[(n >> 6) & 0x3F] : '=';
+    out += '=';
+  }
+  return out;
+}
+
+// Appends text escaped for embedding in a JSON string literal
+template <typename String>
+void append_json_escaped(String &out, std::string_view text) {
+  out.reserve(out.size() + text.size() + 8);
+  for (char c : text) {
+    if (c == '"')
+      out += "\\\"";
+    else if (c == '\\')
+      out += "\\\\";
+    else if (c == '\n')
+      out += "\\n";
+    else if (c == '\r')
+      out += "\\r";
+    else if (c == '\t')
+      out += "\\t";
+    else if (static_cast<unsigned char>(c) < 0x20) {
+      // Other control characters may not appear raw either
+      static constexpr char HEX[] = "0123456789abcdef";
+      out += "\\u00";
+      out += HEX[c >> 4];
+      out += HEX[c & 0xF];
+    } else
+      out += c;
+  }
+}
+
+inline std::string json_escape(const std::string &text) {
+  std::string escaped;
+  append_json_escaped(escaped, text);
+  return escaped;
+}
+
+// Parses the JSON string literal whose opening quote is at `pos` into
+// `out`, decoding escapes (\uXXXX, including surrogate pairs, to UTF-8).
+inline bool json_unescape(const std::string &json, size_t pos,
+                          std::string &out) {
+  if (pos >= json.size() || json[pos] != '"')
+    return false;
+  out.clear();
+  auto hex4 = [&](size_t at, uint32_t &cp) {
+    if (at + 4 > json.size())
+      return false;
+    cp = 0;
+    for (size_t i = at; i < at + 4; ++i) {
+      char c = json[i];
+      cp <<= 4;
+      if (c >= '0' && c <= '9')
+        cp |= static_cast<uint32_t>(c - '0');
+      else if (c >= 'a' && c <= 'f')
+        cp |= static_cast<uint32_t>(c - 'a' + 10);
+      else if (c >= 'A' && c <= 'F')
+        cp |= static_cast<uint32_t>(c - 'A' + 10);
+      else
+        return false;
+    }
+    return true;
+  };
+
+  for (size_t i = pos + 1; i < json.size(); ++i) {
+    char c = json[i];
+    if (c == '"')
+      return true;
+    if (c != '\\') {
+      out += c;
+      continue;
+    }
+    if (++i >= json.size())
+      return false;
+    switch (json[i]) {
+    case 'n':
+      out += '\n';
+      break;
+    case 'r':
+      out += '\r';
+      break;
+    case 't':
+      out += '\t';
+      break;
+    case 'b':
+      out += '\b';
+      break;
+    case 'f':
+      out += '\f';
+      break;
+    case 'u': {
+      uint32_t cp;
+      if (!hex4(i + 1, cp))
+        return false;
+      i += 4;
+      if (cp >= 0xD800 && cp <= 0xDBFF && i + 6 < json.size() &&
+          json[i + 1] == '\\' && json[i + 2] == 'u') {
+        uint32_t low;
+        if (hex4(i + 3, low) && low >= 0xDC00 && low <= 0xDFFF) {
+          cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+          i += 6;
+        }
+      }
+      if (cp < 0x80) {
+        out += static_cast<char>(cp);
+      } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+      } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+      } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+      }
+      break;
+    }
+    default: // \" \\ \/
+      out += json[i];
+      break;
+    }
+  }
+  return false;
+}
+
+// The client's optional request "id" as a JSON token ready to echo back: a
+// re-escaped string or a number. Empty if absent or of another type.
+inline std::string request_id(const std::string &msg) {
+  constexpr size_t MAX_ID_LEN = 128;
+  size_t pos = msg.find("\"id\"");
+  if (pos == std::string::npos)
+    return "";
+  pos = msg.find_first_not_of(" \t", pos + 4);
+  if (pos == std::string::npos || msg[pos] != ':')
+    return "";
+  pos = msg.find_first_not_of(" \t", pos + 1);
+  if (pos == std::string::npos)
+    return "";
+  if (msg[pos] == '"') {
+    std::string value;
+    if (!json_unescape(msg, pos, value) || value.size() > MAX_ID_LEN)
+      return "";
+    return "\"" + json_escape(value) + "\"";
+  }
+  size_t end = msg.find_first_not_of("-+.0123456789eE", pos);
+  if (end == std::string::npos)
+    end = msg.size();
+  if (end == pos || end - pos > MAX_ID_LEN)
+    return "";
+  return msg.substr(pos, end - pos);
+}
+
+// A name-like field of a client message ([A-Za-z0-9_-], up to `max_len`)
+// into `out`, which is left alone if the field is absent. False if the value
+// is not such a name.
+inline bool parse_name(const std::string &msg, const char *field,
+                       size_t max_len, std::string &out) {
+  const std::string key = std::string("\"") + field + "\":\"";
+  size_t pos = msg.find(key);
+  if (pos == std::string::npos)
+    return true;
+  pos += key.size();
+  size_t end = msg.find('"', pos);
+  if (end == std::string::npos || end == pos || end - pos > max_len)
+    return false;
+  for (size_t i = pos; i < end; ++i) {
+    char c = msg[i];
+    bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') || c == '-' || c == '_';
+    if (!ok)
+      return false;
+  }
+  out = msg.substr(pos, end - pos);
+  return true;
+}
+
+// The "language" field of a client message (e.g. "yue", "en", "zh-TW") into
+// `language`, which is left alone if the field is absent. False if the value
+// is not a plausible language code.
+inline bool parse_language(const std::string &msg, std::string &language) {
+  constexpr size_t MAX_LANGUAGE_LEN = 16;
+  return parse_name(msg, "language", MAX_LANGUAGE_LEN, language);
+}
+
+// The "tenant" field, naming the transcript rules to apply (asr_rules.h)
+inline bool parse_tenant(const std::string &msg, std::string &tenant) {
+  constexpr size_t MAX_TENANT_LEN = 64;
+  return parse_name(msg, "tenant", MAX_TENANT_LEN, tenant);
+}
+
+// Finds the contents of a string member `key` of a JSON object, at or after
+// `from`: [begin, end) between the quotes, still escaped. False if there is
+// none. Nested objects are searched too.
+inline bool find_string_member(std::string_view object, std::string_view key,
+                               size_t from, size_t &begin, size_t &end) {
+  size_t pos = from;
+  while ((pos = object.find(key, pos)) != std::string_view::npos) {
+    const size_t after = pos + key.size();
+    if (pos == 0 || object[pos - 1] != '"' || after >= object.size() ||
+        object[after] != '"') {
+      pos = after;
+      continue;
+    }
+    size_t at = object.find_first_not_of(" \t\r\n", after + 1);
+    if (at == std::string_view::npos || object[at] != ':')
+      return false;
+    at = object.find_first_not_of(" \t\r\n", at + 1);
+    if (at == std::string_view::npos || object[at] != '"')
+      return false;
+    begin = at + 1;
+    for (end = begin; end < object.size(); ++end) {
+      if (object[end] == '\\')
+        ++end;
+      else if (object[end] == '"')
+        return true;
+    }
+    return false;
+  }
+  return false;
+}
+
+// Appends `object` with "<key>":<value> added as its first member; `value`
+// is a JSON token.
+template <typename String>
+void append_with_member(String &out, std::string_view object,
+                        std::string_view key, std::string_view value) {
+  size_t brace = object.find('{');
+  if (brace == std::string_view::npos) {
+    out.append(object.data(), object.size());
+    return;
+  }
+  size_t next = object.find_first_not_of(" \t\r\n", brace + 1);
+  bool empty = next != std::string_view::npos && object[next] == '}';
+  out.reserve(out.size() + object.size() + key.size() + value.size() + 4);
+  out.append(object.data(), brace + 1);
+  out += '"';
+  out.append(key.data(), key.size());
+  out += "\":";
+  out.append(value.data(), value.size());
+  if (!empty)
+    out += ',';
+  out.append(object.data() + brace + 1, object.size() - brace - 1);
+}
+
+// Appends `object` with "id":<id> added as its first member, or unchanged
+// if `id` is empty.
+template <typename String>
+void append_tagged(String &out, std::string_view object, std::string_view id) {
+  if (id.empty())
+    out.append(object.data(), object.size());
+  else
+    append_with_member(out, object, "id", id);
+}
+
+// Appends a journaled result with its sequence number
+template <typename String>
+void append_sequenced(String &out, std::string_view object, uint64_t seq) {
+  char digits[20];
+  auto res = std::to_chars(digits, digits + sizeof(digits), seq);
+  append_with_member(out, object, "seq",
+                     std::string_view(digits, res.ptr - digits));
+}
+
+inline std::string tag_id(const std::string &object, const std::string &id) {
+  std::string tagged;
+  append_tagged(tagged, object, id);
+  return tagged;
+}
+
+// Greeting sent on connect; `session` is the journal token to resume with,
+// if journaling is on
+inline std::string initialized_message(const std::string &session) {
+  std::string msg =
+      "{\"type\":\"initialized\",\"server\":\"asr-mcp\",\"version\":\"1.0\"";
+  if (!session.empty())
+    msg += ",\"session\":\"" + session + "\"";
+  return msg + "}";
+}
+
+// Answer to a resume: the last journaled result and the audio offset to
+// continue from
+inline std::string resumed_message(const std::string &session, uint64_t seq,
+                                   uint64_t audio_ms) {
+  return "{\"type\":\"resumed\",\"session\":\"" + session +
+         "\",\"seq\":" + std::to_string(seq) +
+         ",\"audio_ms\":" + std::to_string(audio_ms) + "}";
+}
+
+// Responses that differ only in a trailing count, completed by format_count
+constexpr std::string_view AUDIO_RECEIVED =
+    "{\"type\":\"audio_received\",\"bytes\":";
+constexpr std::string_view AUDIO_SENT = "{\"type\":\"audio_sent\",\"bytes\":";
+
+// Replaces `out` with a template above completed with `count`
+template <typename String>
+void format_count(String &out, std::string_view prefix, uint64_t count) {
+  char digits[20];
+  auto res = std::to_chars(digits, digits + sizeof(digits), count);
+  out.assign(prefix.data(), prefix.size());
+  out.append(digits, static_cast<size_t>(res.ptr - digits));
+  out += '}';
+}
+
+// Cuts a byte stream that arrives in arbitrary pieces into its top-level
+// JSON objects, whatever separates them (newlines, SSE "data:" prefixes).
+class JsonObjectSplitter {
+public:
+  // Calls fn(object) for every object completed by `data`.
+  template <typename Fn> void feed(const char *data, size_t len, Fn &&fn) {
+    for (size_t i = 0; i < len; ++i) {
+      char c = data[i];
+      if (depth_ == 0) {
+        if (c != '{')
+          continue;
+        current_.clear();
+      }
+      current_ += c;
+      if (in_string_) {
+        if (escape_)
+          escape_ = false;
+        else if (c == '\\')
+          escape_ = true;
+        else if (c == '"')
+          in_string_ = false;
+      } else if (c == '"') {
+        in_string_ = true;
+      } else if (c == '{' || c == '[') {
+        ++depth_;
+      } else if ((c == '}' || c == ']') && --depth_ == 0) {
+        fn(current_);
+        current_.clear();
+      }
+    }
+  }
+
+private:
+  std::string current_;
+  int depth_ = 0;
+  bool in_string_ = false;
+  bool escape_ = false;
+};
+
+// Offset just past the JSON object or array starting at `pos`, or npos if
+// it does not end in `json`.
+inline size_t value_end(std::string_view json, size_t pos) {
+  int depth = 0;
+  bool in_string = false;
+  for (size_t i = pos; i < json.size(); ++i) {
+    const char c = json[i];
+    if (in_string) {
+      if (c == '\\')
+        ++i;
+      else if (c == '"')
+        in_string = false;
+    } else if (c == '"') {
+      in_string = true;
+    } else if (c == '{' || c == '[') {
+      ++depth;
+    } else if ((c == '}' || c == ']') && --depth == 0) {
+      return i + 1;
+    }
+  }
+  return std::string_view::npos;
+}
+
+// Offset of the value of the member `key` of the JSON object starting at
+// `pos`, not looking into nested objects and arrays, or npos if it has none.
+inline size_t find_top_level_member(std::string_view json, std::string_view key,
+                                    size_t pos = 0) {
+  auto string_end = [&](size_t at) { // Just past the string opening at `at`
+    for (++at; at < json.size(); ++at) {
+      if (json[at] == '\\')
+        ++at;
+      else if (json[at] == '"')
+        return at + 1;
+    }
+    return std::string_view::npos;
+  };
+  pos = json.find_first_not_of(" \t\r\n", pos);
+  if (pos == std::string_view::npos || json[pos] != '{')
+    return std::string_view::npos;
+  ++pos;
+  while (true) {
+    pos = json.find_first_not_of(" \t\r\n,", pos);
+    if (pos == std::string_view::npos || json[pos] != '"')
+      return std::string_view::npos; // End of the object, or malformed
+    const size_t name_end = string_end(pos);
+    if (name_end == std::string_view::npos)
+      return std::string_view::npos;
+    const std::string_view name = json.substr(pos + 1, name_end - pos - 2);
+    pos = json.find_first_not_of(" \t\r\n", name_end);
+    if (pos == std::string_view::npos || json[pos] != ':')
+      return std::string_view::npos;
+    pos = json.find_first_not_of(" \t\r\n", pos + 1);
+    if (pos == std::string_view::npos)
+      return std::string_view::npos;
+    if (name == key)
+      return pos;
+    if (json[pos] == '"')
+      pos = string_end(pos);
+    else if (json[pos] == '{' || json[pos] == '[')
+      pos = value_end(json, pos);
+    else
+      pos = json.find_first_of(",}", pos);
+    if (pos == std::string_view::npos)
+      return std::string_view::npos;
+  }
+}
+
+// First numeric member `key` of `object`
+inline bool find_number_member(std::string_view object, std::string_view key,
+                               double &out) {
+  std::string needle = "\"";
+  needle.append(key);
+  needle += "\"";
+  size_t pos = object.find(needle);
+  if (pos == std::string_view::npos)
+    return false;
+  pos = object.find_first_not_of(" \t\r\n", pos + needle.size());
+  if (pos == std::string_view::npos || object[pos] != ':')
+    return false;
+  const std::string number(object.substr(pos + 1, 32));
+  char *end = nullptr;
+  out = strtod(number.c_str(), &end);
+  return end != number.c_str();
+}
+
+// A timed piece of a transcript (seconds from the start of the audio)
+struct Segment {
+  double start = 0;
+  double end = 0;
+  std::string text;
+};
+
+// An object with "start", "end" and "text", such as a verbose_json segment.
+// False if any is missing.
+inline bool parse_segment(std::string_view object, Segment &segment) {
+  size_t begin, end;
+  if (!find_number_member(object, "start", segment.start) ||
+      !find_number_member(object, "end", segment.end) ||
+      !find_string_member(object, "text", 0, begin, end))
+    return false;
+  segment.start = std::max(0.0, segment.start);
+  segment.end = std::max(segment.start, segment.end);
+  return json_unescape(std::string(object), begin - 1, segment.text);
+}
+
+// Calls fn(segment) for each entry of a verbose_json response's "segments"
+// array. False if `response` has no such array.
+template <typename Fn>
+bool for_each_segment(const std::string &response, Fn &&fn) {
+  size_t pos = response.find("\"segments\"");
+  if (pos == std::string::npos ||
+      (pos = response.find_first_not_of(" \t\r\n:", pos + 10)) ==
+          std::string::npos ||
+      response[pos] != '[')
+    return false;
+  const size_t array_end = value_end(response, pos);
+  if (array_end == std::string::npos)
+    return false;
+  JsonObjectSplitter splitter;
+  Segment segment;
+  splitter.feed(response.data() + pos + 1, array_end - pos - 2,
+                [&](const std::string &object) {
+                  if (parse_segment(object, segment))
+                    fn(segment);
+                });
+  return true;
+}
+
+// Upstream finals are cumulative: each repeats the previous final as a
+// prefix. Returns only the new suffix of `text`.
+inline std::string strip_duplicate_prefix(const std::string &last,
+                                          const std::string &text) {
+  if (!last.empty() && text.length() >= last.length() &&
+      text.substr(0, last.length()) == last) {
+    return text.substr(last.length());
+  }
+  return text;
+}
+
+} // namespace asr_protocol
@@ -0,0 +1,440 @@
+// Per-tenant rewriting of transcripts: hotword substitution (vocabulary the
+// model keeps getting wrong) and redaction of phone numbers, ID numbers and
+// the like, before results leave the server.
+//
+// ASR_RULES_DIR holds one file per tenant, <tenant>.rules; clients pick
+// theirs with "tenant" on transcribe or configure_audio, and sessions start
+// with "default" if there is such a file. One rule per line, fields
+// separated by tabs (aligned here), '#' starting a comment line:
+//
+//   replace  chat g p t   ChatGPT
+//   replace  嘅士         的士
+//   redact   ####~####    [PHONE]
+//   redact   @######(#)   [HKID]
+//
+// A replace rule substitutes a phrase. ASCII letters match either case, and
+// a phrase that begins or ends with a letter or digit only matches as whole
+// words. A redact rule replaces text matching a pattern, in which '#' is a
+// digit, '@' an ASCII letter, '~' an optional space or hyphen and '\' takes
+// the next character literally; anything else stands for itself. Patterns
+// only match between word boundaries. Where matches overlap, the leftmost
+// wins, then the longest.
+//
+// The phrases are compiled into an Aho-Corasick automaton, so rewriting is
+// a single pass over the UTF-8 bytes whatever the number of rules (after a
+// replacement it backs up by at most the longest phrase). Patterns are only
+// tried where their first character could start. A tenant's file is
+// checked for changes at most once a second and recompiled when it has
+// changed; results in flight keep the rules they started with.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <vector>
+
+#include "asr_log.h"
+#include "asr_protocol.h"
+
+namespace asr_rules {
+
+constexpr auto RELOAD_CHECK_INTERVAL = std::chrono::seconds(1);
+
+inline bool is_word_byte(uint8_t c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+         (c >= 'A' && c <= 'Z');
+}
+
+inline uint8_t fold(uint8_t c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<uint8_t>(c + 32) : c;
+}
+
+// One tenant's rules, compiled. Immutable once built.
+class Rules {
+public:
+  // Compiles rules text; bad lines are logged and skipped
+  static std::shared_ptr<const Rules> compile(std::string_view text,
+                                              const std::string &name) {
+    std::shared_ptr<Rules> rules(new Rules());
+    std::vector<std::pair<std::string, uint32_t>> phrases;
+    size_t pos = 0;
+    for (int line_no = 1; pos < text.size(); ++line_no) {
+      size_t end = text.find('\n', pos);
+      if (end == std::string_view::npos)
+        end = text.size();
+      std::string_view line = text.substr(pos, end - pos);
+      pos = end + 1;
+      if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+      if (line.empty() || line[0] == '#')
+        continue;
+
+      const size_t tab1 = line.find('\t');
+      const size_t tab2 = tab1 == std::string_view::npos
+                              ? tab1
+                              : line.find('\t', tab1 + 1);
+      if (tab2 == std::string_view::npos || tab2 == tab1 + 1) {
+        ASR_LOG_WARN("Rules %s:%d: expected kind, match and replacement",
+                     name.c_str(), line_no);
+        continue;
+      }
+      const std::string_view kind = line.substr(0, tab1);
+      const std::string_view match = line.substr(tab1 + 1, tab2 - tab1 - 1);
+      const uint32_t replacement =
+          rules->add_replacement(line.substr(tab2 + 1));
+      if (kind == "replace") {
+        phrases.emplace_back(std::string(match), replacement);
+      } else if (kind == "redact") {
+        if (!rules->add_pattern(match, replacement))
+          ASR_LOG_WARN("Rules %s:%d: bad pattern", name.c_str(), line_no);
+      } else {
+        ASR_LOG_WARN("Rules %s:%d: unknown rule \"%.*s\"", name.c_str(),
+                     line_no, static_cast<int>(kind.size()), kind.data());
+      }
+    }
+    rules->build_automaton(phrases);
+    ASR_LOG_INFO("Rules %s: %zu phrases (%zu states), %zu patterns",
+                 name.c_str(), phrases.size(), rules->states_.size(),
+                 rules->patterns_.size());
+    return rules;
+  }
+
+  // Appends `in` to `out` with every match replaced. With `json`, `in` is
+  // the contents of a JSON string and replacements go in escaped.
+  template <typename String>
+  void apply(std::string_view in, String &out, bool json) const {
+    const size_t n = in.size();
+    size_t copied = 0; // Bytes of `in` already in `out`
+    size_t from = 0;   // Where the search (re)starts
+    while (from < n) {
+      Match best;
+      uint32_t s = ROOT;
+      for (size_t j = from; j < n; ++j) {
+        // Nothing yet to come can start at or before best.start
+        if (best.found() && j - states_[s].depth > best.start)
+          break;
+        if (!best.found())
+          match_patterns(in, j, best);
+        s = step(s, fold(static_cast<uint8_t>(in[j])));
+        for (uint32_t o = states_[s].terminal ? s : states_[s].dict; o != ROOT;
+             o = states_[o].dict) {
+          const State &st = states_[o];
+          const size_t start = j + 1 - st.depth;
+          if ((st.bounded_start && !boundary_before(in, start)) ||
+              (st.bounded_end && !boundary_after(in, j + 1)))
+            continue;
+          if (!best.found() || start < best.start ||
+              (start == best.start && j + 1 > best.end))
+            best = {start, j + 1, st.replacement};
+          break; // The rest of the chain starts later
+        }
+      }
+      if (!best.found())
+        break;
+      out.append(in.data() + copied, best.start - copied);
+      const std::string &r = json ? escaped_[best.replacement]
+                                  : replacements_[best.replacement];
+      out.append(r.data(), r.size());
+      copied = from = best.end;
+    }
+    out.append(in.data() + copied, n - copied);
+  }
+
+private:
+  static constexpr uint32_t ROOT = 0;
+  static constexpr uint32_t NONE = UINT32_MAX;
+
+  struct State {
+    uint32_t edges = 0; // First edge in labels_/targets_
+    uint32_t edge_count = 0;
+    uint32_t fail = ROOT;
+    uint32_t dict = ROOT; // Nearest terminal state down the fail chain
+    uint32_t depth = 0;
+    uint32_t replacement = NONE;
+    bool terminal = false;
+    bool bounded_start = false;
+    bool bounded_end = false;
+  };
+
+  enum class Token : uint8_t { Digit, Letter, Separator, Literal };
+
+  struct Pattern {
+    std::vector<std::pair<Token, uint8_t>> tokens;
+    uint32_t replacement;
+  };
+
+  struct Match {
+    size_t start = 0;
+    size_t end = 0;
+    uint32_t replacement = NONE;
+    bool found() const { return replacement != NONE; }
+  };
+
+  Rules() = default;
+
+  uint32_t add_replacement(std::string_view text) {
+    replacements_.emplace_back(text);
+    escaped_.push_back(asr_protocol::json_escape(replacements_.back()));
+    return static_cast<uint32_t>(replacements_.size() - 1);
+  }
+
+  bool add_pattern(std::string_view text, uint32_t replacement) {
+    Pattern p{{}, replacement};
+    for (size_t i = 0; i < text.size(); ++i) {
+      const uint8_t c = static_cast<uint8_t>(text[i]);
+      if (c == '\\' && i + 1 < text.size())
+        p.tokens.emplace_back(Token::Literal, text[++i]);
+      else if (c == '#')
+        p.tokens.emplace_back(Token::Digit, 0);
+      else if (c == '@')
+        p.tokens.emplace_back(Token::Letter, 0);
+      else if (c == '~')
+        p.tokens.emplace_back(Token::Separator, 0);
+      else
+        p.tokens.emplace_back(Token::Literal, c);
+    }
+    // The first token decides where the pattern is tried
+    if (p.tokens.empty() || p.tokens[0].first == Token::Separator)
+      return false;
+    for (unsigned c = 0; c < 256; ++c) {
+      if (accepts(p.tokens[0], static_cast<uint8_t>(c)))
+        starts_[c] = true;
+    }
+    patterns_.push_back(std::move(p));
+    return true;
+  }
+
+  static bool accepts(std::pair<Token, uint8_t> token, uint8_t c) {
+    switch (token.first) {
+    case Token::Digit:
+      return c >= '0' && c <= '9';
+    case Token::Letter:
+      return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    case Token::Separator:
+      return c == ' ' || c == '-';
+    case Token::Literal:
+      return c == token.second;
+    }
+    return false;
+  }
+
+  static bool boundary_before(std::string_view in, size_t at) {
+    return at == 0 || !is_word_byte(static_cast<uint8_t>(in[at - 1]));
+  }
+
+  static bool boundary_after(std::string_view in, size_t at) {
+    return at == in.size() || !is_word_byte(static_cast<uint8_t>(in[at]));
+  }
+
+  // Takes the longest pattern match starting at `at` into `best`
+  void match_patterns(std::string_view in, size_t at, Match &best) const {
+    if (!starts_[static_cast<uint8_t>(in[at])] || !boundary_before(in, at))
+      return;
+    for (const Pattern &p : patterns_) {
+      size_t i = at;
+      bool matched = true;
+      for (const auto &token : p.tokens) {
+        const bool fits =
+            i < in.size() && accepts(token, static_cast<uint8_t>(in[i]));
+        if (fits)
+          ++i;
+        else if (token.first != Token::Separator) {
+          matched = false;
+          break;
+        }
+      }
+      if (matched && boundary_after(in, i) && (!best.found() || i > best.end))
+        best = {at, i, p.replacement};
+    }
+  }
+
+  // The child of `s` on `c`, or NONE
+  uint32_t child(uint32_t s, uint8_t c) const {
+    const State &st = states_[s];
+    for (uint32_t e = st.edges; e < st.edges + st.edge_count; ++e) {
+      if (labels_[e] == c)
+        return targets_[e];
+      if (labels_[e] > c)
+        break;
+    }
+    return NONE;
+  }
+
+  uint32_t step(uint32_t s, uint8_t c) const {
+    while (s != ROOT) {
+      const uint32_t t = child(s, c);
+      if (t != NONE)
+        return t;
+      s = states_[s].fail;
+    }
+    return root_[c];
+  }
+
+  void build_automaton(std::vector<std::pair<std::string, uint32_t>> &phrases) {
+    // Trie, its children in per-state maps while building
+    std::vector<std::map<uint8_t, uint32_t>> children(1);
+    states_.assign(1, State());
+    for (const auto &[phrase, replacement] : phrases) {
+      if (phrase.empty())
+        continue;
+      uint32_t s = ROOT;
+      for (char ch : phrase) {
+        const uint8_t c = fold(static_cast<uint8_t>(ch));
+        auto it = children[s].find(c);
+        if (it == children[s].end()) {
+          const uint32_t t = static_cast<uint32_t>(states_.size());
+          children[s][c] = t;
+          children.emplace_back();
+          states_.push_back(State());
+          states_[t].depth = states_[s].depth + 1;
+          s = t;
+        } else {
+          s = it->second;
+        }
+      }
+      State &st = states_[s];
+      if (st.terminal)
+        continue; // The first rule for a phrase wins
+      st.terminal = true;
+      st.replacement = replacement;
+      st.bounded_start = is_word_byte(static_cast<uint8_t>(phrase.front()));
+      st.bounded_end = is_word_byte(static_cast<uint8_t>(phrase.back()));
+    }
+
+    // Flatten the edges and link the states breadth first, so that all a
+    // fail link can lead to is already flattened when step() follows it
+    root_.fill(ROOT);
+    std::vector<uint32_t> queue;
+    for (const auto &[c, t] : children[ROOT]) {
+      root_[c] = t;
+      queue.push_back(t);
+    }
+    for (size_t q = 0; q < queue.size(); ++q) {
+      const uint32_t s = queue[q];
+      states_[s].edges = static_cast<uint32_t>(labels_.size());
+      states_[s].edge_count = static_cast<uint32_t>(children[s].size());
+      for (const auto &[c, t] : children[s]) {
+        labels_.push_back(c);
+        targets_.push_back(t);
+      }
+      for (const auto &[c, t] : children[s]) {
+        const uint32_t f = step(states_[s].fail, c);
+        states_[t].fail = f;
+        states_[t].dict = states_[f].terminal ? f : states_[f].dict;
+        queue.push_back(t);
+      }
+    }
+  }
+
+  std::vector<State> states_;
+  std::vector<uint8_t> labels_;   // Edges of each state, sorted by label
+  std::vector<uint32_t> targets_;
+  std::array<uint32_t, 256> root_{}; // The root's transitions, dense
+  std::vector<Pattern> patterns_;
+  std::array<bool, 256> starts_{}; // Bytes a pattern can start with
+  std::vector<std::string> replacements_;
+  std::vector<std::string> escaped_; // The same, JSON-escaped
+};
+
+// A tenant's rules file, recompiled when it changes.
+class TenantRules {
+public:
+  TenantRules(std::string name, std::string path)
+      : name_(std::move(name)), path_(std::move(path)) {}
+
+  // The rules as of the last check of the file (at most a second ago)
+  std::shared_ptr<const Rules> current() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto now = std::chrono::steady_clock::now();
+    if (!rules_ || now - checked_ >= RELOAD_CHECK_INTERVAL) {
+      checked_ = now;
+      reload_locked();
+    }
+    return rules_;
+  }
+
+private:
+  // Keeps the rules it has if the file cannot be read
+  void reload_locked() {
+    struct stat st;
+    if (stat(path_.c_str(), &st) != 0) {
+      if (!rules_)
+        rules_ = Rules::compile({}, name_);
+      return;
+    }
+    if (rules_ && st.st_ino == ino_ && st.st_size == size_ &&
+        st.st_mtim.tv_sec == mtime_.tv_sec &&
+        st.st_mtim.tv_nsec == mtime_.tv_nsec)
+      return;
+    std::ifstream file(path_, std::ios::binary);
+    if (!file) {
+      ASR_LOG_WARN("Rules %s unreadable", path_.c_str());
+      if (!rules_)
+        rules_ = Rules::compile({}, name_);
+      return;
+    }
+    std::ostringstream text;
+    text << file.rdbuf();
+    rules_ = Rules::compile(text.str(), name_);
+    ino_ = st.st_ino;
+    size_ = st.st_size;
+    mtime_ = st.st_mtim;
+  }
+
+  const std::string name_;
+  const std::string path_;
+  std::mutex mutex_;
+  std::shared_ptr<const Rules> rules_;
+  std::chrono::steady_clock::time_point checked_;
+  ino_t ino_ = 0;
+  off_t size_ = 0;
+  timespec mtime_{};
+};
+
+// The tenants in ASR_RULES_DIR.
+class Library {
+public:
+  static Library &instance() {
+    static Library library(std::getenv("ASR_RULES_DIR"));
+    return library;
+  }
+
+  explicit Library(const char *dir) : dir_(dir ? dir : "") {}
+
+  bool enabled() const { return !dir_.empty(); }
+
+  // The rules of `tenant` (a name as accepted by parse_tenant), or null if
+  // it has no rules file. New files are picked up as they appear.
+  std::shared_ptr<TenantRules> find(const std::string &tenant) {
+    if (dir_.empty())
+      return nullptr;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = tenants_.find(tenant);
+    if (it != tenants_.end())
+      return it->second;
+    const std::string path = dir_ + "/" + tenant + ".rules";
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+      return nullptr;
+    auto rules = std::make_shared<TenantRules>(tenant, path);
+    tenants_.emplace(tenant, rules);
+    return rules;
+  }
+
+private:
+  const std::string dir_;
+  std::mutex mutex_;
+  std::map<std::string, std::shared_ptr<TenantRules>> tenants_;
+};
+
+} // namespace asr_rules
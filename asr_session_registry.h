@@ -0,0 +1,169 @@
+// Slot-indexed registry of live client sessions.
+//
+// Sessions live in a vector of slots with an intrusive free list, so
+// registering and unregistering are O(1) and never scan. A session
+// unregisters itself (Registration::release) when its client goes away; the
+// owning pointer moves to a reaper thread which runs the destructor (thread
+// joins, socket close, buffer frees) outside the registry lock. Memory
+// therefore tracks live clients instead of waiting for a periodic sweep.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace asr_registry {
+
+template <typename Session> class SessionRegistry {
+public:
+  // Token a session uses to unregister itself; stale tokens are ignored.
+  class Registration {
+  public:
+    Registration() = default;
+
+    Session *session() const { return session_; }
+
+    void release() const {
+      if (registry_)
+        registry_->release(index_, generation_);
+    }
+
+  private:
+    friend class SessionRegistry;
+    Registration(SessionRegistry *registry, Session *session, uint32_t index,
+                 uint32_t generation)
+        : registry_(registry), session_(session), index_(index),
+          generation_(generation) {}
+
+    SessionRegistry *registry_ = nullptr;
+    Session *session_ = nullptr;
+    uint32_t index_ = 0;
+    uint32_t generation_ = 0;
+  };
+
+  SessionRegistry() : reaper_(&SessionRegistry::reap_loop, this) {}
+
+  ~SessionRegistry() { shutdown(); }
+
+  SessionRegistry(const SessionRegistry &) = delete;
+  SessionRegistry &operator=(const SessionRegistry &) = delete;
+
+  Registration add(std::unique_ptr<Session> session) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint32_t index;
+    if (free_head_ != NO_SLOT) {
+      index = free_head_;
+      free_head_ = slots_[index].next_free;
+    } else {
+      index = static_cast<uint32_t>(slots_.size());
+      slots_.emplace_back();
+    }
+    Slot &slot = slots_[index];
+    slot.session = std::move(session);
+    slot.next_free = NO_SLOT;
+    ++live_;
+    return Registration(this, slot.session.get(), index, slot.generation);
+  }
+
+  // Visits every live session under the registry lock; `fn` must not
+  // register or release sessions.
+  template <typename Fn> void for_each(Fn &&fn) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &slot : slots_) {
+      if (slot.session)
+        fn(*slot.session);
+    }
+  }
+
+  size_t live() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return live_;
+  }
+
+  size_t reaping() const {
+    std::lock_guard<std::mutex> lock(reap_mutex_);
+    return reap_queue_.size();
+  }
+
+  // Destroys every session (live ones included) and stops the reaper.
+  void shutdown() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (uint32_t i = 0; i < slots_.size(); ++i) {
+        if (slots_[i].session)
+          vacate(i);
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(reap_mutex_);
+      stopping_ = true;
+    }
+    reap_cv_.notify_one();
+    if (reaper_.joinable())
+      reaper_.join();
+  }
+
+private:
+  static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+  struct Slot {
+    std::unique_ptr<Session> session;
+    uint32_t generation = 0;
+    uint32_t next_free = NO_SLOT;
+  };
+
+  void release(uint32_t index, uint32_t generation) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index >= slots_.size() || slots_[index].generation != generation ||
+        !slots_[index].session) {
+      return;
+    }
+    vacate(index);
+  }
+
+  // Must hold mutex_. Hands the session to the reaper and frees the slot.
+  void vacate(uint32_t index) {
+    Slot &slot = slots_[index];
+    {
+      std::lock_guard<std::mutex> lock(reap_mutex_);
+      reap_queue_.push_back(std::move(slot.session));
+    }
+    reap_cv_.notify_one();
+    ++slot.generation;
+    slot.next_free = free_head_;
+    free_head_ = index;
+    --live_;
+  }
+
+  void reap_loop() {
+    std::unique_lock<std::mutex> lock(reap_mutex_);
+    while (true) {
+      reap_cv_.wait(lock, [this] { return stopping_ || !reap_queue_.empty(); });
+      if (reap_queue_.empty() && stopping_)
+        break;
+      std::unique_ptr<Session> doomed = std::move(reap_queue_.front());
+      reap_queue_.pop_front();
+      lock.unlock();
+      doomed.reset();
+      lock.lock();
+    }
+  }
+
+  mutable std::mutex mutex_;
+  std::vector<Slot> slots_;
+  uint32_t free_head_ = NO_SLOT;
+  size_t live_ = 0;
+
+  mutable std::mutex reap_mutex_;
+  std::condition_variable reap_cv_;
+  std::deque<std::unique_ptr<Session>> reap_queue_;
+  bool stopping_ = false;
+  std::thread reaper_;
+};
+
+} // namespace asr_registry
@@ -0,0 +1,426 @@
+// Sampled span tracing for the ASR MCP servers.
+//
+// Set ASR_TRACE_FILE to enable ("%p" expands to the pid). Each session is
+// sampled on creation with probability ASR_TRACE_SAMPLE (default 0.1, 1 traces
+// everything); every span of a sampled session is recorded, so a slow request
+// can be followed end to end. ASR_TRACE_FORMAT selects the output:
+//
+//   chrome  Chrome trace event JSON (default); open in chrome://tracing or
+//           https://ui.perfetto.dev. Each session is shown as a process.
+//   otlp    OTLP/JSON, one TracesData object per line (the OpenTelemetry
+//           collector's file format). One trace per session; stage spans are
+//           children of their request span.
+//
+// Spans are written like log records: into a per-thread SPSC ring (see
+// asr_log.h) that a background thread drains to the file. Spans of an
+// unsampled session cost a branch and no clock reads.
+//
+// Usage:
+//   asr_trace::Context session = asr_trace::begin_session();
+//   asr_trace::Span request("stream_audio", session.for_request(++requests));
+//   { asr_trace::Span decode("base64_decode", request.context()); ... }
+
+#pragma once
+
+#include "asr_log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdarg>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
+
+namespace asr_trace {
+
+constexpr size_t RING_SLOTS = 1024; // Per thread, power of two
+constexpr int DRAIN_INTERVAL_MS = 50;
+constexpr double DEFAULT_SAMPLE = 0.1;
+
+enum class Format : uint8_t { Chrome, Otlp };
+
+// Where a span belongs: its session, the client request it serves and the
+// span it is nested in.
+struct Context {
+  uint32_t session = 0;
+  uint32_t request = 0;
+  uint64_t parent = 0;
+  bool sampled = false;
+
+  // Root context of request number `id` within this session.
+  Context for_request(uint32_t id) const {
+    Context ctx = *this;
+    ctx.request = id;
+    ctx.parent = 0;
+    return ctx;
+  }
+};
+
+struct SpanRecord {
+  const char *name; // String literal
+  uint64_t start_ns; // Monotonic, since tracer start
+  uint64_t end_ns;
+  uint64_t span_id;
+  uint64_t parent_id;
+  uint32_t session;
+  uint32_t request;
+  uint32_t thread_id;
+};
+
+class Ring : public asr_log::SlotRing<SpanRecord, RING_SLOTS> {
+public:
+  explicit Ring(uint32_t id) : thread_id_(id) {}
+
+  uint32_t thread_id() const { return thread_id_; }
+
+  // Unique per process: thread id in the top bits, sequence below.
+  uint64_t next_span_id() {
+    return (static_cast<uint64_t>(thread_id_) << 40) | ++span_seq_;
+  }
+
+private:
+  uint32_t thread_id_;
+  uint64_t span_seq_ = 0;
+};
+
+class Tracer {
+public:
+  static Tracer &instance() {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  bool enabled() const { return file_ != nullptr; }
+
+  Context begin_session() {
+    Context ctx;
+    if (!enabled())
+      return ctx;
+    ctx.session = next_session_.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(rng_mutex_);
+    ctx.sampled = sample_dist_(rng_) < sample_;
+    return ctx;
+  }
+
+  uint64_t now_ns() const {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_)
+            .count());
+  }
+
+  uint64_t new_span_id() { return local_ring()->next_span_id(); }
+
+  // Records a finished span; `span_id` from new_span_id(), or 0 to assign one.
+  void record(const char *name, const Context &ctx, uint64_t start_ns,
+              uint64_t end_ns, uint64_t span_id = 0) {
+    Ring *ring = local_ring();
+    SpanRecord *rec = ring->reserve();
+    if (!rec)
+      return;
+    rec->name = name;
+    rec->start_ns = start_ns;
+    rec->end_ns = end_ns;
+    rec->span_id = span_id ? span_id : ring->next_span_id();
+    rec->parent_id = ctx.parent;
+    rec->session = ctx.session;
+    rec->request = ctx.request;
+    rec->thread_id = ring->thread_id();
+    ring->commit();
+  }
+
+  void flush() {
+    std::lock_guard<std::mutex> lock(drain_mutex_);
+    drain_once();
+  }
+
+  ~Tracer() {
+    if (!file_)
+      return;
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+      running_ = false;
+    }
+    wake_.notify_one();
+    if (writer_.joinable())
+      writer_.join();
+    flush();
+    if (format_ == Format::Chrome)
+      fputs("\n]\n", file_);
+    fclose(file_);
+  }
+
+private:
+  Tracer()
+      : start_(std::chrono::steady_clock::now()),
+        wall_start_ns_(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch())
+                .count())),
+        rng_(std::random_device{}()), sample_dist_(0.0, 1.0) {
+    const char *env_path = std::getenv("ASR_TRACE_FILE");
+    if (!env_path || !*env_path)
+      return;
+    std::string path(env_path);
+    size_t pid_pos = path.find("%p");
+    if (pid_pos != std::string::npos)
+      path.replace(pid_pos, 2, std::to_string(getpid()));
+
+    const char *env_format = std::getenv("ASR_TRACE_FORMAT");
+    format_ = env_format && strcmp(env_format, "otlp") == 0 ? Format::Otlp
+                                                            : Format::Chrome;
+    const char *env_sample = std::getenv("ASR_TRACE_SAMPLE");
+    sample_ = env_sample && *env_sample ? std::atof(env_sample) : DEFAULT_SAMPLE;
+
+    file_ = fopen(path.c_str(), "w");
+    if (!file_) {
+      ASR_LOG_WARN("Tracing disabled: cannot open %s", path.c_str());
+      return;
+    }
+    if (format_ == Format::Chrome)
+      fputs("[\n", file_);
+    ASR_LOG_INFO("Tracing %.0f%% of sessions to %s (%s)", sample_ * 100,
+                 path.c_str(), format_ == Format::Otlp ? "otlp" : "chrome");
+    writer_ = std::thread(&Tracer::write_loop, this);
+  }
+
+  Tracer(const Tracer &) = delete;
+  Tracer &operator=(const Tracer &) = delete;
+
+  struct LocalHandle {
+    std::shared_ptr<Ring> ring;
+    ~LocalHandle() {
+      if (ring)
+        ring->retired.store(true, std::memory_order_release);
+    }
+  };
+
+  Ring *local_ring() {
+    thread_local LocalHandle handle;
+    if (!handle.ring) {
+      handle.ring = std::make_shared<Ring>(
+          next_thread_id_.fetch_add(1, std::memory_order_relaxed));
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      rings_.push_back(handle.ring);
+    }
+    return handle.ring.get();
+  }
+
+  void write_loop() {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    while (running_) {
+      wake_.wait_for(lock, std::chrono::milliseconds(DRAIN_INTERVAL_MS));
+      lock.unlock();
+      flush();
+      lock.lock();
+    }
+  }
+
+  void drain_once() {
+    std::vector<std::shared_ptr<Ring>> snapshot;
+    {
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      snapshot = rings_;
+    }
+
+    out_.clear();
+    size_t spans = 0;
+    for (auto &ring : snapshot) {
+      bool retired = ring->retired.load(std::memory_order_acquire);
+      spans += ring->drain([&](const SpanRecord &rec) {
+        if (format_ == Format::Chrome)
+          append_chrome(rec);
+        else
+          append_otlp(rec);
+      });
+      if (uint64_t dropped = ring->take_dropped()) {
+        ASR_LOG_WARN("Tracer dropped %llu spans",
+                     static_cast<unsigned long long>(dropped));
+      }
+      if (retired && ring->empty()) {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        for (auto it = rings_.begin(); it != rings_.end(); ++it) {
+          if (*it == ring) {
+            rings_.erase(it);
+            break;
+          }
+        }
+      }
+    }
+    if (spans == 0)
+      return;
+    if (format_ == Format::Otlp)
+      finish_otlp_batch();
+    fwrite(out_.data(), 1, out_.size(), file_);
+    fflush(file_);
+  }
+
+  __attribute__((format(printf, 2, 3))) void appendf(const char *fmt, ...) {
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n > 0)
+      out_.append(buf, std::min(static_cast<size_t>(n), sizeof(buf) - 1));
+  }
+
+  // Complete ("X") events with microsecond timestamps; pid is the session
+  // so each session gets its own track group, named on first use.
+  void append_chrome(const SpanRecord &rec) {
+    if (chrome_sessions_.insert(rec.session).second) {
+      appendf("%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,"
+              "\"args\":{\"name\":\"session %u\"}}",
+              first_event_ ? "" : ",\n", rec.session, rec.session);
+      first_event_ = false;
+    }
+    appendf("%s{\"name\":\"%s\",\"cat\":\"asr\",\"ph\":\"X\",\"ts\":%.3f,"
+            "\"dur\":%.3f,\"pid\":%u,\"tid\":%u,\"args\":{\"request\":%u}}",
+            first_event_ ? "" : ",\n", rec.name, rec.start_ns / 1000.0,
+            (rec.end_ns - rec.start_ns) / 1000.0, rec.session, rec.thread_id,
+            rec.request);
+    first_event_ = false;
+  }
+
+  void append_otlp(const SpanRecord &rec) {
+    if (otlp_spans_ == 0) {
+      appendf("{\"resourceSpans\":[{\"resource\":{\"attributes\":[{\"key\":"
+              "\"service.name\",\"value\":{\"stringValue\":\"%s\"}}]},"
+              "\"scopeSpans\":[{\"scope\":{\"name\":\"asr_trace\"},"
+              "\"spans\":[",
+              program_invocation_short_name);
+    }
+    appendf("%s{\"traceId\":\"%08x%08x%016llx\",\"spanId\":\"%016llx\",",
+            otlp_spans_ ? "," : "", static_cast<unsigned>(getpid()),
+            static_cast<unsigned>(wall_start_ns_ / 1000000000),
+            static_cast<unsigned long long>(rec.session),
+            static_cast<unsigned long long>(rec.span_id));
+    if (rec.parent_id)
+      appendf("\"parentSpanId\":\"%016llx\",",
+              static_cast<unsigned long long>(rec.parent_id));
+    appendf("\"name\":\"%s\",\"kind\":1,\"startTimeUnixNano\":\"%llu\","
+            "\"endTimeUnixNano\":\"%llu\",\"attributes\":["
+            "{\"key\":\"asr.session\",\"value\":{\"intValue\":\"%u\"}},"
+            "{\"key\":\"asr.request\",\"value\":{\"intValue\":\"%u\"}},"
+            "{\"key\":\"thread.id\",\"value\":{\"intValue\":\"%u\"}}]}",
+            rec.name,
+            static_cast<unsigned long long>(wall_start_ns_ + rec.start_ns),
+            static_cast<unsigned long long>(wall_start_ns_ + rec.end_ns),
+            rec.session, rec.request, rec.thread_id);
+    ++otlp_spans_;
+  }
+
+  void finish_otlp_batch() {
+    out_ += "]}]}]}\n";
+    otlp_spans_ = 0;
+  }
+
+  const std::chrono::steady_clock::time_point start_;
+  const uint64_t wall_start_ns_;
+  FILE *file_ = nullptr;
+  Format format_ = Format::Chrome;
+  double sample_ = DEFAULT_SAMPLE;
+  std::atomic<uint32_t> next_session_{1};
+  std::atomic<uint32_t> next_thread_id_{1};
+
+  std::mutex rng_mutex_;
+  std::mt19937 rng_;
+  std::uniform_real_distribution<double> sample_dist_;
+
+  std::mutex rings_mutex_;
+  std::vector<std::shared_ptr<Ring>> rings_;
+
+  // Writer state, guarded by drain_mutex_
+  std::mutex drain_mutex_;
+  std::string out_;
+  bool first_event_ = true;
+  std::unordered_set<uint32_t> chrome_sessions_;
+  size_t otlp_spans_ = 0;
+
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  bool running_ = true;
+  std::thread writer_;
+};
+
+inline Context begin_session() { return Tracer::instance().begin_session(); }
+
+// Times a scope. Children created from context() nest under this span.
+class Span {
+public:
+  Span(const char *name, const Context &ctx) : name_(name), ctx_(ctx) {
+    if (!ctx_.sampled)
+      return;
+    Tracer &tracer = Tracer::instance();
+    id_ = tracer.new_span_id();
+    start_ns_ = tracer.now_ns();
+  }
+
+  // Starts the span at an earlier now_ns() reading, for work that began
+  // before its context was known (e.g. the recv of a request).
+  Span(const char *name, const Context &ctx, uint64_t start_ns)
+      : name_(name), ctx_(ctx) {
+    if (!ctx_.sampled)
+      return;
+    id_ = Tracer::instance().new_span_id();
+    start_ns_ = start_ns;
+  }
+
+  ~Span() { end(); }
+
+  Span(const Span &) = delete;
+  Span &operator=(const Span &) = delete;
+
+  // Context for spans nested in this one.
+  Context context() const {
+    Context child = ctx_;
+    if (ctx_.sampled)
+      child.parent = id_;
+    return child;
+  }
+
+  // Ends the span early; later calls (and the destructor) do nothing.
+  void end() {
+    if (!ctx_.sampled || ended_)
+      return;
+    ended_ = true;
+    Tracer &tracer = Tracer::instance();
+    tracer.record(name_, ctx_, start_ns_, tracer.now_ns(), id_);
+  }
+
+  uint64_t start_ns() const { return start_ns_; }
+
+private:
+  const char *name_;
+  Context ctx_;
+  uint64_t id_ = 0;
+  uint64_t start_ns_ = 0;
+  bool ended_ = false;
+};
+
+// Records a span whose timing was measured elsewhere (e.g. libcurl's
+// per-phase timers), relative to the tracer clock.
+inline void record(const char *name, const Context &ctx, uint64_t start_ns,
+                   uint64_t end_ns) {
+  if (ctx.sampled)
+    Tracer::instance().record(name, ctx, start_ns, end_ns);
+}
+
+// Tracer clock reading, or 0 when `ctx` is not sampled.
+inline uint64_t now_ns(const Context &ctx) {
+  return ctx.sampled ? Tracer::instance().now_ns() : 0;
+}
+
+} // namespace asr_trace
@@ -0,0 +1,223 @@
+// Upstream endpoint selection for the ASR MCP servers.
+//
+// ASR_API_URLS (batch server, refinement) and ASR_WS_HOSTS (streaming
+// server) list replicas of the ASR service, comma separated. Each new
+// request or stream goes to the endpoint with the lowest EWMA latency,
+// scaled by the requests it already has in flight. Endpoints without a
+// sample yet are tried first. An endpoint that fails is skipped for
+// RETRY_AFTER, then tried again.
+//
+//   asr_upstream::Lease lease = endpoints.acquire();
+//   ... request to endpoints.address(lease.index()) ...
+//   endpoints.record(lease.index(), elapsed);   // or record_failure()
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace asr_upstream {
+
+constexpr double EWMA_ALPHA = 0.3; // Weight of the newest sample
+constexpr std::chrono::seconds RETRY_AFTER(30);
+constexpr size_t LATENCY_WINDOW = 128;
+constexpr size_t MIN_PERCENTILE_SAMPLES = 20;
+constexpr size_t NO_ENDPOINT = static_cast<size_t>(-1);
+
+// Entries of a comma-separated list, blanks trimmed and empties dropped.
+inline std::vector<std::string> split_list(const std::string &list) {
+  std::vector<std::string> items;
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos)
+      end = list.size();
+    size_t first = list.find_first_not_of(" \t", start);
+    if (first != std::string::npos && first < end) {
+      size_t last = list.find_last_not_of(" \t", end - 1);
+      items.push_back(list.substr(first, last - first + 1));
+    }
+    start = end + 1;
+  }
+  return items;
+}
+
+// The list in environment variable `name`, or `fallback` if it is unset or
+// empty.
+inline std::vector<std::string> env_list(const char *name,
+                                         const std::string &fallback) {
+  const char *value = std::getenv(name);
+  std::vector<std::string> items =
+      value ? split_list(value) : std::vector<std::string>();
+  if (items.empty())
+    items.push_back(fallback);
+  return items;
+}
+
+class Endpoints;
+
+// An endpoint chosen for one request; counts as in flight until destroyed.
+class Lease {
+public:
+  Lease() = default;
+  Lease(Endpoints *endpoints, size_t index)
+      : endpoints_(endpoints), index_(index) {}
+  Lease(Lease &&other) noexcept { *this = std::move(other); }
+  Lease &operator=(Lease &&other) noexcept;
+  Lease(const Lease &) = delete;
+  Lease &operator=(const Lease &) = delete;
+  ~Lease() { reset(); }
+
+  size_t index() const { return index_; }
+  explicit operator bool() const { return endpoints_ != nullptr; }
+  void reset();
+
+private:
+  Endpoints *endpoints_ = nullptr;
+  size_t index_ = NO_ENDPOINT;
+};
+
+class Endpoints {
+public:
+  explicit Endpoints(std::vector<std::string> addresses)
+      : addresses_(std::move(addresses)), stats_(addresses_.size()) {}
+
+  Endpoints(const Endpoints &) = delete;
+  Endpoints &operator=(const Endpoints &) = delete;
+
+  size_t size() const { return addresses_.size(); }
+  const std::string &address(size_t i) const { return addresses_[i]; }
+
+  // The best endpoint other than `exclude` (unless it is the only one).
+  Lease acquire(size_t exclude = NO_ENDPOINT) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto now = std::chrono::steady_clock::now();
+    size_t best = NO_ENDPOINT;
+    double best_score = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < stats_.size(); ++i) {
+      if (i == exclude && stats_.size() > 1)
+        continue;
+      double s = score(stats_[i], now);
+      if (best == NO_ENDPOINT || s < best_score) {
+        best = i;
+        best_score = s;
+      }
+    }
+    ++stats_[best].in_flight;
+    return Lease(this, best);
+  }
+
+  // A completed request's latency.
+  void record(size_t i, std::chrono::steady_clock::duration latency) {
+    const double ms =
+        std::chrono::duration<double, std::milli>(latency).count();
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats &s = stats_[i];
+    s.ewma_ms =
+        s.sampled ? EWMA_ALPHA * ms + (1 - EWMA_ALPHA) * s.ewma_ms : ms;
+    s.sampled = true;
+    s.failed = false;
+  }
+
+  void record_failure(size_t i) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_[i].failed = true;
+    stats_[i].failed_at = std::chrono::steady_clock::now();
+  }
+
+  double ewma_ms(size_t i) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_[i].ewma_ms;
+  }
+
+private:
+  friend class Lease;
+
+  struct Stats {
+    double ewma_ms = 0;
+    bool sampled = false;
+    unsigned in_flight = 0;
+    bool failed = false;
+    std::chrono::steady_clock::time_point failed_at;
+  };
+
+  // Lower is better. Untried endpoints score by their in-flight count alone,
+  // so each gets a sample; a recent failure ranks behind every healthy one.
+  static double score(const Stats &s,
+                      std::chrono::steady_clock::time_point now) {
+    double base = s.sampled ? s.ewma_ms * (s.in_flight + 1) : s.in_flight;
+    if (s.failed && now - s.failed_at < RETRY_AFTER)
+      base += 1e12;
+    return base;
+  }
+
+  void release(size_t i) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --stats_[i].in_flight;
+  }
+
+  std::vector<std::string> addresses_;
+  mutable std::mutex mutex_;
+  std::vector<Stats> stats_;
+};
+
+inline Lease &Lease::operator=(Lease &&other) noexcept {
+  if (this != &other) {
+    reset();
+    endpoints_ = other.endpoints_;
+    index_ = other.index_;
+    other.endpoints_ = nullptr;
+    other.index_ = NO_ENDPOINT;
+  }
+  return *this;
+}
+
+inline void Lease::reset() {
+  if (endpoints_)
+    endpoints_->release(index_);
+  endpoints_ = nullptr;
+  index_ = NO_ENDPOINT;
+}
+
+// Recent latencies of one kind of request, for deadlines such as the hedge
+// delay of short batch clips.
+class LatencyWindow {
+public:
+  void add(std::chrono::steady_clock::duration latency) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (samples_.size() < LATENCY_WINDOW)
+      samples_.push_back(latency);
+    else
+      samples_[next_] = latency;
+    next_ = (next_ + 1) % LATENCY_WINDOW;
+  }
+
+  // The `p` quantile (0..1) of the window; zero until there are
+  // MIN_PERCENTILE_SAMPLES.
+  std::chrono::steady_clock::duration percentile(double p) const {
+    std::vector<std::chrono::steady_clock::duration> sorted;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (samples_.size() < MIN_PERCENTILE_SAMPLES)
+        return std::chrono::steady_clock::duration::zero();
+      sorted = samples_;
+    }
+    size_t k = std::min(sorted.size() - 1,
+                        static_cast<size_t>(p * sorted.size()));
+    std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+    return sorted[k];
+  }
+
+private:
+  mutable std::mutex mutex_;
+  std::vector<std::chrono::steady_clock::duration> samples_;
+  size_t next_ = 0;
+};
+
+} // namespace asr_upstream
@@ -0,0 +1,596 @@
+// Client connections for the ASR MCP servers: the raw newline-JSON TCP
+// protocol and WebSocket (RFC 6455) for browser and Electron clients.
+//
+// Both servers accept WebSocket clients on a second port (ASR_MCP_WS_PORT,
+// default 8081, 0 disables). A WebSocket client sends control messages as
+// text frames holding the same JSON as the TCP protocol and audio as binary
+// frames of raw samples in the negotiated format, so no base64 is needed.
+// Responses are text frames, one JSON object each.
+//
+// Outbound messages are queued per connection and written without blocking:
+// the session flushes once per loop iteration, so a burst of results goes
+// out in one sendmsg, and a client that stops reading is disconnected once
+// its backlog passes MAX_PENDING_BYTES instead of stalling the session.
+//
+// Sessions talk to a ClientChannel and never see which transport is in use.
+// Clients on the local Unix socket (asr_local.h) use the raw protocol.
+
+#pragma once
+
+#include "asr_protocol.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <poll.h>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
+
+namespace asr_ws {
+
+constexpr int DEFAULT_PORT = 8081;
+constexpr size_t RECV_CHUNK = 16384;
+constexpr size_t MAX_HANDSHAKE_BYTES = 8192;
+constexpr int HANDSHAKE_TIMEOUT_MS = 5000;
+constexpr size_t MAX_MESSAGE_BYTES = 1 << 20;
+constexpr size_t MAX_PENDING_BYTES = 4 << 20; // Backlog of a slow reader
+constexpr size_t MAX_IOV = 64;                // Messages gathered per sendmsg
+constexpr size_t SPARE_BUFFERS = 16;          // Recycled outbound buffers
+constexpr size_t MAX_SPARE_CAPACITY = 64 * 1024;
+constexpr size_t MAX_PASSED_FDS = 2;          // Per send_with_fds()
+constexpr const char *ACCEPT_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// Port of the WebSocket listener; 0 when disabled.
+inline int listen_port() {
+  const char *env_port = std::getenv("ASR_MCP_WS_PORT");
+  if (env_port && *env_port)
+    return std::atoi(env_port);
+  return DEFAULT_PORT;
+}
+
+// SHA-1, needed only for Sec-WebSocket-Accept.
+inline void sha1(const uint8_t *data, size_t len, uint8_t digest[20]) {
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                   0xC3D2E1F0};
+  auto rol = [](uint32_t v, int n) { return (v << n) | (v >> (32 - n)); };
+
+  std::vector<uint8_t> msg(data, data + len);
+  msg.push_back(0x80);
+  while (msg.size() % 64 != 56)
+    msg.push_back(0);
+  const uint64_t bits = static_cast<uint64_t>(len) * 8;
+  for (int i = 7; i >= 0; --i)
+    msg.push_back(static_cast<uint8_t>(bits >> (8 * i)));
+
+  for (size_t block = 0; block < msg.size(); block += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+      const uint8_t *p = &msg[block + 4 * i];
+      w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+             (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+    for (int i = 16; i < 80; ++i)
+      w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; ++i) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t t = rol(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rol(b, 30);
+      b = a;
+      a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+  for (int i = 0; i < 5; ++i) {
+    digest[4 * i] = static_cast<uint8_t>(h[i] >> 24);
+    digest[4 * i + 1] = static_cast<uint8_t>(h[i] >> 16);
+    digest[4 * i + 2] = static_cast<uint8_t>(h[i] >> 8);
+    digest[4 * i + 3] = static_cast<uint8_t>(h[i]);
+  }
+}
+
+inline std::string accept_key(const std::string &client_key) {
+  const std::string joined = client_key + ACCEPT_GUID;
+  uint8_t digest[20];
+  sha1(reinterpret_cast<const uint8_t *>(joined.data()), joined.size(),
+       digest);
+  return asr_protocol::base64_encode(digest, sizeof(digest));
+}
+
+// Value of header `name` (lower case) in a request head, trimmed; empty if
+// absent.
+inline std::string header_value(const std::string &head,
+                                const std::string &name) {
+  std::string lower(head);
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  size_t pos = lower.find("\r\n" + name + ":");
+  if (pos == std::string::npos)
+    return "";
+  size_t start = head.find_first_not_of(" \t", pos + name.size() + 3);
+  size_t end = head.find("\r\n", pos + 2);
+  if (start == std::string::npos || start >= end)
+    return "";
+  size_t last = head.find_last_not_of(" \t", end - 1);
+  return head.substr(start, last - start + 1);
+}
+
+// XORs a payload with its 4-byte masking key, eight bytes at a time.
+inline void unmask(uint8_t *data, size_t len, const uint8_t key[4]) {
+  uint64_t key64;
+  uint8_t *k = reinterpret_cast<uint8_t *>(&key64);
+  for (int i = 0; i < 8; ++i)
+    k[i] = key[i % 4];
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t v;
+    memcpy(&v, data + i, 8);
+    v ^= key64;
+    memcpy(data + i, &v, 8);
+  }
+  for (; i < len; ++i)
+    data[i] ^= key[i % 4];
+}
+
+struct Message {
+  bool binary = false; // Audio samples; otherwise a JSON control message
+  std::string data;
+};
+
+// The messages of one receive(). Slots keep their buffers from one call to
+// the next, so steady-state receiving does not allocate.
+class MessageBatch {
+public:
+  void clear() { count_ = 0; }
+  size_t size() const { return count_; }
+  const Message *begin() const { return slots_.data(); }
+  const Message *end() const { return slots_.data() + count_; }
+
+  Message &next() {
+    if (count_ == slots_.size())
+      slots_.emplace_back();
+    return slots_[count_++];
+  }
+
+private:
+  std::vector<Message> slots_;
+  size_t count_ = 0;
+};
+
+class ClientChannel {
+public:
+  ClientChannel(int fd, bool websocket)
+      : fd_(fd), websocket_(websocket), open_(!websocket) {}
+
+  ClientChannel(const ClientChannel &) = delete;
+  ClientChannel &operator=(const ClientChannel &) = delete;
+
+  int fd() const { return fd_; }
+  bool websocket() const { return websocket_; }
+
+  // WebSocket: reads the HTTP upgrade request and completes the handshake.
+  // Raw TCP: nothing to do.
+  bool handshake() {
+    if (!websocket_)
+      return true;
+    size_t head_end;
+    while ((head_end = in_.find("\r\n\r\n")) == std::string::npos) {
+      struct pollfd pfd = {fd_, POLLIN, 0};
+      if (in_.size() > MAX_HANDSHAKE_BYTES ||
+          poll(&pfd, 1, HANDSHAKE_TIMEOUT_MS) <= 0 || !read_some()) {
+        return false;
+      }
+    }
+    const std::string head = in_.substr(0, head_end + 2);
+    in_.erase(0, head_end + 4);
+
+    std::string upgrade = header_value(head, "upgrade");
+    std::transform(upgrade.begin(), upgrade.end(), upgrade.begin(), ::tolower);
+    const std::string key = header_value(head, "sec-websocket-key");
+    if (head.compare(0, 4, "GET ") != 0 || upgrade != "websocket" ||
+        key.empty() || header_value(head, "sec-websocket-version") != "13") {
+      static const char BAD_REQUEST[] =
+          "HTTP/1.1 400 Bad Request\r\nSec-WebSocket-Version: 13\r\n"
+          "Content-Length: 0\r\nConnection: close\r\n\r\n";
+      send_all(BAD_REQUEST, sizeof(BAD_REQUEST) - 1);
+      return false;
+    }
+    const std::string response = "HTTP/1.1 101 Switching Protocols\r\n"
+                                 "Upgrade: websocket\r\n"
+                                 "Connection: Upgrade\r\n"
+                                 "Sec-WebSocket-Accept: " +
+                                 accept_key(key) + "\r\n\r\n";
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    open_ = send_all(response.data(), response.size());
+    return open_;
+  }
+
+  // Call when the socket is readable. Appends the complete messages
+  // received; returns false once the client has gone or broken the
+  // protocol. On raw TCP each complete line, newline included, is a
+  // message, so pipelined requests are handled one by one.
+  bool receive(MessageBatch &out) {
+    if (!read_some())
+      return false;
+    if (!websocket_)
+      return split_lines(out);
+    return parse_frames(out);
+  }
+
+  // Queues one JSON message: a line on raw TCP, a text frame on WebSocket.
+  // It is written by the next flush(). Safe to call from any thread;
+  // dropped before the handshake completes. Returns false, with errno set,
+  // once the connection has failed or the client has stopped reading.
+  bool queue(std::string_view json) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (!open_)
+      return false;
+    return queue_locked(OP_TEXT, json.data(), json.size());
+  }
+
+  // Writes as much of the queue as the socket accepts without blocking,
+  // gathering queued messages into one sendmsg. The rest waits for the next
+  // call; poll for POLLOUT while pending(). False once the connection has
+  // failed.
+  bool flush() {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    return flush_locked();
+  }
+
+  bool pending() {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    return !out_.empty();
+  }
+
+  // Unix sockets only: sends one JSON line now, after the queue, with
+  // `count` descriptors attached (SCM_RIGHTS). False with errno set if the
+  // queue cannot be written first or the message does not go out.
+  bool send_with_fds(std::string_view json, const int *fds, size_t count) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (websocket_ || count == 0 || count > MAX_PASSED_FDS) {
+      errno = EINVAL;
+      return false;
+    }
+    if (!flush_locked())
+      return false;
+    if (!out_.empty()) {
+      errno = EAGAIN;
+      return false;
+    }
+    std::string line(json);
+    line += '\n';
+    struct iovec iov = {line.data(), line.size()};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) *
+                                                    MAX_PASSED_FDS)] = {};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+
+    ssize_t n;
+    do {
+      n = sendmsg(fd_, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+      return false;
+    // The descriptors went with the first byte; the rest is ordinary output
+    if (static_cast<size_t>(n) < line.size()) {
+      line.erase(0, static_cast<size_t>(n));
+      pending_bytes_ += line.size();
+      out_.push_back(std::move(line));
+    }
+    return true;
+  }
+
+private:
+  enum Opcode : uint8_t {
+    OP_CONTINUATION = 0x0,
+    OP_TEXT = 0x1,
+    OP_BINARY = 0x2,
+    OP_CLOSE = 0x8,
+    OP_PING = 0x9,
+    OP_PONG = 0xA,
+  };
+
+  bool read_some() {
+    char buffer[RECV_CHUNK];
+    ssize_t n = recv(fd_, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (n > 0) {
+      in_.append(buffer, static_cast<size_t>(n));
+      return true;
+    }
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+  }
+
+  bool send_all(const char *data, size_t len) {
+    while (len > 0) {
+      ssize_t n = ::send(fd_, data, len, MSG_NOSIGNAL);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+      data += n;
+      len -= static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  static void append_frame_header(std::string &wire, Opcode op, size_t len) {
+    wire += static_cast<char>(0x80 | op); // FIN, unmasked (server side)
+    if (len < 126) {
+      wire += static_cast<char>(len);
+    } else if (len <= 0xFFFF) {
+      wire += static_cast<char>(126);
+      wire += static_cast<char>(len >> 8);
+      wire += static_cast<char>(len & 0xFF);
+    } else {
+      wire += static_cast<char>(127);
+      for (int i = 7; i >= 0; --i)
+        wire += static_cast<char>((static_cast<uint64_t>(len) >> (8 * i)) &
+                                  0xFF);
+    }
+  }
+
+  void send_control(Opcode op, const char *payload, size_t len) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (queue_locked(op, payload, len))
+      flush_locked();
+  }
+
+  bool queue_locked(Opcode op, const char *payload, size_t len) {
+    if (failed_) {
+      errno = failed_errno_;
+      return false;
+    }
+    std::string buffer;
+    if (!spare_.empty()) {
+      buffer = std::move(spare_.back());
+      spare_.pop_back();
+    }
+    if (websocket_) {
+      append_frame_header(buffer, op, len);
+      buffer.append(payload, len);
+    } else {
+      buffer.append(payload, len);
+      buffer += '\n';
+    }
+    pending_bytes_ += buffer.size();
+    out_.push_back(std::move(buffer));
+    if (pending_bytes_ > MAX_PENDING_BYTES) {
+      fail_output(ENOBUFS);
+      return false;
+    }
+    return true;
+  }
+
+  bool flush_locked() {
+    while (!failed_ && !out_.empty()) {
+      struct iovec iov[MAX_IOV];
+      size_t count = 0;
+      for (; count < MAX_IOV && count < out_.size(); ++count) {
+        const std::string &buffer = out_[count];
+        const size_t skip = count == 0 ? out_offset_ : 0;
+        iov[count].iov_base = const_cast<char *>(buffer.data() + skip);
+        iov[count].iov_len = buffer.size() - skip;
+      }
+      struct msghdr msg = {};
+      msg.msg_iov = iov;
+      msg.msg_iovlen = count;
+      ssize_t n = sendmsg(fd_, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+          return true;
+        fail_output(errno);
+        return false;
+      }
+      consume(static_cast<size_t>(n));
+    }
+    if (failed_)
+      errno = failed_errno_;
+    return !failed_;
+  }
+
+  // Drops `n` written bytes from the front of the queue, keeping emptied
+  // buffers for reuse.
+  void consume(size_t n) {
+    pending_bytes_ -= n;
+    while (n > 0) {
+      std::string &front = out_.front();
+      const size_t left = front.size() - out_offset_;
+      if (n < left) {
+        out_offset_ += n;
+        return;
+      }
+      n -= left;
+      out_offset_ = 0;
+      recycle(std::move(front));
+      out_.pop_front();
+    }
+  }
+
+  void recycle(std::string &&buffer) {
+    if (spare_.size() < SPARE_BUFFERS &&
+        buffer.capacity() <= MAX_SPARE_CAPACITY) {
+      buffer.clear();
+      spare_.push_back(std::move(buffer));
+    }
+  }
+
+  // The queue is abandoned; the session sees the failure on its next flush.
+  void fail_output(int error) {
+    failed_ = true;
+    failed_errno_ = error;
+    out_.clear();
+    out_offset_ = 0;
+    pending_bytes_ = 0;
+    errno = error;
+  }
+
+  void fail(uint16_t code) {
+    const char payload[2] = {static_cast<char>(code >> 8),
+                             static_cast<char>(code & 0xFF)};
+    send_control(OP_CLOSE, payload, sizeof(payload));
+  }
+
+  bool split_lines(MessageBatch &out) {
+    size_t pos = 0;
+    size_t end;
+    while ((end = in_.find('\n', pos)) != std::string::npos) {
+      Message &message = out.next();
+      message.binary = false;
+      message.data.assign(in_, pos, end + 1 - pos);
+      pos = end + 1;
+    }
+    in_.erase(0, pos);
+    return in_.size() <= MAX_MESSAGE_BYTES;
+  }
+
+  // Decodes every complete frame in in_. Fragmented messages are collected
+  // in partial_ until their final frame.
+  bool parse_frames(MessageBatch &out) {
+    size_t pos = 0;
+    while (true) {
+      const uint8_t *p = reinterpret_cast<const uint8_t *>(in_.data()) + pos;
+      const size_t avail = in_.size() - pos;
+      if (avail < 2)
+        break;
+      const bool fin = p[0] & 0x80;
+      const uint8_t op = p[0] & 0x0F;
+      const bool masked = p[1] & 0x80;
+      uint64_t len = p[1] & 0x7F;
+      size_t header = 2;
+      if (len == 126) {
+        if (avail < 4)
+          break;
+        len = (uint64_t(p[2]) << 8) | p[3];
+        header = 4;
+      } else if (len == 127) {
+        if (avail < 10)
+          break;
+        len = 0;
+        for (int i = 0; i < 8; ++i)
+          len = (len << 8) | p[2 + i];
+        header = 10;
+      }
+      // Clients must mask every frame
+      if (!masked || (p[0] & 0x70)) {
+        fail(1002);
+        return false;
+      }
+      if (len > MAX_MESSAGE_BYTES ||
+          partial_.size() + len > MAX_MESSAGE_BYTES) {
+        fail(1009);
+        return false;
+      }
+      if (avail < header + 4 + len)
+        break;
+
+      uint8_t key[4];
+      memcpy(key, p + header, 4);
+      uint8_t *payload = reinterpret_cast<uint8_t *>(&in_[pos + header + 4]);
+      unmask(payload, static_cast<size_t>(len), key);
+      pos += header + 4 + static_cast<size_t>(len);
+
+      const char *data = reinterpret_cast<const char *>(payload);
+      switch (op) {
+      case OP_TEXT:
+      case OP_BINARY:
+        if (in_message_) {
+          fail(1002);
+          return false;
+        }
+        partial_binary_ = op == OP_BINARY;
+        in_message_ = !fin;
+        if (fin) {
+          Message &message = out.next();
+          message.binary = partial_binary_;
+          message.data.assign(data, static_cast<size_t>(len));
+        } else {
+          partial_.assign(data, static_cast<size_t>(len));
+        }
+        break;
+      case OP_CONTINUATION:
+        if (!in_message_) {
+          fail(1002);
+          return false;
+        }
+        partial_.append(data, static_cast<size_t>(len));
+        if (fin) {
+          in_message_ = false;
+          Message &message = out.next();
+          message.binary = partial_binary_;
+          message.data.swap(partial_); // partial_ reuses the slot's buffer
+          partial_.clear();
+        }
+        break;
+      case OP_PING:
+        send_control(OP_PONG, data, static_cast<size_t>(len));
+        break;
+      case OP_PONG:
+        break;
+      case OP_CLOSE:
+        // Echo the status code back and end the session
+        send_control(OP_CLOSE, data, std::min<size_t>(len, 2));
+        return false;
+      default:
+        fail(1002);
+        return false;
+      }
+    }
+    in_.erase(0, pos);
+    return true;
+  }
+
+  int fd_;
+  bool websocket_;
+  std::string in_;
+  std::string partial_;
+  bool partial_binary_ = false;
+  bool in_message_ = false;
+  std::mutex send_mutex_;
+  // Guarded by send_mutex_
+  bool open_;
+  std::deque<std::string> out_; // Encoded messages not yet fully written
+  size_t out_offset_ = 0;       // Bytes of out_.front() already written
+  size_t pending_bytes_ = 0;
+  std::vector<std::string> spare_;
+  bool failed_ = false;
+  int failed_errno_ = 0;
+};
+
+} // namespace asr_ws
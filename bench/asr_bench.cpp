@@ -0,0 +1,242 @@
+// Microbenchmarks for the MCP server hot paths. Run with e.g.
+//   ./asr_bench --benchmark_repetitions=5 --benchmark_out=baseline.json
+// and compare runs with Google Benchmark's tools/compare.py.
+
+#include "asr_arena.h"
+#include "asr_convert.h"
+#include "asr_pool.h"
+#include "asr_protocol.h"
+#include "asr_rules.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// base64 of `bytes` pseudo-random bytes, as the client sends audio chunks.
+std::string make_base64(size_t bytes) {
+  std::mt19937 rng(42);
+  std::string out;
+  out.reserve((bytes + 2) / 3 * 4);
+  for (size_t i = 0; i < bytes; i += 3) {
+    uint32_t n = rng() & 0xFFFFFF;
+    size_t chars = bytes - i >= 3 ? 4 : bytes - i + 1;
+    for (size_t c = 0; c < 4; ++c) {
+      out += c < chars ? asr_protocol::BASE64_CHARS[(n >> (18 - 6 * c)) & 0x3F]
+                       : '=';
+    }
+  }
+  return out;
+}
+
+// UTF-8 of CJK ideograph `i` of the first few thousand
+std::string ideograph(uint32_t i) {
+  const uint32_t cp = 0x4E00 + i;
+  return {static_cast<char>(0xE0 | (cp >> 12)),
+          static_cast<char>(0x80 | ((cp >> 6) & 0x3F)),
+          static_cast<char>(0x80 | (cp & 0x3F))};
+}
+
+// A conversion stage the size of OpenCC's Traditional-to-Simplified set:
+// 3000 characters and 50000 phrases of two to four of the first 800.
+const asr_convert::Dictionary &conversion_dictionary() {
+  static std::string text;
+  static asr_convert::Dictionary dictionary;
+  if (text.empty()) {
+    std::mt19937 rng(42);
+    for (uint32_t i = 0; i < 3000; ++i)
+      text += ideograph(i) + "\t" + ideograph(rng() % 3000) + "\n";
+    for (int i = 0; i < 50000; ++i) {
+      std::string phrase, value;
+      for (uint32_t n = 2 + rng() % 3; n > 0; --n) {
+        phrase += ideograph(rng() % 800);
+        value += ideograph(rng() % 3000);
+      }
+      text += phrase + "\t" + value + "\n";
+    }
+    dictionary.add(text);
+    dictionary.build();
+  }
+  return dictionary;
+}
+
+// A tenant with 5000 hotwords of two or three of the first 800 ideographs
+// and the phone and ID redactions.
+const asr_rules::Rules &tenant_rules() {
+  static std::shared_ptr<const asr_rules::Rules> rules;
+  if (!rules) {
+    std::mt19937 rng(42);
+    std::string text = "redact\t####~####\t[PHONE]\n"
+                       "redact\t@######(#)\t[HKID]\n";
+    for (int i = 0; i < 5000; ++i) {
+      std::string phrase;
+      for (uint32_t n = 2 + rng() % 2; n > 0; --n)
+        phrase += ideograph(rng() % 800);
+      text += "replace\t" + phrase + "\t" + ideograph(rng() % 3000) + "\n";
+    }
+    rules = asr_rules::Rules::compile(text, "bench");
+  }
+  return *rules;
+}
+
+std::string stream_audio_message(size_t pcm_bytes) {
+  return "{\"method\":\"stream_audio\",\"data\":\"" + make_base64(pcm_bytes) +
+         "\"}\n";
+}
+
+} // namespace
+
+// 100 ms .. 1 s of 16 kHz s16le audio per chunk.
+static void BM_Base64Decode(benchmark::State &state) {
+  const std::string encoded = make_base64(state.range(0));
+  for (auto _ : state) {
+    auto decoded = asr_protocol::base64_decode(encoded);
+    benchmark::DoNotOptimize(decoded.data());
+  }
+  state.SetBytesProcessed(state.iterations() * encoded.size());
+}
+BENCHMARK(BM_Base64Decode)->Arg(3200)->Arg(12800)->Arg(32000);
+
+// Transcript text with a realistic sprinkling of characters to escape; the
+// same loop serves send_error and handle_message.
+static void BM_JsonEscape(benchmark::State &state) {
+  std::string text;
+  const std::string sentence =
+      "He said \"turn left\" at C:\\path then stopped.\n";
+  while (text.size() < static_cast<size_t>(state.range(0)))
+    text += sentence;
+  text.resize(state.range(0));
+  for (auto _ : state) {
+    auto escaped = asr_protocol::json_escape(text);
+    benchmark::DoNotOptimize(escaped.data());
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_JsonEscape)->Arg(64)->Arg(512)->Arg(4096);
+
+// A cumulative final that extends the previous one by a short phrase.
+static void BM_StripDuplicatePrefix(benchmark::State &state) {
+  std::string last;
+  while (last.size() < static_cast<size_t>(state.range(0)))
+    last += "the quick brown fox jumps over the lazy dog ";
+  const std::string text = last + "and keeps running";
+  for (auto _ : state) {
+    auto suffix = asr_protocol::strip_duplicate_prefix(last, text);
+    benchmark::DoNotOptimize(suffix.data());
+  }
+}
+BENCHMARK(BM_StripDuplicatePrefix)->Arg(64)->Arg(1024)->Arg(8192);
+
+// A final of `range` ideographs run through one conversion stage, into
+// reused buffers as the servers do.
+static void BM_ConvertResult(benchmark::State &state) {
+  const asr_convert::Dictionary &dictionary = conversion_dictionary();
+  std::mt19937 rng(7);
+  std::string text;
+  for (int64_t i = 0; i < state.range(0); ++i)
+    text += ideograph(rng() % 900);
+  std::string out;
+  out.reserve(2 * text.size());
+  for (auto _ : state) {
+    out.clear();
+    dictionary.convert(text, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_ConvertResult)->Arg(16)->Arg(64)->Arg(512);
+
+// A final of `range` ideographs with a phone number in it, through a
+// tenant's rules into a reused buffer.
+static void BM_ApplyRules(benchmark::State &state) {
+  const asr_rules::Rules &rules = tenant_rules();
+  std::mt19937 rng(7);
+  std::string text;
+  for (int64_t i = 0; i < state.range(0); ++i)
+    text += ideograph(rng() % 900);
+  text.insert(text.size() / 2, " 9123 4567 ");
+  std::string out;
+  out.reserve(2 * text.size());
+  for (auto _ : state) {
+    out.clear();
+    rules.apply(text, out, true);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_ApplyRules)->Arg(16)->Arg(64)->Arg(512);
+
+// handle_session builds a std::string from the receive buffer, then
+// dispatches on the method.
+static void BM_DispatchStreamAudio(benchmark::State &state) {
+  const std::string wire = stream_audio_message(state.range(0));
+  for (auto _ : state) {
+    std::string msg(wire.data(), wire.size());
+    benchmark::DoNotOptimize(asr_protocol::parse_method(msg));
+  }
+  state.SetBytesProcessed(state.iterations() * wire.size());
+}
+BENCHMARK(BM_DispatchStreamAudio)->Arg(3200)->Arg(12800);
+
+static void BM_DispatchFinalize(benchmark::State &state) {
+  const std::string wire = "{\"method\":\"finalize_transcription\"}\n";
+  for (auto _ : state) {
+    std::string msg(wire.data(), wire.size());
+    benchmark::DoNotOptimize(asr_protocol::parse_method(msg));
+  }
+}
+BENCHMARK(BM_DispatchFinalize);
+
+// The rest of a stream_audio message: decode into the session arena and
+// format the acknowledgement. Allocation-free once the arena is warm.
+static void BM_StreamAudioArena(benchmark::State &state) {
+  const std::string msg = stream_audio_message(state.range(0));
+  const size_t data_start = msg.find("\"data\":\"") + 8;
+  const size_t data_len = msg.find('"', data_start) - data_start;
+  asr_arena::MessageArena arena;
+  for (auto _ : state) {
+    arena.reset();
+    asr_arena::Bytes audio(arena.resource());
+    asr_protocol::base64_decode(msg.data() + data_start, data_len, audio);
+    asr_arena::String ack(arena.resource());
+    asr_protocol::format_count(ack, asr_protocol::AUDIO_RECEIVED, audio.size());
+    benchmark::DoNotOptimize(ack.data());
+  }
+  state.SetBytesProcessed(state.iterations() * msg.size());
+}
+BENCHMARK(BM_StreamAudioArena)->Arg(3200)->Arg(12800)->Arg(32000);
+
+namespace {
+
+// Stand-in for the batch server's ASRConnection: no network, same interface.
+class FakeConnection {
+public:
+  bool is_valid() const { return true; }
+  bool is_in_use() const { return in_use_; }
+  void set_in_use(bool in_use) { in_use_ = in_use; }
+
+private:
+  bool in_use_ = false;
+};
+
+constexpr size_t BENCH_POOL_SIZE = 4;
+
+} // namespace
+
+// Acquire/release round trips with more threads than connections, as when
+// many sessions finalize at once.
+static void BM_PoolAcquireRelease(benchmark::State &state) {
+  static asr_pool::ConnectionPool<FakeConnection> pool(BENCH_POOL_SIZE);
+  for (auto _ : state) {
+    FakeConnection *conn = pool.acquire();
+    benchmark::DoNotOptimize(conn);
+    pool.release(conn);
+  }
+}
+BENCHMARK(BM_PoolAcquireRelease)->ThreadRange(1, 16)->UseRealTime();
+
+BENCHMARK_MAIN();
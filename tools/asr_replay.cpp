@@ -0,0 +1,646 @@
+// Replays a session capture (see asr_capture.h) against a running ASR MCP
+// server and reports how response timing compares with the recording.
+//
+//   asr_replay CAPTURE [--server HOST:PORT] [--speed X]
+//              [--mock-http PORT | --mock-wss PORT]
+//
+// Every captured session is reopened at its recorded offset and its client
+// frames are re-sent byte for byte at their recorded times, divided by
+// --speed. With --mock-http or --mock-wss the tool also plays the upstream
+// ASR service: the batch server (ASR_API_URL=http://127.0.0.1:PORT/...) or
+// the streaming server (ASR_WS_HOST=127.0.0.1 ASR_WS_PORT=PORT
+// ASR_TLS_VERIFY=0) then gets the recorded upstream responses at their
+// recorded latency, so runs are repeatable without the real service.
+
+#include "asr_capture.h"
+
+#include <boost/asio/ssl.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/beast/websocket/ssl.hpp>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace beast = boost::beast;
+namespace websocket = beast::websocket;
+namespace net = boost::asio;
+namespace ssl = net::ssl;
+using tcp = net::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr int SESSION_TAIL_MS = 2000; // Wait for late responses after the last frame
+constexpr int MOCK_BACKLOG = 64;
+
+struct Timed {
+  uint64_t offset_ns; // From the start of the session / exchange
+  std::string data;
+};
+
+struct SessionTrace {
+  uint32_t id = 0;
+  uint64_t open_ns = 0;
+  uint64_t close_ns = 0;
+  std::vector<Timed> client_frames;
+  std::vector<Timed> server_frames;
+};
+
+// One upstream connection (streaming) or request (batch) and what the
+// service sent back.
+struct Exchange {
+  uint64_t open_ns = 0;
+  std::vector<Timed> messages;
+};
+
+struct Options {
+  std::string capture;
+  std::string host = "127.0.0.1";
+  int port = 8080;
+  double speed = 1.0;
+  int mock_http_port = 0;
+  int mock_wss_port = 0;
+};
+
+Clock::duration scaled(uint64_t ns, double speed) {
+  return std::chrono::nanoseconds(static_cast<int64_t>(ns / speed));
+}
+
+double to_ms(Clock::duration d) {
+  return std::chrono::duration<double, std::milli>(d).count();
+}
+
+void build_traces(const std::vector<asr_capture::Event> &events,
+                  std::vector<SessionTrace> &sessions,
+                  std::vector<Exchange> &exchanges) {
+  std::map<uint32_t, SessionTrace> by_id;
+  std::map<uint32_t, size_t> open_exchange; // session -> index in exchanges
+
+  for (const auto &ev : events) {
+    if (ev.session == 0)
+      continue;
+    SessionTrace &s = by_id[ev.session];
+    switch (ev.kind) {
+    case asr_capture::Kind::SessionOpen:
+      s.id = ev.session;
+      s.open_ns = ev.t_ns;
+      break;
+    case asr_capture::Kind::SessionClose:
+      s.close_ns = ev.t_ns;
+      break;
+    case asr_capture::Kind::ClientFrame:
+      s.client_frames.push_back({ev.t_ns - s.open_ns, ev.data});
+      break;
+    case asr_capture::Kind::ServerFrame:
+      s.server_frames.push_back({ev.t_ns - s.open_ns, ev.data});
+      break;
+    case asr_capture::Kind::UpstreamOpen:
+      open_exchange[ev.session] = exchanges.size();
+      exchanges.push_back({ev.t_ns, {}});
+      break;
+    case asr_capture::Kind::UpstreamMessage: {
+      auto it = open_exchange.find(ev.session);
+      if (it != open_exchange.end()) {
+        Exchange &ex = exchanges[it->second];
+        ex.messages.push_back({ev.t_ns - ex.open_ns, ev.data});
+      }
+      break;
+    }
+    }
+  }
+
+  for (auto &entry : by_id) {
+    if (entry.second.id != 0 && !entry.second.client_frames.empty())
+      sessions.push_back(std::move(entry.second));
+  }
+}
+
+// Hands recorded exchanges to mock connections in the order they were
+// opened.
+class ExchangeQueue {
+public:
+  explicit ExchangeQueue(std::vector<Exchange> exchanges)
+      : exchanges_(std::move(exchanges)) {}
+
+  bool next(Exchange &out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (next_ >= exchanges_.size())
+      return false;
+    out = exchanges_[next_++];
+    return true;
+  }
+
+private:
+  std::mutex mutex_;
+  std::vector<Exchange> exchanges_;
+  size_t next_ = 0;
+};
+
+int listen_on(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  int opt = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      listen(fd, MOCK_BACKLOG) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool send_all(int fd, const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+    if (n <= 0)
+      return false;
+    data += n;
+    len -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+// Mock batch backend: plain HTTP/1.1, one recorded response per request
+// ----------------------------------------------------------------------------
+
+size_t content_length(const std::string &headers) {
+  std::string lower(headers);
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  size_t pos = lower.find("\r\ncontent-length:");
+  if (pos == std::string::npos)
+    return 0;
+  return std::strtoul(lower.c_str() + pos + 17, nullptr, 10);
+}
+
+// Appends at least one more received chunk to `pending`.
+bool recv_more(int fd, std::string &pending) {
+  char buf[16384];
+  ssize_t n = recv(fd, buf, sizeof(buf), 0);
+  if (n <= 0)
+    return false;
+  pending.append(buf, static_cast<size_t>(n));
+  return true;
+}
+
+// Consumes a chunked body starting at `pos`; false on EOF.
+bool read_chunked_body(int fd, std::string &pending, size_t pos) {
+  while (true) {
+    size_t line_end;
+    while ((line_end = pending.find("\r\n", pos)) == std::string::npos) {
+      if (!recv_more(fd, pending))
+        return false;
+    }
+    size_t chunk = std::strtoul(pending.c_str() + pos, nullptr, 16);
+    // Chunk data plus CRLF; the last chunk is followed by an empty trailer
+    size_t next = line_end + 2 + chunk + 2;
+    while (pending.size() < next) {
+      if (!recv_more(fd, pending))
+        return false;
+    }
+    pos = next;
+    if (chunk == 0) {
+      pending.erase(0, pos);
+      return true;
+    }
+  }
+}
+
+// Reads one request; returns false on EOF. Handles Content-Length bodies and
+// the chunked bodies the batch server sends for uploads made while the
+// client is still recording.
+bool read_http_request(int fd, std::string &pending) {
+  size_t header_end;
+  while ((header_end = pending.find("\r\n\r\n")) == std::string::npos) {
+    if (!recv_more(fd, pending))
+      return false;
+  }
+  const std::string headers = pending.substr(0, header_end + 2);
+  if (headers.find("100-continue") != std::string::npos) {
+    static const char CONTINUE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    send_all(fd, CONTINUE, sizeof(CONTINUE) - 1);
+  }
+  std::string lower(headers);
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  if (lower.find("transfer-encoding: chunked") != std::string::npos)
+    return read_chunked_body(fd, pending, header_end + 4);
+
+  const size_t total = header_end + 4 + content_length(headers);
+  while (pending.size() < total) {
+    if (!recv_more(fd, pending))
+      return false;
+  }
+  pending.erase(0, total);
+  return true;
+}
+
+void serve_http_client(int fd, ExchangeQueue &queue, double speed) {
+  std::string pending;
+  while (true) {
+    Clock::time_point start = Clock::now();
+    if (!read_http_request(fd, pending))
+      break;
+
+    Exchange ex;
+    if (!queue.next(ex))
+      ex.messages.push_back({0, "{\"text\":\"\"}"});
+    size_t body_len = 0;
+    for (const auto &m : ex.messages)
+      body_len += m.data.size();
+
+    // Headers go out with the first recorded chunk
+    std::string head = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                       "Content-Length: " +
+                       std::to_string(body_len) + "\r\n\r\n";
+    bool ok = true;
+    for (size_t i = 0; ok && i < ex.messages.size(); ++i) {
+      std::this_thread::sleep_until(start +
+                                    scaled(ex.messages[i].offset_ns, speed));
+      std::string out = i == 0 ? head + ex.messages[i].data
+                               : ex.messages[i].data;
+      ok = send_all(fd, out.data(), out.size());
+    }
+    if (!ok)
+      break;
+  }
+  close(fd);
+}
+
+void run_http_mock(int listen_fd, ExchangeQueue &queue, double speed) {
+  while (true) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0)
+      break;
+    std::thread(serve_http_client, fd, std::ref(queue), speed).detach();
+  }
+}
+
+// ----------------------------------------------------------------------------
+// Mock streaming backend: WebSocket over TLS with a throwaway certificate
+// ----------------------------------------------------------------------------
+
+// Self-signed P-256 certificate for CN=localhost, valid for a day.
+bool use_self_signed_certificate(ssl::context &ctx) {
+  EVP_PKEY *key = EVP_EC_gen("P-256");
+  X509 *cert = X509_new();
+  bool ok = key && cert;
+  if (ok) {
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 86400);
+    X509_set_pubkey(cert, key);
+    X509_NAME *name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(
+        name, "CN", MBSTRING_ASC,
+        reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    ok = X509_sign(cert, key, EVP_sha256()) > 0 &&
+         SSL_CTX_use_certificate(ctx.native_handle(), cert) == 1 &&
+         SSL_CTX_use_PrivateKey(ctx.native_handle(), key) == 1;
+  }
+  X509_free(cert);
+  EVP_PKEY_free(key);
+  return ok;
+}
+
+using WssStream = websocket::stream<beast::ssl_stream<tcp::socket>>;
+
+// Discards audio from the client while replaying the recorded messages on
+// a timer; one io_context per connection keeps the stream single-threaded.
+class WssSession {
+public:
+  WssSession(net::io_context &ioc, tcp::socket socket, ssl::context &ctx,
+             Exchange exchange, double speed)
+      : ws_(std::move(socket), ctx), timer_(ioc),
+        exchange_(std::move(exchange)), speed_(speed) {}
+
+  void run() {
+    try {
+      ws_.next_layer().handshake(ssl::stream_base::server);
+      ws_.accept();
+    } catch (const std::exception &e) {
+      fprintf(stderr, "mock-wss: handshake failed: %s\n", e.what());
+      return;
+    }
+    ws_.text(true);
+    start_ = Clock::now();
+    read_next();
+    write_next();
+  }
+
+private:
+  void read_next() {
+    ws_.async_read(buffer_, [this](beast::error_code ec, size_t) {
+      if (ec) {
+        timer_.cancel();
+        return;
+      }
+      buffer_.clear();
+      read_next();
+    });
+  }
+
+  void write_next() {
+    if (next_ >= exchange_.messages.size())
+      return;
+    timer_.expires_at(start_ +
+                      scaled(exchange_.messages[next_].offset_ns, speed_));
+    timer_.async_wait([this](beast::error_code ec) {
+      if (ec)
+        return;
+      ws_.async_write(net::buffer(exchange_.messages[next_].data),
+                      [this](beast::error_code ec, size_t) {
+                        if (ec)
+                          return;
+                        ++next_;
+                        write_next();
+                      });
+    });
+  }
+
+  WssStream ws_;
+  net::steady_timer timer_;
+  beast::flat_buffer buffer_;
+  Exchange exchange_;
+  double speed_;
+  Clock::time_point start_;
+  size_t next_ = 0;
+};
+
+void run_wss_mock(int port, ExchangeQueue &queue, double speed) {
+  ssl::context ctx(ssl::context::tls_server);
+  if (!use_self_signed_certificate(ctx)) {
+    fprintf(stderr, "mock-wss: cannot create certificate\n");
+    return;
+  }
+  net::io_context accept_ioc;
+  tcp::acceptor acceptor(accept_ioc,
+                         {net::ip::make_address("127.0.0.1"),
+                          static_cast<unsigned short>(port)});
+  while (true) {
+    auto ioc = std::make_shared<net::io_context>();
+    tcp::socket socket(*ioc);
+    beast::error_code ec;
+    acceptor.accept(socket, ec);
+    if (ec)
+      break;
+    Exchange ex;
+    queue.next(ex);
+    std::thread([ioc, &ctx, ex = std::move(ex), speed,
+                 socket = std::move(socket)]() mutable {
+      WssSession session(*ioc, std::move(socket), ctx, std::move(ex), speed);
+      session.run();
+      ioc->run();
+    }).detach();
+  }
+}
+
+// ----------------------------------------------------------------------------
+// Client side
+// ----------------------------------------------------------------------------
+
+struct SessionResult {
+  uint32_t id = 0;
+  bool connected = false;
+  size_t recorded_responses = 0;
+  size_t replayed_responses = 0;
+  std::vector<double> lag_ms; // Replayed minus recorded offset, per response
+};
+
+int connect_to(const Options &opt) {
+  addrinfo hints = {}, *res = nullptr;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(opt.host.c_str(), std::to_string(opt.port).c_str(), &hints,
+                  &res) != 0) {
+    return -1;
+  }
+  int fd = socket(res->ai_family, res->ai_socktype, 0);
+  if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if (fd >= 0) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return fd;
+}
+
+void replay_session(const Options &opt, const SessionTrace &trace,
+                    Clock::time_point run_start, uint64_t capture_start_ns,
+                    SessionResult &result) {
+  result.id = trace.id;
+  result.recorded_responses = trace.server_frames.size();
+
+  std::this_thread::sleep_until(
+      run_start + scaled(trace.open_ns - capture_start_ns, opt.speed));
+  int fd = connect_to(opt);
+  if (fd < 0)
+    return;
+  result.connected = true;
+  const Clock::time_point start = Clock::now();
+
+  std::vector<Clock::duration> arrivals;
+  std::mutex arrivals_mutex;
+  std::thread reader([&] {
+    std::string pending;
+    char buf[16384];
+    while (true) {
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0)
+        break;
+      pending.append(buf, static_cast<size_t>(n));
+      size_t nl;
+      while ((nl = pending.find('\n')) != std::string::npos) {
+        pending.erase(0, nl + 1);
+        std::lock_guard<std::mutex> lock(arrivals_mutex);
+        arrivals.push_back(Clock::now() - start);
+      }
+    }
+  });
+
+  for (const auto &frame : trace.client_frames) {
+    std::this_thread::sleep_until(start + scaled(frame.offset_ns, opt.speed));
+    if (!send_all(fd, frame.data.data(), frame.data.size()))
+      break;
+  }
+
+  // Give the server until the recorded end of the session (or the last
+  // recorded response) plus a grace period
+  uint64_t end_ns = trace.client_frames.back().offset_ns;
+  if (!trace.server_frames.empty())
+    end_ns = std::max(end_ns, trace.server_frames.back().offset_ns);
+  if (trace.close_ns > trace.open_ns)
+    end_ns = std::max(end_ns, trace.close_ns - trace.open_ns);
+  const Clock::time_point deadline =
+      start + scaled(end_ns, opt.speed) +
+      std::chrono::milliseconds(SESSION_TAIL_MS);
+  while (Clock::now() < deadline) {
+    {
+      std::lock_guard<std::mutex> lock(arrivals_mutex);
+      if (arrivals.size() >= trace.server_frames.size())
+        break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  shutdown(fd, SHUT_RDWR);
+  reader.join();
+  close(fd);
+
+  result.replayed_responses = arrivals.size();
+  size_t matched = std::min(arrivals.size(), trace.server_frames.size());
+  for (size_t i = 0; i < matched; ++i) {
+    result.lag_ms.push_back(
+        to_ms(arrivals[i] - scaled(trace.server_frames[i].offset_ns,
+                                   opt.speed)));
+  }
+}
+
+double percentile(std::vector<double> values, double p) {
+  if (values.empty())
+    return 0.0;
+  std::sort(values.begin(), values.end());
+  size_t idx = static_cast<size_t>(std::ceil(p * values.size())) - 1;
+  return values[std::min(idx, values.size() - 1)];
+}
+
+void usage(const char *argv0) {
+  fprintf(stderr,
+          "Usage: %s CAPTURE [--server HOST:PORT] [--speed X]\n"
+          "          [--mock-http PORT | --mock-wss PORT]\n",
+          argv0);
+}
+
+bool parse_args(int argc, char *argv[], Options &opt) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--server" && has_value) {
+      std::string server = argv[++i];
+      size_t colon = server.rfind(':');
+      if (colon == std::string::npos)
+        return false;
+      opt.host = server.substr(0, colon);
+      opt.port = std::atoi(server.c_str() + colon + 1);
+    } else if (arg == "--speed" && has_value) {
+      opt.speed = std::atof(argv[++i]);
+    } else if (arg == "--mock-http" && has_value) {
+      opt.mock_http_port = std::atoi(argv[++i]);
+    } else if (arg == "--mock-wss" && has_value) {
+      opt.mock_wss_port = std::atoi(argv[++i]);
+    } else if (opt.capture.empty() && arg[0] != '-') {
+      opt.capture = arg;
+    } else {
+      return false;
+    }
+  }
+  return !opt.capture.empty() && opt.speed > 0 &&
+         !(opt.mock_http_port && opt.mock_wss_port);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Options opt;
+  if (!parse_args(argc, argv, opt)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::vector<asr_capture::Event> events;
+  if (!asr_capture::read_file(opt.capture, events)) {
+    fprintf(stderr, "Cannot read capture %s\n", opt.capture.c_str());
+    return 1;
+  }
+  std::vector<SessionTrace> sessions;
+  std::vector<Exchange> exchanges;
+  build_traces(events, sessions, exchanges);
+  if (sessions.empty()) {
+    fprintf(stderr, "No client sessions in %s\n", opt.capture.c_str());
+    return 1;
+  }
+  printf("Replaying %zu sessions (%zu upstream exchanges) at %.2fx against "
+         "%s:%d\n",
+         sessions.size(), exchanges.size(), opt.speed, opt.host.c_str(),
+         opt.port);
+
+  ExchangeQueue queue(std::move(exchanges));
+  if (opt.mock_http_port) {
+    int fd = listen_on(opt.mock_http_port);
+    if (fd < 0) {
+      fprintf(stderr, "Cannot listen on mock port %d\n", opt.mock_http_port);
+      return 1;
+    }
+    std::thread(run_http_mock, fd, std::ref(queue), opt.speed).detach();
+  } else if (opt.mock_wss_port) {
+    std::thread(run_wss_mock, opt.mock_wss_port, std::ref(queue), opt.speed)
+        .detach();
+  }
+
+  const uint64_t capture_start_ns = sessions.front().open_ns;
+  const Clock::time_point run_start = Clock::now();
+  std::vector<SessionResult> results(sessions.size());
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < sessions.size(); ++i) {
+    threads.emplace_back(replay_session, std::cref(opt), std::cref(sessions[i]),
+                         run_start, capture_start_ns, std::ref(results[i]));
+  }
+  for (auto &t : threads)
+    t.join();
+
+  std::vector<double> all_lag;
+  size_t failed = 0;
+  printf("%8s %10s %10s %10s %10s\n", "session", "recorded", "replayed",
+         "p50_lag_ms", "max_lag_ms");
+  for (const auto &r : results) {
+    if (!r.connected) {
+      printf("%8u  connect failed\n", r.id);
+      ++failed;
+      continue;
+    }
+    if (r.replayed_responses < r.recorded_responses)
+      ++failed;
+    all_lag.insert(all_lag.end(), r.lag_ms.begin(), r.lag_ms.end());
+    printf("%8u %10zu %10zu %10.1f %10.1f\n", r.id, r.recorded_responses,
+           r.replayed_responses, percentile(r.lag_ms, 0.5),
+           percentile(r.lag_ms, 1.0));
+  }
+  printf("\nresponses: %zu  lag p50 %.1f ms  p95 %.1f ms  p99 %.1f ms  "
+         "max %.1f ms\n",
+         all_lag.size(), percentile(all_lag, 0.5), percentile(all_lag, 0.95),
+         percentile(all_lag, 0.99), percentile(all_lag, 1.0));
+  if (failed)
+    printf("%zu sessions incomplete\n", failed);
+  return failed ? 1 : 0;
+}
@@ -13,6 +13,8 @@ class ASRClient extends EventEmitter {
     this.port = 8080;
     this.buffer = Buffer.alloc(0);
     this.transcriptionStarted = false;
+    this.audioFormat = null;
+    this.migrateTimer = null;
   }
   
 
@@ -29,8 +31,8 @@ class ASRClient extends EventEmitter {
   }
 
   connectWebSocket() {
-    // For now, we'll use TCP socket to connect to MCP server
-    // The MCP server uses TCP, not WebSocket
+    // The main process can reach the server's TCP port directly; the
+    // WebSocket port (8081) is for browser-side clients, see PROTOCOL.md
     this.connectTCP();
   }
 
@@ -133,7 +135,7 @@ class ASRClient extends EventEmitter {
       // Start transcription after initialization
       if (!this.transcriptionStarted) {
         console.log('[ASRClient] Sending transcribe request...');
-        const sent = this.sendMessage({ method: 'transcribe' });
+        const sent = this.sendMessage({ method: 'transcribe', ...this.formatFields() });
         console.log('[ASRClient] Transcribe request sent:', sent ? 'success' : 'failed');
       } else {
         console.log('[ASRClient] Transcription already started, skipping');
@@ -151,7 +153,7 @@ class ASRClient extends EventEmitter {
         console.log('[ASRClient] ✓✓✓ EXTRACTED TEXT: "' + message.text + '" ✓✓✓');
         console.log('[ASRClient] ✓✓✓ EMITTING TRANSCRIPTION EVENT ✓✓✓');
         console.log('='.repeat(80) + '\n');
-        this.emit('transcription', message.text);
+        this.emit('transcription', message.text, message.utterance);
       } else {
         console.log('[ASRClient] ⚠️  Transcription message missing text field');
         console.log('[ASRClient] Message keys:', Object.keys(message));
@@ -161,6 +163,10 @@ class ASRClient extends EventEmitter {
           this.emit('transcription', message.data);
         }
       }
+    } else if (message.type === 'refined') {
+      // Batch-grade text for an utterance already delivered as 'transcription'
+      console.log('[ASRClient] Refined utterance', message.utterance + ':', message.text);
+      this.emit('refined', message.utterance, message.text);
     } else if (message.type === 'error') {
       this.emit('error', message.message || 'Unknown error');
     } else if (message.type === 'transcription_started') {
@@ -170,6 +176,11 @@ class ASRClient extends EventEmitter {
     } else if (message.type === 'transcription_stopped') {
       console.log('Transcription stopped');
       this.transcriptionStarted = false;
+    } else if (message.type === 'draining') {
+      console.log('[ASRClient] Server is restarting, migrating connection');
+      this.scheduleMigration();
+    } else if (message.type === 'audio_configured') {
+      console.log('[ASRClient] Server audio format:', message.format);
     } else if (message.type === 'audio_sent') {
       // Acknowledgment that audio was received
       // No action needed
@@ -179,6 +190,73 @@ class ASRClient extends EventEmitter {
     }
   }
 
+  // The server handed its port to a new process. Reconnect after a random
+  // delay so clients do not all reconnect at once; the old connection stays
+  // open until it has delivered its remaining results.
+  scheduleMigration() {
+    if (this.migrateTimer) {
+      return;
+    }
+    const delay = Math.floor(Math.random() * 5000);
+    this.migrateTimer = setTimeout(() => {
+      this.migrateTimer = null;
+      this.migrateConnection();
+    }, delay);
+  }
+
+  migrateConnection() {
+    const old = this.socket;
+    if (!old || old.destroyed) {
+      return;
+    }
+
+    old.removeAllListeners();
+    old.on('error', () => old.destroy());
+    let pending = Buffer.alloc(0);
+    old.on('data', (data) => {
+      pending = Buffer.concat([pending, data]);
+      let newlineIndex;
+      while ((newlineIndex = pending.indexOf('\n')) !== -1) {
+        const line = pending.slice(0, newlineIndex).toString();
+        pending = pending.slice(newlineIndex + 1);
+        try {
+          const message = JSON.parse(line);
+          if (message.type === 'transcription') {
+            this.handleMessage(message);
+          } else if (message.type === 'transcription_complete' ||
+                     message.type === 'transcription_stopped') {
+            old.destroy();
+          }
+        } catch (error) {
+          // Ignore partial or malformed lines on the old connection
+        }
+      }
+    });
+    old.write(JSON.stringify({ method: 'finalize_transcription' }) + '\n');
+    setTimeout(() => old.destroy(), 30000);
+
+    this.socket = null;
+    this.connectTCP();
+  }
+
+  setAudioFormat(format) {
+    this.audioFormat = format;
+    if (this.isConnected) {
+      this.sendMessage({ method: 'configure_audio', ...this.formatFields() });
+    }
+  }
+
+  formatFields() {
+    if (!this.audioFormat) {
+      return {};
+    }
+    return {
+      sample_rate: this.audioFormat.sampleRate,
+      channels: this.audioFormat.channels,
+      encoding: this.audioFormat.encoding
+    };
+  }
+
   sendMessage(message) {
     if (!this.socket || !this.isConnected) {
       return false;
@@ -219,7 +297,7 @@ class ASRClient extends EventEmitter {
       // Auto-start transcription if not started
       if (!this.transcriptionStarted) {
         console.log('[ASRClient] Auto-starting transcription now');
-        this.sendMessage({ method: 'transcribe' });
+        this.sendMessage({ method: 'transcribe', ...this.formatFields() });
         // Set flag optimistically - server should confirm
         this.transcriptionStarted = true;
       }
@@ -274,6 +352,11 @@ class ASRClient extends EventEmitter {
   }
 
   disconnect() {
+    if (this.migrateTimer) {
+      clearTimeout(this.migrateTimer);
+      this.migrateTimer = null;
+    }
+
     if (this.socket && !this.socket.destroyed) {
       // Send finalize message (non-blocking)
       this.sendMessage({
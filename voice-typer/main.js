@@ -141,6 +141,14 @@ function initializeNativeModules() {
       }
     });
     
+    // Handle capture format reported by renderer
+    ipcMain.on('audio-format', (event, format) => {
+      console.log('[Main] Audio format from renderer:', format);
+      if (asrClient) {
+        asrClient.setAudioFormat(format);
+      }
+    });
+    
     // Handle audio capture errors from renderer
     ipcMain.on('audio-error', (event, error) => {
       console.error('[Main] Audio capture error from renderer:', error);
@@ -60,6 +60,14 @@ class AudioCaptureWeb extends EventEmitter {
 
       console.log('[AudioCaptureWeb] AudioContext created, sample rate:', this.audioContext.sampleRate);
 
+      // The browser may not honour the requested rate; report what we actually
+      // produce so the server can resample to 16 kHz
+      this.emit('format', {
+        sampleRate: this.audioContext.sampleRate,
+        channels: this.channels,
+        encoding: 's16le'
+      });
+
       // Create MediaStreamAudioSourceNode
       this.mediaStreamSource = this.audioContext.createMediaStreamSource(this.mediaStream);
 
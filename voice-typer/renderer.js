@@ -144,6 +144,12 @@ audioCapture.on('audioData', (audioBuffer) => {
   ipcRenderer.send('audio-data', audioBuffer);
 });
 
+// Report the actual capture format so the server can normalize it
+audioCapture.on('format', (format) => {
+  console.log('[Renderer] Audio format:', format);
+  ipcRenderer.send('audio-format', format);
+});
+
 // Set up error handler
 audioCapture.on('error', (error) => {
   console.error('[Renderer] Audio capture error:', error);